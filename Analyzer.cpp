@@ -0,0 +1,455 @@
+//
+//  Analyzer.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "Analyzer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <limits>
+
+Analyzer::Analyzer(real _xMin, real _xMax, real _step)
+    : xMin(_xMin),
+      xMax(_xMax),
+      step(_step),
+      curves()
+{
+}
+
+void Analyzer::addExpression(size_type expressionIndex, const Expression &expression)
+{
+    curves.emplace_back(expressionIndex, expression);
+}
+
+std::vector<CriticalPoint> Analyzer::analyze(const std::atomic<bool> &cancelled) const
+{
+    std::vector<real> xs;
+    for (real x = xMin; x < xMax + step; x += step)
+    {
+        xs.push_back(x);
+    }
+    
+    ThreadPool &pool = ThreadPool::globalInstance();
+    
+    // Sample every curve once, the same values are used for roots, extrema and intersections
+    std::vector<std::vector<real>> ys(curves.size());
+    std::vector<std::vector<CriticalPoint>> curveResults(curves.size());
+    
+    pool.parallelFor(curves.size(), [&](size_type i)
+    {
+        if (cancelled) return;
+        
+        const Expression &expression = curves[i].second;
+        
+        ys[i].resize(xs.size());
+        expression.evaluate(xs.data(), ys[i].data(), xs.size());
+        
+        curveResults[i] = findRoots(i, xs, ys[i]);
+        
+        std::vector<CriticalPoint> extrema = findExtrema(i, xs, ys[i]);
+        curveResults[i].insert(curveResults[i].end(), extrema.begin(), extrema.end());
+    });
+    
+    std::vector<std::pair<size_type, size_type>> pairs;
+    for (size_type i = 0; i < curves.size(); ++i)
+    {
+        for (size_type j = i + 1; j < curves.size(); ++j)
+        {
+            pairs.emplace_back(i, j);
+        }
+    }
+    
+    std::vector<std::vector<CriticalPoint>> pairResults(pairs.size());
+    
+    pool.parallelFor(pairs.size(), [&](size_type i)
+    {
+        if (cancelled) return;
+        
+        pairResults[i] = findIntersections(pairs[i].first, pairs[i].second, xs, ys[pairs[i].first], ys[pairs[i].second]);
+    });
+    
+    std::vector<CriticalPoint> result;
+    for (const std::vector<CriticalPoint> &points : curveResults)
+    {
+        result.insert(result.end(), points.begin(), points.end());
+    }
+    
+    for (const std::vector<CriticalPoint> &points : pairResults)
+    {
+        result.insert(result.end(), points.begin(), points.end());
+    }
+    
+    std::sort(result.begin(), result.end(), [](const CriticalPoint &a, const CriticalPoint &b) { return a.x < b.x; });
+    
+    return result;
+}
+
+real Analyzer::findRoot(const std::function<real(real)> &f, real a, real b, real fa, real fb)
+{
+    const real epsilon = std::numeric_limits<real>::epsilon();
+    const real absoluteTolerance = epsilon * std::fabs(b - a);
+    
+    real c = b, fc = fb;
+    real d = b - a, e = d;
+    
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration)
+    {
+        if ((fb > 0 && fc > 0) || (fb < 0 && fc < 0))
+        { // Keep the root between b and c
+            c = a;
+            fc = fa;
+            e = d = b - a;
+        }
+        
+        if (std::fabs(fc) < std::fabs(fb))
+        { // b is the best estimate
+            a = b;
+            b = c;
+            c = a;
+            fa = fb;
+            fb = fc;
+            fc = fa;
+        }
+        
+        real tolerance = 2 * epsilon * std::fabs(b) + absoluteTolerance;
+        real m = (c - b) / 2;
+        
+        if (std::fabs(m) <= tolerance || fb == 0) break;
+        
+        if (std::fabs(e) >= tolerance && std::fabs(fa) > std::fabs(fb))
+        { // Try interpolation
+            real p, q;
+            real s = fb / fa;
+            
+            if (a == c)
+            { // Secant
+                p = 2 * m * s;
+                q = 1 - s;
+            }
+            else
+            { // Inverse quadratic
+                real r = fb / fc;
+                q = fa / fc;
+                p = s * (2 * m * q * (q - r) - (b - a) * (r - 1));
+                q = (q - 1) * (r - 1) * (s - 1);
+            }
+            
+            if (p > 0) q = -q;
+            p = std::fabs(p);
+            
+            if (2 * p < std::min(3 * m * q - std::fabs(tolerance * q), std::fabs(e * q)))
+            {
+                e = d;
+                d = p / q;
+            }
+            else
+            { // Interpolation failed, bisect
+                d = m;
+                e = d;
+            }
+        }
+        else
+        { // Bisect
+            d = m;
+            e = d;
+        }
+        
+        a = b;
+        fa = fb;
+        
+        if (std::fabs(d) > tolerance)
+            b += d;
+        else
+            b += m > 0 ? tolerance : -tolerance;
+        
+        fb = f(b);
+    }
+    
+    return b;
+}
+
+real Analyzer::findRootNewton(const std::function<std::pair<real, real>(real)> &df, real a, real b, real fa, real fb)
+{
+    const real epsilon = std::numeric_limits<real>::epsilon();
+    
+    if (fa == 0) return a;
+    if (fb == 0) return b;
+    
+    // Orient the bracket so that f(low) < 0 < f(high)
+    real low = fa < 0 ? a : b;
+    real high = fa < 0 ? b : a;
+    
+    real x = (a + b) / 2;
+    real dxOld = std::fabs(b - a);
+    real dx = dxOld;
+    
+    std::pair<real, real> fx = df(x);
+    
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration)
+    {
+        real newtonX = x - fx.first / fx.second;
+        
+        if (!std::isfinite(newtonX) || (newtonX - low) * (newtonX - high) > 0 || std::fabs(2 * fx.first) > std::fabs(dxOld * fx.second))
+        { // Newton would leave the bracket or converges too slowly, bisect
+            dxOld = dx;
+            dx = (high - low) / 2;
+            x = low + dx;
+        }
+        else
+        {
+            dxOld = dx;
+            dx = newtonX - x;
+            x = newtonX;
+        }
+        
+        if (std::fabs(dx) <= 2 * epsilon * std::fabs(x) + epsilon * std::fabs(b - a)) break;
+        
+        fx = df(x);
+        
+        if (fx.first == 0) break;
+        
+        if (fx.first < 0)
+            low = x;
+        else
+            high = x;
+    }
+    
+    return x;
+}
+
+real Analyzer::findMinimum(const std::function<real(real)> &f, real a, real b)
+{
+    const real golden = 0.381966011250105151795413165634361882279690820194237137864551377294739537181097550292792795810608862515245L;
+    const real relativeTolerance = std::sqrt(std::numeric_limits<real>::epsilon());
+    const real absoluteTolerance = std::numeric_limits<real>::epsilon() * std::fabs(b - a);
+    
+    real x = a + golden * (b - a);
+    real w = x, v = x;
+    real fx = f(x);
+    real fw = fx, fv = fx;
+    real d = 0, e = 0;
+    
+    for (int iteration = 0; iteration < MAX_ITERATIONS; ++iteration)
+    {
+        real m = (a + b) / 2;
+        real tolerance = relativeTolerance * std::fabs(x) + absoluteTolerance;
+        
+        if (std::fabs(x - m) <= 2 * tolerance - (b - a) / 2) break;
+        
+        bool goldenSection = true;
+        
+        if (std::fabs(e) > tolerance)
+        { // Try a parabolic fit through x, w and v
+            real r = (x - w) * (fx - fv);
+            real q = (x - v) * (fx - fw);
+            real p = (x - v) * q - (x - w) * r;
+            q = 2 * (q - r);
+            
+            if (q > 0) p = -p;
+            q = std::fabs(q);
+            
+            real previousE = e;
+            e = d;
+            
+            if (std::fabs(p) < std::fabs(q * previousE / 2) && p > q * (a - x) && p < q * (b - x))
+            {
+                d = p / q;
+                goldenSection = false;
+                
+                real u = x + d;
+                if (u - a < 2 * tolerance || b - u < 2 * tolerance) d = m > x ? tolerance : -tolerance;
+            }
+        }
+        
+        if (goldenSection)
+        {
+            e = x >= m ? a - x : b - x;
+            d = golden * e;
+        }
+        
+        real u = std::fabs(d) >= tolerance ? x + d : x + (d > 0 ? tolerance : -tolerance);
+        real fu = f(u);
+        
+        if (fu <= fx)
+        {
+            if (u >= x)
+                a = x;
+            else
+                b = x;
+            
+            v = w;
+            fv = fw;
+            w = x;
+            fw = fx;
+            x = u;
+            fx = fu;
+        }
+        else
+        {
+            if (u < x)
+                a = u;
+            else
+                b = u;
+            
+            if (fu <= fw || w == x)
+            {
+                v = w;
+                fv = fw;
+                w = u;
+                fw = fu;
+            }
+            else if (fu <= fv || v == x || v == w)
+            {
+                v = u;
+                fv = fu;
+            }
+        }
+    }
+    
+    return x;
+}
+
+std::vector<real> Analyzer::refineSignChanges(const std::function<real(real)> &f, const std::function<std::pair<real, real>(real)> &df, const std::vector<real> &xs, const std::vector<real> &ys)
+{
+    std::vector<real> roots;
+    
+    for (std::vector<real>::size_type i = 0; i + 1 < xs.size(); ++i)
+    {
+        real fa = ys[i];
+        real fb = ys[i + 1];
+        
+        if (fa == 0)
+        {
+            roots.push_back(xs[i]);
+        }
+        else if ((fa < 0 && fb > 0) || (fa > 0 && fb < 0))
+        {
+            real root = df ? findRootNewton(df, xs[i], xs[i + 1], fa, fb) : findRoot(f, xs[i], xs[i + 1], fa, fb);
+            
+            // A sign change across a pole or a jump converges to the discontinuity, not to a zero
+            if (std::fabs(f(root)) <= 1e-6 * std::max(std::fabs(fa), std::fabs(fb)))
+            {
+                roots.push_back(root);
+            }
+        }
+    }
+    
+    return roots;
+}
+
+std::vector<CriticalPoint> Analyzer::findRoots(size_type curveIndex, const std::vector<real> &xs, const std::vector<real> &ys) const
+{
+    const Expression &expression = curves[curveIndex].second;
+    
+    std::function<std::pair<real, real>(real)> df;
+    if (expression.isDifferentiable())
+    {
+        df = [&expression](real x) { return expression.evaluateDerivative(x); };
+    }
+    
+    std::vector<real> roots = refineSignChanges([&expression](real x) { return expression.evaluate(x); }, df, xs, ys);
+    
+    std::vector<CriticalPoint> result;
+    for (real x : roots)
+    {
+        CriticalPoint point = {CriticalPoint::ROOT, curves[curveIndex].first, curves[curveIndex].first, x, 0};
+        result.push_back(point);
+    }
+    
+    return result;
+}
+
+std::vector<CriticalPoint> Analyzer::findExtrema(size_type curveIndex, const std::vector<real> &xs, const std::vector<real> &ys) const
+{
+    const Expression &expression = curves[curveIndex].second;
+    
+    std::vector<CriticalPoint> result;
+    
+    for (std::vector<real>::size_type i = 1; i + 1 < xs.size(); ++i)
+    {
+        real before = ys[i] - ys[i - 1];
+        real after = ys[i + 1] - ys[i];
+        
+        bool isMaximum = before > 0 && after < 0;
+        bool isMinimum = before < 0 && after > 0;
+        
+        if (!isMaximum && !isMinimum) continue;
+        
+        real a = xs[i - 1];
+        real b = xs[i + 1];
+        real x;
+        
+        std::pair<real, real> da, db;
+        if (expression.isDifferentiable())
+        {
+            da = expression.evaluateDerivative(a);
+            db = expression.evaluateDerivative(b);
+        }
+        
+        if (expression.isDifferentiable() && ((da.second < 0 && db.second > 0) || (da.second > 0 && db.second < 0)))
+        { // The derivative changes sign, find its root
+            x = findRoot([&expression](real t) { return expression.evaluateDerivative(t).second; }, a, b, da.second, db.second);
+        }
+        else
+        {
+            real sign = isMinimum ? 1 : -1;
+            x = findMinimum([&expression, sign](real t) { return sign * expression.evaluate(t); }, a, b);
+        }
+        
+        real y = expression.evaluate(x);
+        
+        // Around a pole the samples look like an extremum, but the refined value runs away
+        if (!std::isfinite(y) || std::fabs(y - ys[i]) > 4 * (std::fabs(before) + std::fabs(after))) continue;
+        
+        CriticalPoint point = {isMinimum ? CriticalPoint::MINIMUM : CriticalPoint::MAXIMUM, curves[curveIndex].first, curves[curveIndex].first, x, y};
+        result.push_back(point);
+        
+        // Double roots touch the x-axis without changing sign
+        if (std::fabs(y) <= 1e-12 * (std::fabs(ys[i - 1]) + std::fabs(ys[i + 1])))
+        {
+            point.kind = CriticalPoint::ROOT;
+            result.push_back(point);
+        }
+    }
+    
+    return result;
+}
+
+std::vector<CriticalPoint> Analyzer::findIntersections(size_type firstCurve, size_type secondCurve, const std::vector<real> &xs, const std::vector<real> &firstYs, const std::vector<real> &secondYs) const
+{
+    const Expression &first = curves[firstCurve].second;
+    const Expression &second = curves[secondCurve].second;
+    
+    std::vector<real> differences(xs.size());
+    for (std::vector<real>::size_type i = 0; i != xs.size(); ++i)
+    {
+        differences[i] = firstYs[i] - secondYs[i];
+    }
+    
+    std::function<std::pair<real, real>(real)> df;
+    if (first.isDifferentiable() && second.isDifferentiable())
+    {
+        df = [&first, &second](real x)
+        {
+            std::pair<real, real> a = first.evaluateDerivative(x);
+            std::pair<real, real> b = second.evaluateDerivative(x);
+            
+            return std::make_pair(a.first - b.first, a.second - b.second);
+        };
+    }
+    
+    std::vector<real> roots = refineSignChanges([&first, &second](real x) { return first.evaluate(x) - second.evaluate(x); }, df, xs, differences);
+    
+    std::vector<CriticalPoint> result;
+    for (real x : roots)
+    {
+        CriticalPoint point = {CriticalPoint::INTERSECTION, curves[firstCurve].first, curves[secondCurve].first, x, first.evaluate(x)};
+        result.push_back(point);
+    }
+    
+    return result;
+}
@@ -0,0 +1,76 @@
+//
+//  Analyzer.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__Analyzer__
+#define __MathGraph__Analyzer__
+
+#include "real.h"
+#include "Expression.h"
+
+#include <vector>
+#include <utility>
+#include <functional>
+#include <atomic>
+
+struct CriticalPoint
+{
+    enum Kind
+    {
+        ROOT,
+        MINIMUM,
+        MAXIMUM,
+        INTERSECTION
+    };
+    
+    Kind kind;
+    std::vector<Expression>::size_type first;
+    std::vector<Expression>::size_type second; // Only used by intersections
+    real x, y;
+};
+
+class Analyzer
+{
+public:
+    typedef std::vector<Expression>::size_type size_type;
+    
+    Analyzer(real _xMin, real _xMax, real _step);
+    
+    void addExpression(size_type expressionIndex, const Expression &expression);
+    
+    // Roots, extrema and pairwise intersections of all added expressions, sorted by x. Curves
+    // and pairs that are not started when cancelled is set are skipped, the result is then partial.
+    std::vector<CriticalPoint> analyze(const std::atomic<bool> &cancelled) const;
+    
+    // Brent's method, f(a) and f(b) must have different signs
+    static real findRoot(const std::function<real(real)> &f, real a, real b, real fa, real fb);
+    
+    // Newton's method kept inside the bracket [a, b], df returns (f(x), f'(x))
+    static real findRootNewton(const std::function<std::pair<real, real>(real)> &df, real a, real b, real fa, real fb);
+    
+    // Brent's method, local minimum of f in [a, b]
+    static real findMinimum(const std::function<real(real)> &f, real a, real b);
+    
+private:
+    static const int MAX_ITERATIONS = 100;
+    
+    real xMin, xMax;
+    
+    // Distance between samples, refinement only looks for one root or extremum per step
+    real step;
+    
+    std::vector<std::pair<size_type, Expression>> curves;
+    
+    // Refines every sign change of the sampled values ys, df may be empty
+    static std::vector<real> refineSignChanges(const std::function<real(real)> &f, const std::function<std::pair<real, real>(real)> &df, const std::vector<real> &xs, const std::vector<real> &ys);
+    
+    std::vector<CriticalPoint> findRoots(size_type curveIndex, const std::vector<real> &xs, const std::vector<real> &ys) const;
+    std::vector<CriticalPoint> findExtrema(size_type curveIndex, const std::vector<real> &xs, const std::vector<real> &ys) const;
+    std::vector<CriticalPoint> findIntersections(size_type firstCurve, size_type secondCurve, const std::vector<real> &xs, const std::vector<real> &firstYs, const std::vector<real> &secondYs) const;
+};
+
+#endif /* defined(__MathGraph__Analyzer__) */
@@ -0,0 +1,122 @@
+//
+//  Animation.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "Animation.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+Animation::Animation(const Plotter &_plotter, const std::string &_variable, const std::vector<Plotter::size_type> &_expressionIndices, real _from, real _to, int _numFrames)
+    : plotter(_plotter.bindVariables(_variable)),
+      variable(_variable),
+      expressionIndices(_expressionIndices),
+      from(_from),
+      to(_to),
+      numFrames(std::max(_numFrames, 1)),
+      bufferMutex(),
+      buffer(BUFFER_SIZE)
+{
+}
+
+const std::string &Animation::getVariable() const
+{
+    return variable;
+}
+
+const std::vector<Plotter::size_type> &Animation::getExpressionIndices() const
+{
+    return expressionIndices;
+}
+
+int Animation::getNumFrames() const
+{
+    return numFrames;
+}
+
+real Animation::getValue(int index) const
+{
+    return numFrames > 1 ? from + (to - from) * index / (numFrames - 1) : from;
+}
+
+int Animation::getIndex(real value) const
+{
+    if (numFrames < 2 || !(to != from)) return 0;
+    
+    real position = std::round((value - from) / (to - from) * (numFrames - 1));
+    
+    return static_cast<int>(std::max<real>(0, std::min<real>(numFrames - 1, position)));
+}
+
+int Animation::next(int index, int &direction) const
+{
+    if (numFrames < 2) return index;
+    
+    if (index + direction < 0 || index + direction >= numFrames) direction = -direction;
+    
+    return index + direction;
+}
+
+std::shared_ptr<const Animation::Frame> Animation::getFrame(int index) const
+{
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    
+    const std::shared_ptr<const Frame> &frame = buffer[index % BUFFER_SIZE];
+    
+    return frame != nullptr && frame->index == index ? frame : nullptr;
+}
+
+void Animation::precompute(int playhead, int direction, const std::atomic<bool> &cancelled) const
+{
+    std::vector<int> missing;
+    
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        
+        // Near the ends the frames come back in the other direction
+        int index = playhead;
+        for (int k = 0; k != FRAMES_AHEAD; ++k)
+        {
+            const std::shared_ptr<const Frame> &frame = buffer[index % BUFFER_SIZE];
+            
+            if ((frame == nullptr || frame->index != index) && std::find(missing.begin(), missing.end(), index) == missing.end())
+                missing.push_back(index);
+            
+            index = next(index, direction);
+        }
+    }
+    
+    ThreadPool::globalInstance().parallelFor(missing.size(), [&](ThreadPool::size_type k)
+    {
+        if (cancelled) return;
+        
+        std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+        frame->index = missing[k];
+        
+        const Plotter bound = plotter.bindVariable(variable, getValue(missing[k]));
+        
+        for (Plotter::size_type i : expressionIndices)
+        { // The bounds and the fill of an inequality come from the same samples
+            if ((bound.cbegin() + i)->getKind() == Expression::INEQUALITY)
+            {
+                frame->regions.push_back(std::make_shared<const InequalityRegion>(bound.getRegion(i)));
+                frame->paths.emplace_back();
+                frame->regions.back()->getBoundaries(frame->paths.back());
+            }
+            else
+            {
+                frame->regions.push_back(nullptr);
+                frame->paths.emplace_back();
+                bound.getPlotPaths(i, frame->paths.back());
+            }
+        }
+        
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        buffer[missing[k] % BUFFER_SIZE] = frame;
+    });
+}
@@ -0,0 +1,77 @@
+//
+//  Animation.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__Animation__
+#define __MathGraph__Animation__
+
+#include "real.h"
+#include "Plotter.h"
+#include "Point.h"
+#include "InequalityRegion.h"
+#include "SampleBuffer.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// A variable swept back and forth over [from, to] in numFrames values. Frames are computed ahead of
+// the playhead on the thread pool, each from a copy of the view with the variable bound to its value,
+// and kept in a ring buffer, so playback only has to draw them. Frames behind the playhead stay until
+// they are overwritten, so stepping back a little does not compute anything either.
+class Animation
+{
+public:
+    // The paths of the animated expressions in their order, and the regions of the inequalities
+    struct Frame
+    {
+        int index;
+        std::vector<SampleBuffer> paths;
+        std::vector<std::shared_ptr<const InequalityRegion>> regions;
+    };
+    
+    // The expressions must be drawn as paths, surfaces and complex functions can not be animated.
+    // The other variables keep the values they have when the animation is made.
+    Animation(const Plotter &_plotter, const std::string &_variable, const std::vector<Plotter::size_type> &_expressionIndices, real _from, real _to, int _numFrames);
+    
+    const std::string &getVariable() const;
+    const std::vector<Plotter::size_type> &getExpressionIndices() const;
+    int getNumFrames() const;
+    real getValue(int index) const;
+    
+    // The frame with the closest value
+    int getIndex(real value) const;
+    
+    // The frame after index when playing in direction 1 or -1, which turns at the ends
+    int next(int index, int &direction) const;
+    
+    // Null if the frame is not in the buffer
+    std::shared_ptr<const Frame> getFrame(int index) const;
+    
+    // Computes the frames missing from the FRAMES_AHEAD ones from playhead on, in parallel and in the
+    // order they are played. Blocks, it is meant to be run in the background.
+    void precompute(int playhead, int direction, const std::atomic<bool> &cancelled) const;
+    
+private:
+    // FRAMES_AHEAD is smaller than the buffer, so the frames ahead never take each others slots
+    static const int BUFFER_SIZE = 48;
+    static const int FRAMES_AHEAD = 32;
+    
+    Plotter plotter;
+    std::string variable;
+    std::vector<Plotter::size_type> expressionIndices;
+    real from, to;
+    int numFrames;
+    
+    // Frame k is kept in slot k % BUFFER_SIZE
+    mutable std::mutex bufferMutex;
+    mutable std::vector<std::shared_ptr<const Frame>> buffer;
+};
+
+#endif /* defined(__MathGraph__Animation__) */
@@ -0,0 +1,357 @@
+//
+//  ContourTracer.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "ContourTracer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <utility>
+
+ContourTracer::ContourTracer(const Expression &_expression, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight, double _cellSize, const std::vector<real> &_levels)
+    : expression(_expression),
+      xMin(_xMin),
+      xMax(_xMax),
+      yMin(_yMin),
+      yMax(_yMax),
+      pixelWidth(_pixelWidth),
+      pixelHeight(_pixelHeight),
+      levels(_levels),
+      depth(0),
+      leafSize(COARSE_CELL_SIZE)
+{
+    while (leafSize > _cellSize && leafSize > 1)
+    {
+        leafSize /= 2;
+        ++depth;
+    }
+    
+    const int tilePixels = TILE_CELLS * COARSE_CELL_SIZE;
+    
+    tileLeaves = TILE_CELLS << depth;
+    tileColumns = (pixelWidth + tilePixels - 1) / tilePixels;
+    tileRows = (pixelHeight + tilePixels - 1) / tilePixels;
+}
+
+void ContourTracer::trace(SampleBuffer &paths) const
+{
+    if (tileColumns <= 0 || tileRows <= 0) return;
+    
+    std::vector<std::vector<Segment>> tileSegments(static_cast<std::size_t>(tileColumns) * tileRows);
+    
+    ThreadPool::globalInstance().parallelFor(tileSegments.size(), [&](ThreadPool::size_type tile)
+    {
+        traceTile(static_cast<int>(tile % tileColumns), static_cast<int>(tile / tileColumns), tileSegments[tile]);
+    });
+    
+    // The segments of neighbouring tiles meet at the same edges, so they are linked all together
+    std::vector<Segment> segments;
+    for (const std::vector<Segment> &tile : tileSegments)
+    {
+        segments.insert(segments.end(), tile.begin(), tile.end());
+    }
+    
+    link(segments, paths);
+}
+
+void ContourTracer::traceTile(int tileColumn, int tileRow, std::vector<Segment> &segments) const
+{
+    const int n = tileLeaves + 1;
+    const long long i0 = static_cast<long long>(tileColumn) * tileLeaves;
+    const long long j0 = static_cast<long long>(tileRow) * tileLeaves;
+    
+    const real xStep = (xMax - xMin) / pixelWidth * leafSize;
+    const real yStep = (yMax - yMin) / pixelHeight * leafSize;
+    
+    // Values at the leaf grid points of the tile, only the points that are needed are evaluated
+    std::vector<real> values(static_cast<std::size_t>(n) * n);
+    std::vector<bool> known(values.size(), false);
+    
+    std::vector<int> pending;
+    std::vector<real> xs, ys, fs;
+    
+    auto request = [&](int i, int j)
+    {
+        int k = j * n + i;
+        
+        if (!known[k])
+        {
+            known[k] = true;
+            pending.push_back(k);
+        }
+    };
+    
+    auto flush = [&]()
+    {
+        xs.resize(pending.size());
+        ys.resize(pending.size());
+        fs.resize(pending.size());
+        
+        for (std::size_t p = 0; p != pending.size(); ++p)
+        {
+            xs[p] = xMin + (i0 + pending[p] % n) * xStep;
+            ys[p] = yMax - (j0 + pending[p] / n) * yStep;
+        }
+        
+        expression.evaluate(xs.data(), ys.data(), fs.data(), pending.size());
+        
+        for (std::size_t p = 0; p != pending.size(); ++p)
+        {
+            values[pending[p]] = fs[p];
+        }
+        
+        pending.clear();
+    };
+    
+    auto value = [&](int i, int j) -> real
+    {
+        return values[j * n + i];
+    };
+    
+    // True if f - level changes sign in the cell for any level, NaN corners count as neither side
+    auto straddles = [&](const std::pair<int, int> &cell, int size) -> bool
+    {
+        bool defined = false;
+        real low = 0;
+        real high = 0;
+        
+        const real corners[4] = {value(cell.first, cell.second), value(cell.first + size, cell.second),
+                                 value(cell.first, cell.second + size), value(cell.first + size, cell.second + size)};
+        
+        for (real v : corners)
+        {
+            if (std::isnan(v)) continue;
+            
+            low = defined ? std::min(low, v) : v;
+            high = defined ? std::max(high, v) : v;
+            defined = true;
+        }
+        
+        for (real level : levels)
+        {
+            if (defined && low < level && high >= level) return true;
+        }
+        
+        return false;
+    };
+    
+    // Coarse grid, cells are identified by their top left grid point
+    int size = 1 << depth;
+    std::vector<std::pair<int, int>> cells;
+    
+    for (int row = 0; row <= TILE_CELLS; ++row)
+    {
+        for (int column = 0; column <= TILE_CELLS; ++column)
+        {
+            request(column * size, row * size);
+            
+            if (row != TILE_CELLS && column != TILE_CELLS) cells.emplace_back(column * size, row * size);
+        }
+    }
+    
+    flush();
+    
+    // Refine the cells that the curve passes through, one level at a time so every level is one batch
+    for (; size > 1; size /= 2)
+    {
+        const int half = size / 2;
+        std::vector<std::pair<int, int>> refined;
+        
+        for (const std::pair<int, int> &cell : cells)
+        {
+            if (straddles(cell, size))
+            {
+                const int i = cell.first;
+                const int j = cell.second;
+                
+                request(i + half, j);
+                request(i, j + half);
+                request(i + half, j + half);
+                request(i + size, j + half);
+                request(i + half, j + size);
+                
+                refined.emplace_back(i, j);
+                refined.emplace_back(i + half, j);
+                refined.emplace_back(i, j + half);
+                refined.emplace_back(i + half, j + half);
+            }
+        }
+        
+        flush();
+        cells.swap(refined);
+    }
+    
+    // Crossing points of a leaf cell and level in the order top, right, bottom, left
+    struct Crossing
+    {
+        long long edge;
+        real x, y;
+    };
+    
+    std::vector<std::pair<int, int>> leaves;
+    std::vector<std::size_t> leafLevels;
+    std::vector<std::vector<Crossing>> crossings;
+    std::vector<std::size_t> saddles;
+    
+    for (const std::pair<int, int> &cell : cells)
+    {
+        if (!straddles(cell, 1)) continue;
+        
+        const int i = cell.first;
+        const int j = cell.second;
+        const long long gi = i0 + i;
+        const long long gj = j0 + j;
+        
+        for (std::size_t l = 0; l != levels.size(); ++l)
+        {
+            const real level = levels[l];
+            std::vector<Crossing> points;
+            
+            auto cross = [&](real a, real b, long long edge, real x, real y, real dx, real dy)
+            {
+                a -= level;
+                b -= level;
+                
+                if (std::isfinite(a) && std::isfinite(b) && (a < 0) != (b < 0))
+                {
+                    real t = a / (a - b);
+                    points.push_back({edge, (x + t * dx) * leafSize, (y + t * dy) * leafSize});
+                }
+            };
+            
+            cross(value(i, j), value(i + 1, j), edgeKey(gi, gj, false, l), gi, gj, 1, 0);
+            cross(value(i + 1, j), value(i + 1, j + 1), edgeKey(gi + 1, gj, true, l), gi + 1, gj, 0, 1);
+            cross(value(i, j + 1), value(i + 1, j + 1), edgeKey(gi, gj + 1, false, l), gi, gj + 1, 1, 0);
+            cross(value(i, j), value(i, j + 1), edgeKey(gi, gj, true, l), gi, gj, 0, 1);
+            
+            if (points.size() == 4) saddles.push_back(leaves.size());
+            
+            if (points.size() == 2 || points.size() == 4)
+            {
+                leaves.push_back(cell);
+                leafLevels.push_back(l);
+                crossings.push_back(points);
+            }
+        }
+    }
+    
+    // A saddle cell has two segments, the value in the middle decides which corners they cut off
+    std::vector<real> centers(saddles.size());
+    
+    if (!saddles.empty())
+    {
+        xs.resize(saddles.size());
+        ys.resize(saddles.size());
+        
+        for (std::size_t s = 0; s != saddles.size(); ++s)
+        {
+            xs[s] = xMin + (i0 + leaves[saddles[s]].first + 0.5) * xStep;
+            ys[s] = yMax - (j0 + leaves[saddles[s]].second + 0.5) * yStep;
+        }
+        
+        expression.evaluate(xs.data(), ys.data(), centers.data(), saddles.size());
+    }
+    
+    std::size_t saddle = 0;
+    
+    for (std::size_t l = 0; l != leaves.size(); ++l)
+    {
+        const std::vector<Crossing> &points = crossings[l];
+        
+        auto emit = [&](const Crossing &a, const Crossing &b)
+        {
+            segments.push_back({{a.edge, b.edge}, {a.x, b.x}, {a.y, b.y}});
+        };
+        
+        if (points.size() == 2)
+        {
+            emit(points[0], points[1]);
+        }
+        else if ((centers[saddle++] < levels[leafLevels[l]]) == (value(leaves[l].first, leaves[l].second) < levels[leafLevels[l]]))
+        { // The top left and bottom right corners are connected
+            emit(points[0], points[1]);
+            emit(points[2], points[3]);
+        }
+        else
+        {
+            emit(points[0], points[3]);
+            emit(points[1], points[2]);
+        }
+    }
+}
+
+long long ContourTracer::edgeKey(long long i, long long j, bool vertical, std::size_t level) const
+{
+    const long long stride = static_cast<long long>(tileColumns) * tileLeaves + 1;
+    const long long points = stride * (static_cast<long long>(tileRows) * tileLeaves + 1);
+    
+    return ((static_cast<long long>(level) * points + j * stride + i) * 2) + (vertical ? 1 : 0);
+}
+
+void ContourTracer::link(const std::vector<Segment> &segments, SampleBuffer &paths)
+{
+    // (edge, 2 * segment + end), sorted so the segments meeting at an edge are found by binary search
+    std::vector<std::pair<long long, std::size_t>> ends;
+    ends.reserve(segments.size() * 2);
+    
+    for (std::size_t s = 0; s != segments.size(); ++s)
+    {
+        ends.emplace_back(segments[s].edges[0], 2 * s);
+        ends.emplace_back(segments[s].edges[1], 2 * s + 1);
+    }
+    
+    std::sort(ends.begin(), ends.end());
+    
+    std::vector<bool> used(segments.size(), false);
+    
+    // Walks from an end of a segment as far as the curve continues, appending the points on the way
+    auto follow = [&](std::size_t segment, int end, std::vector<std::pair<real, real>> &points)
+    {
+        long long edge = segments[segment].edges[end];
+        
+        while (true)
+        {
+            auto it = std::lower_bound(ends.begin(), ends.end(), std::make_pair(edge, static_cast<std::size_t>(0)));
+            
+            while (it != ends.end() && it->first == edge && used[it->second / 2]) ++it;
+            
+            if (it == ends.end() || it->first != edge) break;
+            
+            std::size_t next = it->second / 2;
+            int other = 1 - static_cast<int>(it->second % 2);
+            
+            used[next] = true;
+            points.emplace_back(segments[next].x[other], segments[next].y[other]);
+            edge = segments[next].edges[other];
+        }
+    };
+    
+    for (std::size_t s = 0; s != segments.size(); ++s)
+    {
+        if (used[s]) continue;
+        
+        used[s] = true;
+        
+        std::vector<std::pair<real, real>> backward(1, std::make_pair(segments[s].x[0], segments[s].y[0]));
+        std::vector<std::pair<real, real>> forward(1, std::make_pair(segments[s].x[1], segments[s].y[1]));
+        
+        follow(s, 1, forward);
+        follow(s, 0, backward);
+        
+        paths.breakPath();
+        
+        auto append = [&](const std::pair<real, real> &point)
+        {
+            paths.add(static_cast<float>(point.first), static_cast<float>(point.second));
+        };
+        
+        std::for_each(backward.rbegin(), backward.rend(), append);
+        std::for_each(forward.begin(), forward.end(), append);
+    }
+    
+    paths.breakPath();
+}
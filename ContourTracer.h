@@ -0,0 +1,65 @@
+//
+//  ContourTracer.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__ContourTracer__
+#define __MathGraph__ContourTracer__
+
+#include "real.h"
+#include "Expression.h"
+#include "SampleBuffer.h"
+
+#include <cstddef>
+#include <vector>
+
+// Traces the implicit curve f(x, y) = 0 with marching squares. The viewport is split into
+// tiles that are traced in parallel. Inside a tile a coarse grid is refined as a quadtree,
+// but only in the cells where f changes sign, so the work follows the length of the curve.
+// Several levels f(x, y) = c can be traced at once, sharing the evaluations.
+class ContourTracer
+{
+public:
+    // The finest cells are at most cellSize pixels wide
+    ContourTracer(const Expression &_expression, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight, double _cellSize = 2, const std::vector<real> &_levels = std::vector<real>(1, 0));
+    
+    // Adds polylines in pixel coordinates to paths, ready to be drawn
+    void trace(SampleBuffer &paths) const;
+    
+private:
+    // Pixels per side of the coarse cells, curves that fit inside one may be missed
+    static const int COARSE_CELL_SIZE = 16;
+    
+    // Coarse cells per side of a tile
+    static const int TILE_CELLS = 4;
+    
+    // Line segment across a leaf cell, the end points are identified by the grid edge and level they lie on
+    struct Segment
+    {
+        long long edges[2];
+        real x[2];
+        real y[2];
+    };
+    
+    Expression expression;
+    real xMin, xMax;
+    real yMin, yMax;
+    int pixelWidth;
+    int pixelHeight;
+    std::vector<real> levels;
+    
+    int depth; // Quadtree levels below the coarse grid
+    real leafSize; // In pixels
+    int tileLeaves; // Leaf cells per side of a tile
+    int tileColumns;
+    int tileRows;
+    
+    void traceTile(int tileColumn, int tileRow, std::vector<Segment> &segments) const;
+    long long edgeKey(long long i, long long j, bool vertical, std::size_t level) const;
+    static void link(const std::vector<Segment> &segments, SampleBuffer &paths);
+};
+
+#endif /* defined(__MathGraph__ContourTracer__) */
@@ -0,0 +1,123 @@
+//
+//  CumulativeIntegral.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "CumulativeIntegral.h"
+
+#include <algorithm>
+
+CumulativeIntegral::CumulativeIntegral(const Expression &integrand, const Expression &_lowerLimit, real _tolerance)
+    : integrator(integrand, _tolerance),
+      lowerLimit(_lowerLimit),
+      tolerance(_tolerance),
+      cacheMutex(),
+      cacheStep(0),
+      cacheFirst(0),
+      cacheValues(),
+      cacheLowerLimit(0),
+      cacheVersion(0)
+{
+}
+
+real CumulativeIntegral::evaluate(real x) const
+{
+    return integrator.integrate(lowerLimit.evaluate(0), x).first;
+}
+
+void CumulativeIntegral::evaluate(const real *x, real *result, std::size_t count) const
+{
+    if (count == 0) return;
+    
+    if (!std::is_sorted(x, x + count))
+    {
+        for (std::size_t i = 0; i != count; ++i)
+        {
+            result[i] = evaluate(x[i]);
+        }
+        
+        return;
+    }
+    
+    result[0] = evaluate(x[0]);
+    
+    for (std::size_t i = 1; i < count; ++i)
+    {
+        result[i] = result[i - 1] + integrateStep(x[i - 1], x[i]);
+    }
+}
+
+void CumulativeIntegral::evaluateGrid(real step, long long first, std::size_t count, real *result) const
+{
+    if (count == 0) return;
+    
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    
+    real a = lowerLimit.evaluate(0);
+    long long last = first + static_cast<long long>(count) - 1;
+    long long cacheLast = cacheFirst + static_cast<long long>(cacheValues.size()) - 1;
+    
+    // Zooming, a new lower limit or a changed variable invalidates everything,
+    // and a jump away from the cached grid starts over from the lower limit
+    if (cacheValues.empty() || step != cacheStep || a != cacheLowerLimit || cacheVersion != Expression::getVariablesVersion() ||
+        last < cacheFirst - 1 || first > cacheLast + 1 || cacheValues.size() + count > MAX_CACHE_SIZE)
+    {
+        cacheStep = step;
+        cacheLowerLimit = a;
+        cacheVersion = Expression::getVariablesVersion();
+        cacheFirst = first;
+        cacheValues.assign(1, integrator.integrate(a, first * step).first);
+        
+        cacheLast = first;
+    }
+    
+    // Extend to the left
+    if (first < cacheFirst)
+    {
+        std::vector<real> left(static_cast<std::size_t>(cacheFirst - first));
+        
+        real value = cacheValues.front();
+        for (long long k = cacheFirst - 1; k >= first; --k)
+        {
+            value -= integrateStep(k * step, (k + 1) * step);
+            left[static_cast<std::size_t>(k - first)] = value;
+        }
+        
+        cacheValues.insert(cacheValues.begin(), left.begin(), left.end());
+        cacheFirst = first;
+    }
+    
+    // Extend to the right
+    for (long long k = cacheLast + 1; k <= last; ++k)
+    {
+        cacheValues.push_back(cacheValues.back() + integrateStep((k - 1) * step, k * step));
+    }
+    
+    std::copy(cacheValues.begin() + (first - cacheFirst), cacheValues.begin() + (first - cacheFirst) + count, result);
+}
+
+const Expression &CumulativeIntegral::getIntegrand() const
+{
+    return integrator.getExpression();
+}
+
+const Expression &CumulativeIntegral::getLowerLimit() const
+{
+    return lowerLimit;
+}
+
+real CumulativeIntegral::integrateStep(real from, real to) const
+{
+    std::pair<real, real> panel = integrator.integratePanel(from, to);
+    
+    // One Kronrod panel per step is enough for smooth integrands, refine the rest
+    if (!(panel.second <= tolerance * std::max<real>(1, std::fabs(panel.first))))
+    {
+        panel = integrator.integrate(from, to);
+    }
+    
+    return panel.first;
+}
@@ -0,0 +1,57 @@
+//
+//  CumulativeIntegral.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__CumulativeIntegral__
+#define __MathGraph__CumulativeIntegral__
+
+#include "real.h"
+#include "Expression.h"
+#include "Integrator.h"
+
+#include <cstddef>
+#include <vector>
+#include <mutex>
+
+// F(x) = integral(f, a, x), the value of the expression integral(f, a, x)
+class CumulativeIntegral
+{
+public:
+    CumulativeIntegral(const Expression &integrand, const Expression &_lowerLimit, real _tolerance = 1e-10);
+    
+    // Integrates from the lower limit every time
+    real evaluate(real x) const;
+    
+    // If x is ascending only the panels between neighbouring samples are integrated, O(count)
+    void evaluate(const real *x, real *result, std::size_t count) const;
+    
+    // Values at x = (first + i) * step. The grid is cached, panning only integrates the new panels.
+    void evaluateGrid(real step, long long first, std::size_t count, real *result) const;
+    
+    // F'(x) = f(x)
+    const Expression &getIntegrand() const;
+    const Expression &getLowerLimit() const;
+    
+private:
+    // Cached grid values are dropped instead of growing past this
+    static const std::size_t MAX_CACHE_SIZE = 1 << 20;
+    
+    Integrator integrator;
+    Expression lowerLimit;
+    real tolerance;
+    
+    mutable std::mutex cacheMutex;
+    mutable real cacheStep;
+    mutable long long cacheFirst;
+    mutable std::vector<real> cacheValues;
+    mutable real cacheLowerLimit;
+    mutable unsigned long cacheVersion;
+    
+    real integrateStep(real from, real to) const;
+};
+
+#endif /* defined(__MathGraph__CumulativeIntegral__) */
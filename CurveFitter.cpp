@@ -0,0 +1,216 @@
+//
+//  CurveFitter.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "CurveFitter.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+CurveFitter::CurveFitter(const Expression &_expression, const std::vector<std::string> &_parameters, real _tolerance, int _maxIterations)
+    : expression(_expression),
+      parameters(_parameters),
+      tolerance(_tolerance),
+      maxIterations(_maxIterations)
+{
+}
+
+FitResult CurveFitter::fit(const double *x, const double *y, std::size_t count) const
+{
+    const std::size_t n = parameters.size();
+    
+    FitResult result;
+    result.parameters = parameters;
+    result.values.resize(n);
+    result.iterations = 0;
+    result.converged = false;
+    
+    for (std::size_t k = 0; k != n; ++k)
+    {
+        result.values[k] = Expression::getVariable(parameters[k]);
+    }
+    
+    NormalEquations current = accumulate(x, y, count);
+    
+    // Marquardt's damping, relative to the diagonal so that the parameters may differ in scale
+    real damping = 1e-3;
+    
+    while (result.iterations < maxIterations && current.numPoints != 0 && current.sumOfSquares > 0)
+    {
+        ++result.iterations;
+        
+        std::vector<real> damped(current.matrix);
+        for (std::size_t k = 0; k != n; ++k)
+        {
+            const real diagonal = current.matrix[k * n + k];
+            damped[k * n + k] += damping * (diagonal > 0 ? diagonal : 1);
+        }
+        
+        std::vector<real> step(current.vector);
+        
+        if (solve(damped, step))
+        {
+            std::vector<real> trial(result.values);
+            for (std::size_t k = 0; k != n; ++k) trial[k] += step[k];
+            
+            setParameters(trial);
+            NormalEquations next = accumulate(x, y, count);
+            
+            // Fewer points where f is defined would make any sum smaller
+            if (next.numPoints >= current.numPoints && next.sumOfSquares < current.sumOfSquares)
+            {
+                const real decrease = current.sumOfSquares - next.sumOfSquares;
+                
+                result.values = trial;
+                current = next;
+                damping = std::max<real>(damping / 10, 1e-12);
+                
+                if (decrease <= tolerance * current.sumOfSquares)
+                {
+                    result.converged = true;
+                    break;
+                }
+                
+                continue;
+            }
+        }
+        
+        // Rejected, a shorter step closer to steepest descent is tried
+        damping *= 10;
+        
+        if (damping > 1e16)
+        { // No step lowers the sum any more, the values are at a minimum
+            result.converged = true;
+            break;
+        }
+    }
+    
+    if (current.sumOfSquares == 0 && current.numPoints != 0) result.converged = true;
+    
+    setParameters(result.values);
+    
+    result.sumOfSquares = current.sumOfSquares;
+    result.numPoints = current.numPoints;
+    
+    return result;
+}
+
+CurveFitter::NormalEquations CurveFitter::accumulate(const double *x, const double *y, std::size_t count) const
+{
+    const std::size_t n = parameters.size();
+    const std::size_t numChunks = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    
+    std::vector<NormalEquations> chunks(numChunks);
+    
+    ThreadPool::globalInstance().parallelFor(numChunks, [&](ThreadPool::size_type chunk)
+    {
+        const std::size_t first = chunk * CHUNK_SIZE;
+        const std::size_t length = std::min(CHUNK_SIZE, count - first);
+        
+        std::vector<real> xs(x + first, x + first + length);
+        std::vector<real> values(length);
+        std::vector<real> gradient(length * n);
+        
+        expression.evaluateGradient(xs.data(), values.data(), gradient.data(), length, parameters);
+        
+        NormalEquations &sums = chunks[chunk];
+        sums.matrix.assign(n * n, 0);
+        sums.vector.assign(n, 0);
+        sums.sumOfSquares = 0;
+        sums.numPoints = 0;
+        
+        for (std::size_t i = 0; i != length; ++i)
+        {
+            const real residual = y[first + i] - values[i];
+            const real *row = gradient.data() + i * n;
+            
+            if (!std::isfinite(residual) || !std::all_of(row, row + n, [](real d) { return std::isfinite(d); })) continue;
+            
+            // Only the lower triangle, the matrix is symmetric
+            for (std::size_t j = 0; j != n; ++j)
+            {
+                for (std::size_t k = 0; k <= j; ++k) sums.matrix[j * n + k] += row[j] * row[k];
+                
+                sums.vector[j] += row[j] * residual;
+            }
+            
+            sums.sumOfSquares += residual * residual;
+            ++sums.numPoints;
+        }
+    });
+    
+    // Added in order, so the same data always gives the same fit
+    NormalEquations total;
+    total.matrix.assign(n * n, 0);
+    total.vector.assign(n, 0);
+    total.sumOfSquares = 0;
+    total.numPoints = 0;
+    
+    for (const NormalEquations &sums : chunks)
+    {
+        for (std::size_t k = 0; k != n * n; ++k) total.matrix[k] += sums.matrix[k];
+        for (std::size_t k = 0; k != n; ++k) total.vector[k] += sums.vector[k];
+        
+        total.sumOfSquares += sums.sumOfSquares;
+        total.numPoints += sums.numPoints;
+    }
+    
+    for (std::size_t j = 0; j != n; ++j)
+    {
+        for (std::size_t k = j + 1; k != n; ++k) total.matrix[j * n + k] = total.matrix[k * n + j];
+    }
+    
+    return total;
+}
+
+void CurveFitter::setParameters(const std::vector<real> &values) const
+{
+    for (std::size_t k = 0; k != parameters.size(); ++k)
+    {
+        Expression::setVariable(parameters[k], values[k]);
+    }
+}
+
+bool CurveFitter::solve(std::vector<real> a, std::vector<real> &b)
+{
+    const std::size_t n = b.size();
+    
+    // a = L L^T, L is kept in the lower triangle of a
+    for (std::size_t j = 0; j != n; ++j)
+    {
+        real diagonal = a[j * n + j];
+        for (std::size_t k = 0; k != j; ++k) diagonal -= a[j * n + k] * a[j * n + k];
+        
+        if (!(diagonal > 0)) return false;
+        
+        a[j * n + j] = std::sqrt(diagonal);
+        
+        for (std::size_t i = j + 1; i != n; ++i)
+        {
+            real sum = a[i * n + j];
+            for (std::size_t k = 0; k != j; ++k) sum -= a[i * n + k] * a[j * n + k];
+            
+            a[i * n + j] = sum / a[j * n + j];
+        }
+    }
+    
+    // L z = b, then L^T x = z
+    for (std::size_t i = 0; i != n; ++i)
+    {
+        for (std::size_t k = 0; k != i; ++k) b[i] -= a[i * n + k] * b[k];
+        b[i] /= a[i * n + i];
+    }
+    
+    for (std::size_t i = n; i-- != 0;)
+    {
+        for (std::size_t k = i + 1; k != n; ++k) b[i] -= a[k * n + i] * b[k];
+        b[i] /= a[i * n + i];
+    }
+    
+    return std::all_of(b.begin(), b.end(), [](real value) { return std::isfinite(value); });
+}
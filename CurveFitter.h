@@ -0,0 +1,69 @@
+//
+//  CurveFitter.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__CurveFitter__
+#define __MathGraph__CurveFitter__
+
+#include "real.h"
+#include "Expression.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct FitResult
+{
+    std::vector<std::string> parameters;
+    std::vector<real> values;
+    real sumOfSquares; // Of the residuals at values
+    std::size_t numPoints; // Where f and its derivatives are defined, the others are left out
+    int iterations;
+    bool converged;
+};
+
+// Least squares fit of the parameters of a function y = f(x) to measured points with the
+// Levenberg-Marquardt method. The partial derivatives come from batch forward mode along the
+// parameters, and the chunks of points add up their own part of the normal equations in parallel,
+// so a step is one pass over the points and a solve the size of the number of parameters.
+class CurveFitter
+{
+public:
+    // Converged when a step lowers the sum of squares by less than tolerance times it
+    CurveFitter(const Expression &_expression, const std::vector<std::string> &_parameters, real _tolerance = 1e-10, int _maxIterations = 100);
+    
+    // The parameters are variables, so the fit starts from their current values and leaves them at
+    // the best values found. Nothing else may read the variables meanwhile. May throw EvaluationError
+    // if f has no known derivative.
+    FitResult fit(const double *x, const double *y, std::size_t count) const;
+    
+private:
+    // Points per task while the normal equations are added up
+    static const std::size_t CHUNK_SIZE = 1 << 14;
+    
+    // J^T J, J^T r and the sum of squares of r = y - f
+    struct NormalEquations
+    {
+        std::vector<real> matrix;
+        std::vector<real> vector;
+        real sumOfSquares;
+        std::size_t numPoints;
+    };
+    
+    Expression expression;
+    std::vector<std::string> parameters;
+    real tolerance;
+    int maxIterations;
+    
+    NormalEquations accumulate(const double *x, const double *y, std::size_t count) const;
+    void setParameters(const std::vector<real> &values) const;
+    
+    // Solves a x = b in place of b by Cholesky decomposition, false if a is not positive definite
+    static bool solve(std::vector<real> a, std::vector<real> &b);
+};
+
+#endif /* defined(__MathGraph__CurveFitter__) */
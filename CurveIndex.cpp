@@ -0,0 +1,152 @@
+//
+//  CurveIndex.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "CurveIndex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+CurveIndex::CurveIndex(int _pixelWidth, int _pixelHeight)
+    : pixelWidth(std::max(_pixelWidth, 0)),
+      pixelHeight(std::max(_pixelHeight, 0)),
+      columns((pixelWidth + CELL_SIZE - 1) / CELL_SIZE),
+      rows((pixelHeight + CELL_SIZE - 1) / CELL_SIZE),
+      segments(),
+      cellBegins(),
+      cellSegments()
+{
+}
+
+void CurveIndex::add(std::size_t curve, const SampleBuffer &paths)
+{
+    const float *x = paths.getX();
+    const float *y = paths.getY();
+    
+    for (SampleBuffer::size_type path = 0; path != paths.numPaths(); ++path)
+    {
+        const SampleBuffer::size_type begin = paths.getPathBegin(path);
+        const SampleBuffer::size_type end = paths.getPathEnd(path);
+        
+        // A path of one point is a segment of length 0
+        for (SampleBuffer::size_type i = begin; i == begin || i + 1 < end; ++i)
+        {
+            const SampleBuffer::size_type j = std::min(i + 1, end - 1);
+            
+            if (std::max(x[i], x[j]) < 0 || std::min(x[i], x[j]) >= pixelWidth) continue;
+            if (std::max(y[i], y[j]) < 0 || std::min(y[i], y[j]) >= pixelHeight) continue;
+            
+            segments.push_back({curve, x[i], y[i], x[j], y[j]});
+        }
+    }
+}
+
+void CurveIndex::build()
+{
+    // Counted first, so every cell gets its own run of one array
+    cellBegins.assign(static_cast<std::size_t>(columns) * rows + 1, 0);
+    
+    for (const Segment &segment : segments)
+    {
+        forEachCell(segment, [this](std::size_t cell) { ++cellBegins[cell + 1]; });
+    }
+    
+    std::partial_sum(cellBegins.begin(), cellBegins.end(), cellBegins.begin());
+    
+    std::vector<std::size_t> next(cellBegins.begin(), cellBegins.end() - 1);
+    cellSegments.resize(cellBegins.back());
+    
+    for (std::uint32_t s = 0; s != segments.size(); ++s)
+    {
+        forEachCell(segments[s], [&](std::size_t cell) { cellSegments[next[cell]++] = s; });
+    }
+}
+
+bool CurveIndex::findNearest(float x, float y, float maxDistance, Hit &hit) const
+{
+    if (cellBegins.empty()) return false;
+    
+    const int firstColumn = std::max(0, static_cast<int>(std::floor((x - maxDistance) / CELL_SIZE)));
+    const int lastColumn = std::min(columns - 1, static_cast<int>(std::floor((x + maxDistance) / CELL_SIZE)));
+    const int firstRow = std::max(0, static_cast<int>(std::floor((y - maxDistance) / CELL_SIZE)));
+    const int lastRow = std::min(rows - 1, static_cast<int>(std::floor((y + maxDistance) / CELL_SIZE)));
+    
+    bool found = false;
+    float best2 = maxDistance * maxDistance;
+    
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            const std::size_t cell = static_cast<std::size_t>(row) * columns + column;
+            
+            for (std::size_t k = cellBegins[cell]; k != cellBegins[cell + 1]; ++k)
+            {
+                const Segment &segment = segments[cellSegments[k]];
+                
+                // Closest point of the segment
+                const float dx = segment.x1 - segment.x0;
+                const float dy = segment.y1 - segment.y0;
+                const float length2 = dx * dx + dy * dy;
+                const float t = length2 > 0 ? std::max(0.0f, std::min(1.0f, ((x - segment.x0) * dx + (y - segment.y0) * dy) / length2)) : 0;
+                
+                const float px = segment.x0 + t * dx;
+                const float py = segment.y0 + t * dy;
+                const float distance2 = (px - x) * (px - x) + (py - y) * (py - y);
+                
+                if (distance2 <= best2)
+                {
+                    best2 = distance2;
+                    hit = {segment.curve, px, py, 0};
+                    found = true;
+                }
+            }
+        }
+    }
+    
+    if (found) hit.distance = std::sqrt(best2);
+    
+    return found;
+}
+
+template <typename Visit>
+void CurveIndex::forEachCell(const Segment &segment, Visit visit) const
+{
+    const float top = std::min(segment.y0, segment.y1);
+    const float bottom = std::max(segment.y0, segment.y1);
+    
+    const int firstRow = std::max(0, static_cast<int>(std::floor(top / CELL_SIZE)));
+    const int lastRow = std::min(rows - 1, static_cast<int>(std::floor(bottom / CELL_SIZE)));
+    
+    const float dx = segment.x1 - segment.x0;
+    const float dy = segment.y1 - segment.y0;
+    
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        // The part of the segment within the row of cells
+        float t0 = 0;
+        float t1 = 1;
+        
+        if (dy != 0)
+        {
+            t0 = std::max(0.0f, std::min(1.0f, (row * CELL_SIZE - segment.y0) / dy));
+            t1 = std::max(0.0f, std::min(1.0f, ((row + 1) * CELL_SIZE - segment.y0) / dy));
+        }
+        
+        const float left = std::min(segment.x0 + t0 * dx, segment.x0 + t1 * dx);
+        const float right = std::max(segment.x0 + t0 * dx, segment.x0 + t1 * dx);
+        
+        const int firstColumn = std::max(0, static_cast<int>(std::floor(left / CELL_SIZE)));
+        const int lastColumn = std::min(columns - 1, static_cast<int>(std::floor(right / CELL_SIZE)));
+        
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            visit(static_cast<std::size_t>(row) * columns + column);
+        }
+    }
+}
@@ -0,0 +1,70 @@
+//
+//  CurveIndex.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__CurveIndex__
+#define __MathGraph__CurveIndex__
+
+#include "SampleBuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Finds the closest point of the plotted curves to a point on screen, from the polylines alone
+// without evaluating anything. The segments are sorted into a uniform grid of square cells, and a
+// query only looks at the cells within its distance, so the cost does not grow with the number
+// of curves.
+class CurveIndex
+{
+public:
+    struct Hit
+    {
+        std::size_t curve;
+        float x, y; // Closest point in pixels
+        float distance;
+    };
+    
+    CurveIndex(int _pixelWidth, int _pixelHeight);
+    
+    // Segments outside the image are left out
+    void add(std::size_t curve, const SampleBuffer &paths);
+    
+    // Sorts the segments into the cells, after the last add
+    void build();
+    
+    // Returns false if no curve is within maxDistance pixels
+    bool findNearest(float x, float y, float maxDistance, Hit &hit) const;
+    
+private:
+    // Pixels per side of the cells
+    static const int CELL_SIZE = 16;
+    
+    struct Segment
+    {
+        std::size_t curve;
+        float x0, y0;
+        float x1, y1;
+    };
+    
+    int pixelWidth;
+    int pixelHeight;
+    int columns;
+    int rows;
+    
+    std::vector<Segment> segments;
+    
+    // The segments crossing cell k are cellSegments[cellBegins[k]] to cellSegments[cellBegins[k + 1] - 1]
+    std::vector<std::size_t> cellBegins;
+    std::vector<std::uint32_t> cellSegments;
+    
+    // Calls visit(cell) for every cell the segment crosses
+    template <typename Visit>
+    void forEachCell(const Segment &segment, Visit visit) const;
+};
+
+#endif /* defined(__MathGraph__CurveIndex__) */
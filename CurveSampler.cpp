@@ -0,0 +1,150 @@
+//
+//  CurveSampler.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "CurveSampler.h"
+
+#include <algorithm>
+
+CurveSampler::CurveSampler(const Expression &_expression, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight, double _segmentLength)
+    : expression(_expression),
+      xMin(_xMin),
+      xMax(_xMax),
+      yMin(_yMin),
+      yMax(_yMax),
+      pixelWidth(_pixelWidth),
+      pixelHeight(_pixelHeight),
+      segmentLength(std::max(_segmentLength, 0.5))
+{
+}
+
+void CurveSampler::sample(SampleBuffer &paths) const
+{
+    std::pair<real, real> range = expression.getParameterRange();
+    
+    if (pixelWidth <= 0 || pixelHeight <= 0 || !std::isfinite(range.first) || !std::isfinite(range.second) || range.first == range.second)
+        return;
+    
+    std::vector<real> ts(INITIAL_SEGMENTS + 1);
+    for (int i = 0; i <= INITIAL_SEGMENTS; ++i)
+    {
+        ts[i] = range.first + (range.second - range.first) * i / INITIAL_SEGMENTS;
+    }
+    
+    std::vector<Sample> samples;
+    evaluate(ts, samples);
+    
+    for (int round = 0; round != MAX_ROUNDS; ++round)
+    {
+        // Midpoints of the segments that are too long, after is the index of the sample before each one
+        std::vector<real> midpoints;
+        std::vector<std::size_t> after;
+        
+        for (std::size_t i = 0; i + 1 < samples.size(); ++i)
+        {
+            if (needsSplit(samples[i], samples[i + 1]))
+            {
+                midpoints.push_back((samples[i].t + samples[i + 1].t) / 2);
+                after.push_back(i);
+            }
+        }
+        
+        if (midpoints.empty() || samples.size() + midpoints.size() > MAX_SAMPLES) break;
+        
+        std::vector<Sample> inserted;
+        evaluate(midpoints, inserted);
+        
+        std::vector<Sample> refined;
+        refined.reserve(samples.size() + inserted.size());
+        
+        std::size_t next = 0;
+        for (std::size_t i = 0; i != samples.size(); ++i)
+        {
+            refined.push_back(samples[i]);
+            
+            if (next != after.size() && after[next] == i) refined.push_back(inserted[next++]);
+        }
+        
+        samples.swap(refined);
+    }
+    
+    // Break the curve where it is undefined, or where a segment is still far too long. A polyline
+    // is only added once it has a second point, lone points are not drawn.
+    paths.breakPath();
+    
+    std::size_t numPoints = 0;
+    float lastX = 0;
+    float lastY = 0;
+    
+    for (std::size_t i = 0; i != samples.size(); ++i)
+    {
+        const Sample &current = samples[i];
+        bool defined = std::isfinite(current.x) && std::isfinite(current.y);
+        
+        if (!defined || (i != 0 && length(samples[i - 1], current) > JUMP_FACTOR * segmentLength))
+        {
+            paths.breakPath();
+            numPoints = 0;
+        }
+        
+        if (!defined) continue;
+        
+        const float x = static_cast<float>(std::max<real>(-SampleBuffer::MAX_PIXEL, std::min<real>(SampleBuffer::MAX_PIXEL, current.x)));
+        const float y = static_cast<float>(std::max<real>(-SampleBuffer::MAX_PIXEL, std::min<real>(SampleBuffer::MAX_PIXEL, current.y)));
+        
+        if (numPoints != 0 && x == lastX && y == lastY) continue;
+        
+        if (numPoints == 1) paths.add(lastX, lastY);
+        if (numPoints != 0) paths.add(x, y);
+        
+        ++numPoints;
+        lastX = x;
+        lastY = y;
+    }
+    
+    paths.breakPath();
+}
+
+void CurveSampler::evaluate(const std::vector<real> &t, std::vector<Sample> &samples) const
+{
+    std::vector<real> x(t.size());
+    std::vector<real> y(t.size());
+    
+    expression.evaluateCurve(t.data(), x.data(), y.data(), t.size());
+    
+    real xPixelsPerPoint = pixelWidth / (xMax - xMin);
+    real yPixelsPerPoint = pixelHeight / (yMax - yMin);
+    
+    samples.resize(t.size());
+    for (std::size_t i = 0; i != t.size(); ++i)
+    {
+        samples[i].t = t[i];
+        samples[i].x = (x[i] - xMin) * xPixelsPerPoint;
+        samples[i].y = (yMax - y[i]) * yPixelsPerPoint;
+    }
+}
+
+bool CurveSampler::needsSplit(const Sample &a, const Sample &b) const
+{
+    bool aDefined = std::isfinite(a.x) && std::isfinite(a.y);
+    bool bDefined = std::isfinite(b.x) && std::isfinite(b.y);
+    
+    // Locate the ends of the parts where the curve is defined
+    if (!aDefined || !bDefined) return aDefined != bDefined;
+    
+    // Segments entirely on one side of the viewport are never drawn
+    if ((a.x < 0 && b.x < 0) || (a.x > pixelWidth && b.x > pixelWidth) ||
+        (a.y < 0 && b.y < 0) || (a.y > pixelHeight && b.y > pixelHeight))
+        return false;
+    
+    return length(a, b) > segmentLength;
+}
+
+real CurveSampler::length(const Sample &a, const Sample &b) const
+{
+    return std::hypot(b.x - a.x, b.y - a.y);
+}
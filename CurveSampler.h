@@ -0,0 +1,57 @@
+//
+//  CurveSampler.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__CurveSampler__
+#define __MathGraph__CurveSampler__
+
+#include "real.h"
+#include "Expression.h"
+#include "SampleBuffer.h"
+
+#include <cstddef>
+#include <vector>
+
+// Samples parametric and polar curves adaptively in t, so that the segments are about as long
+// on screen as the sampling rate. Uniform steps in t are very uneven for curves like spirals.
+// Starting from a uniform grid every segment that is too long is bisected, one round at a time,
+// and all new values of t in a round are evaluated as one batch.
+class CurveSampler
+{
+public:
+    CurveSampler(const Expression &_expression, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight, double _segmentLength = 2);
+    
+    // Adds polylines in pixel coordinates to paths, the curve is broken where it is undefined or jumps
+    void sample(SampleBuffer &paths) const;
+    
+private:
+    static const int INITIAL_SEGMENTS = 128;
+    static const int MAX_ROUNDS = 14;
+    static const std::size_t MAX_SAMPLES = 1 << 18;
+    
+    // Segments still this many times too long after refinement are jumps
+    static const int JUMP_FACTOR = 8;
+    
+    struct Sample
+    {
+        real t;
+        real x, y; // In pixels
+    };
+    
+    Expression expression;
+    real xMin, xMax;
+    real yMin, yMax;
+    int pixelWidth;
+    int pixelHeight;
+    real segmentLength;
+    
+    void evaluate(const std::vector<real> &t, std::vector<Sample> &samples) const;
+    bool needsSplit(const Sample &a, const Sample &b) const;
+    real length(const Sample &a, const Sample &b) const;
+};
+
+#endif /* defined(__MathGraph__CurveSampler__) */
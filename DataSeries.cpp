@@ -0,0 +1,498 @@
+//
+//  DataSeries.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "DataSeries.h"
+#include "ThreadPool.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace
+{
+    const char SIDECAR_MAGIC[8] = {'M', 'G', 'D', 'A', 'T', 'A', '1', '\0'};
+    
+    bool endsWith(const std::string &text, const std::string &suffix)
+    {
+        return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+    }
+}
+
+const std::string DataSeries::SIDECAR_SUFFIX = ".mgdata";
+
+DataFileError::DataFileError(const std::string &_what_arg) : std::runtime_error(_what_arg) {}
+
+DataSeries::DataSeries(const std::string &_path)
+    : path(_path),
+      sidecar(QString::fromStdString(_path + SIDECAR_SUFFIX)),
+      mapped(nullptr),
+      columns(),
+      counts(),
+      levelX(),
+      levelY()
+{
+    QFileInfo info(QString::fromStdString(path));
+    
+    if (!info.exists()) throw DataFileError("The file " + path + " does not exist.");
+    
+    // The sidecar belongs to the source as it was when the sidecar was written
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC));
+    header.sourceSize = info.size();
+    header.sourceModified = info.lastModified().toMSecsSinceEpoch();
+    
+    if (mapSidecar(header)) return;
+    
+    QFile source(QString::fromStdString(path));
+    
+    if (!source.open(QFile::ReadOnly)) throw DataFileError("The file " + path + " could not be opened.");
+    
+    std::vector<double> xs;
+    std::vector<double> ys;
+    
+    if (source.size() > 0)
+    {
+        const uchar *data = source.map(0, source.size());
+        
+        if (data == nullptr) throw DataFileError("The file " + path + " could not be mapped.");
+        
+        if (endsWith(path, ".bin") || endsWith(path, ".raw"))
+        {
+            parseBinary(reinterpret_cast<const char *>(data), source.size(), xs, ys);
+        }
+        else
+        {
+            parseText(reinterpret_cast<const char *>(data), source.size(), xs, ys);
+        }
+        
+        source.unmap(const_cast<uchar *>(data));
+    }
+    
+    source.close();
+    
+    if (xs.empty()) throw DataFileError("No points were found in " + path + ".");
+    
+    // Points with the same x keep their order
+    if (!std::is_sorted(xs.begin(), xs.end()))
+    {
+        std::vector<size_type> order(xs.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&xs](size_type a, size_type b) { return xs[a] < xs[b]; });
+        
+        std::vector<double> sorted(xs.size());
+        
+        for (size_type i = 0; i != order.size(); ++i) sorted[i] = xs[order[i]];
+        xs.swap(sorted);
+        
+        for (size_type i = 0; i != order.size(); ++i) sorted[i] = ys[order[i]];
+        ys.swap(sorted);
+    }
+    
+    header.numLevels = 1;
+    header.counts[0] = xs.size();
+    
+    while (header.numLevels != MAX_LEVELS && header.counts[header.numLevels - 1] / LEVEL_FACTOR >= MIN_LEVEL_POINTS)
+    {
+        header.counts[header.numLevels] = header.counts[header.numLevels - 1] / LEVEL_FACTOR;
+        ++header.numLevels;
+    }
+    
+    size_type total = 0;
+    for (size_type level = 0; level != header.numLevels; ++level) total += 2 * header.counts[level];
+    
+    columns.resize(total);
+    std::copy(xs.begin(), xs.end(), columns.begin());
+    std::copy(ys.begin(), ys.end(), columns.begin() + xs.size());
+    
+    std::vector<double>().swap(xs);
+    std::vector<double>().swap(ys);
+    
+    // Each level is downsampled from the one below it
+    double *level = columns.data();
+    
+    for (size_type k = 1; k != header.numLevels; ++k)
+    {
+        double *next = level + 2 * header.counts[k - 1];
+        
+        downsample(level, level + header.counts[k - 1], header.counts[k - 1], header.counts[k], next, next + header.counts[k]);
+        
+        level = next;
+    }
+    
+    // Written and mapped again, so that the columns are paged in from the file and not kept in memory
+    const qint64 bodySize = static_cast<qint64>(total * sizeof(double));
+    
+    if (sidecar.open(QFile::WriteOnly | QFile::Truncate))
+    {
+        bool written = sidecar.write(reinterpret_cast<const char *>(&header), sizeof(header)) == static_cast<qint64>(sizeof(header)) &&
+                       sidecar.write(reinterpret_cast<const char *>(columns.data()), bodySize) == bodySize;
+        
+        sidecar.close();
+        
+        if (written && mapSidecar(header))
+        {
+            std::vector<double>().swap(columns);
+            return;
+        }
+        
+        sidecar.remove();
+    }
+    
+    setLevels(header, columns.data());
+}
+
+DataSeries::~DataSeries()
+{
+    if (mapped != nullptr) sidecar.unmap(mapped);
+}
+
+const std::string &DataSeries::getPath() const
+{
+    return path;
+}
+
+DataSeries::size_type DataSeries::size() const
+{
+    return counts[0];
+}
+
+const double *DataSeries::getX() const
+{
+    return levelX[0];
+}
+
+const double *DataSeries::getY() const
+{
+    return levelY[0];
+}
+
+void DataSeries::sample(real xFrom, real xTo, size_type numPoints, std::vector<real> &xs, std::vector<real> &ys) const
+{
+    numPoints = std::max<size_type>(numPoints, 3);
+    
+    // The coarsest level with enough points in the range, the finest level has all of them
+    for (size_type level = counts.size(); level-- != 0;)
+    {
+        const double *x = levelX[level];
+        const double *y = levelY[level];
+        
+        size_type first = std::lower_bound(x, x + counts[level], static_cast<double>(xFrom)) - x;
+        size_type last = std::upper_bound(x, x + counts[level], static_cast<double>(xTo)) - x;
+        
+        if (first != 0) --first;
+        if (last != counts[level]) ++last;
+        
+        const size_type count = last - first;
+        
+        if (count < numPoints && level != 0) continue;
+        
+        if (count <= numPoints)
+        {
+            xs.assign(x + first, x + last);
+            ys.assign(y + first, y + last);
+        }
+        else
+        { // Less than LEVEL_FACTOR times too many, or the finest level
+            std::vector<double> sampledX(numPoints);
+            std::vector<double> sampledY(numPoints);
+            
+            downsample(x + first, y + first, count, numPoints, sampledX.data(), sampledY.data());
+            
+            xs.assign(sampledX.begin(), sampledX.end());
+            ys.assign(sampledY.begin(), sampledY.end());
+        }
+        
+        return;
+    }
+}
+
+void DataSeries::downsample(const double *x, const double *y, size_type count, size_type numPoints, double *outX, double *outY)
+{
+    if (numPoints >= count || numPoints < 3)
+    {
+        numPoints = std::min(numPoints, count);
+        
+        std::copy(x, x + numPoints, outX);
+        std::copy(y, y + numPoints, outY);
+        
+        return;
+    }
+    
+    const size_type numBuckets = numPoints - 2;
+    
+    // The points strictly between the ends are split evenly, bucket b is [begin(b), begin(b + 1))
+    auto begin = [count, numBuckets](size_type bucket)
+    {
+        return 1 + bucket * (count - 2) / numBuckets;
+    };
+    
+    outX[0] = x[0];
+    outY[0] = y[0];
+    
+    size_type kept = 0;
+    
+    for (size_type bucket = 0; bucket != numBuckets; ++bucket)
+    {
+        // The mean of the next bucket, the last point after the last bucket
+        double meanX = x[count - 1];
+        double meanY = y[count - 1];
+        
+        if (bucket + 1 != numBuckets)
+        {
+            const size_type nextBegin = begin(bucket + 1);
+            const size_type nextEnd = begin(bucket + 2);
+            
+            meanX = meanY = 0;
+            for (size_type i = nextBegin; i != nextEnd; ++i)
+            {
+                meanX += x[i];
+                meanY += y[i];
+            }
+            
+            meanX /= nextEnd - nextBegin;
+            meanY /= nextEnd - nextBegin;
+        }
+        
+        // Twice the area of the triangle, the factor does not change which is largest
+        const double keptX = x[kept];
+        const double keptY = y[kept];
+        
+        size_type best = begin(bucket);
+        double bestArea = -1;
+        
+        for (size_type i = begin(bucket); i != begin(bucket + 1); ++i)
+        {
+            const double area = std::abs((keptX - meanX) * (y[i] - keptY) - (keptX - x[i]) * (meanY - keptY));
+            
+            if (area > bestArea)
+            {
+                best = i;
+                bestArea = area;
+            }
+        }
+        
+        kept = best;
+        outX[bucket + 1] = x[kept];
+        outY[bucket + 1] = y[kept];
+    }
+    
+    outX[numPoints - 1] = x[count - 1];
+    outY[numPoints - 1] = y[count - 1];
+}
+
+bool DataSeries::mapSidecar(const Header &expected)
+{
+    if (!sidecar.open(QFile::ReadOnly)) return false;
+    
+    Header header;
+    
+    bool valid = sidecar.read(reinterpret_cast<char *>(&header), sizeof(header)) == static_cast<qint64>(sizeof(header)) &&
+                 std::memcmp(header.magic, expected.magic, sizeof(header.magic)) == 0 &&
+                 header.sourceSize == expected.sourceSize &&
+                 header.sourceModified == expected.sourceModified &&
+                 header.numLevels != 0 && header.numLevels <= MAX_LEVELS;
+    
+    qint64 fileSize = sizeof(header);
+    for (size_type level = 0; valid && level != header.numLevels; ++level) fileSize += 2 * header.counts[level] * sizeof(double);
+    
+    if (valid && sidecar.size() == fileSize) mapped = sidecar.map(0, fileSize);
+    
+    if (mapped == nullptr)
+    {
+        sidecar.close();
+        return false;
+    }
+    
+    // The file stays open, closing it would unmap it
+    setLevels(header, reinterpret_cast<const double *>(mapped + sizeof(header)));
+    
+    return true;
+}
+
+void DataSeries::setLevels(const Header &header, const double *body)
+{
+    counts.assign(header.counts, header.counts + header.numLevels);
+    levelX.clear();
+    levelY.clear();
+    
+    for (size_type level = 0; level != counts.size(); ++level)
+    {
+        levelX.push_back(body);
+        levelY.push_back(body + counts[level]);
+        
+        body += 2 * counts[level];
+    }
+}
+
+void DataSeries::parseText(const char *text, size_type length, std::vector<double> &xs, std::vector<double> &ys)
+{
+    // A chunk begins after the first line break from just before its nominal start, so the line
+    // across a boundary belongs to the chunk before it
+    auto lineStart = [text, length](size_type position) -> size_type
+    {
+        if (position == 0) return 0;
+        if (position >= length) return length;
+        
+        const void *lineBreak = std::memchr(text + position - 1, '\n', length - position + 1);
+        
+        return lineBreak == nullptr ? length : static_cast<const char *>(lineBreak) - text + 1;
+    };
+    
+    const size_type numChunks = (length + PARSE_CHUNK_SIZE - 1) / PARSE_CHUNK_SIZE;
+    
+    std::vector<std::vector<double>> chunkX(numChunks);
+    std::vector<std::vector<double>> chunkY(numChunks);
+    
+    ThreadPool::globalInstance().parallelFor(numChunks, [&](ThreadPool::size_type chunk)
+    {
+        const char *position = text + lineStart(chunk * PARSE_CHUNK_SIZE);
+        const char *end = text + lineStart((chunk + 1) * PARSE_CHUNK_SIZE);
+        
+        while (position < end)
+        {
+            const void *lineBreak = std::memchr(position, '\n', end - position);
+            const char *lineEnd = lineBreak == nullptr ? end : static_cast<const char *>(lineBreak);
+            
+            double x, y;
+            
+            if (parseNumber(position, lineEnd, x) && parseNumber(position, lineEnd, y) && std::isfinite(x) && std::isfinite(y))
+            {
+                chunkX[chunk].push_back(x);
+                chunkY[chunk].push_back(y);
+            }
+            
+            position = lineEnd + 1;
+        }
+    });
+    
+    size_type total = 0;
+    for (const std::vector<double> &chunk : chunkX) total += chunk.size();
+    
+    xs.reserve(total);
+    ys.reserve(total);
+    
+    for (size_type chunk = 0; chunk != numChunks; ++chunk)
+    {
+        xs.insert(xs.end(), chunkX[chunk].begin(), chunkX[chunk].end());
+        ys.insert(ys.end(), chunkY[chunk].begin(), chunkY[chunk].end());
+        
+        std::vector<double>().swap(chunkX[chunk]);
+        std::vector<double>().swap(chunkY[chunk]);
+    }
+}
+
+void DataSeries::parseBinary(const char *data, size_type length, std::vector<double> &xs, std::vector<double> &ys)
+{
+    const size_type count = length / (2 * sizeof(double));
+    
+    xs.reserve(count);
+    ys.reserve(count);
+    
+    for (size_type i = 0; i != count; ++i)
+    {
+        double point[2];
+        std::memcpy(point, data + i * sizeof(point), sizeof(point));
+        
+        if (std::isfinite(point[0]) && std::isfinite(point[1]))
+        {
+            xs.push_back(point[0]);
+            ys.push_back(point[1]);
+        }
+    }
+}
+
+bool DataSeries::parseNumber(const char *&position, const char *end, double &value)
+{
+    // Exact powers of ten, up to 10^27 they fit in the mantissa of a long double
+    static const long double powers[] = {1e0L, 1e1L, 1e2L, 1e3L, 1e4L, 1e5L, 1e6L, 1e7L, 1e8L, 1e9L, 1e10L, 1e11L, 1e12L, 1e13L,
+                                         1e14L, 1e15L, 1e16L, 1e17L, 1e18L, 1e19L, 1e20L, 1e21L, 1e22L, 1e23L, 1e24L, 1e25L, 1e26L, 1e27L};
+    const int MAX_POWER = sizeof(powers) / sizeof(powers[0]) - 1;
+    const std::uint64_t MAX_MANTISSA = 100000000000000000ull; // More digits are beyond the precision of a double
+    
+    auto isBlank = [](char c) { return c == ' ' || c == '\t' || c == '\r'; };
+    auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+    
+    // Blanks, and a comma or semicolon between the numbers
+    const char *p = position;
+    while (p != end && isBlank(*p)) ++p;
+    if (p != end && (*p == ',' || *p == ';')) ++p;
+    while (p != end && isBlank(*p)) ++p;
+    
+    bool negative = false;
+    if (p != end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    
+    std::uint64_t mantissa = 0;
+    int exponent = 0;
+    bool hasDigits = false;
+    
+    for (; p != end && isDigit(*p); ++p, hasDigits = true)
+    {
+        if (mantissa < MAX_MANTISSA) mantissa = mantissa * 10 + (*p - '0');
+        else ++exponent;
+    }
+    
+    if (p != end && *p == '.')
+    {
+        for (++p; p != end && isDigit(*p); ++p, hasDigits = true)
+        {
+            if (mantissa < MAX_MANTISSA)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                --exponent;
+            }
+        }
+    }
+    
+    if (!hasDigits) return false;
+    
+    if (p != end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        
+        bool negativeExponent = false;
+        if (q != end && (*q == '-' || *q == '+')) negativeExponent = *q++ == '-';
+        
+        int written = 0;
+        bool hasExponentDigits = false;
+        
+        for (; q != end && isDigit(*q); ++q, hasExponentDigits = true)
+        {
+            if (written < 100000) written = written * 10 + (*q - '0');
+        }
+        
+        if (hasExponentDigits)
+        {
+            exponent += negativeExponent ? -written : written;
+            p = q;
+        }
+    }
+    
+    // Anything else right after the number, like a letter, means that the field is not a number
+    if (p != end && !isBlank(*p) && *p != ',' && *p != ';') return false;
+    
+    long double result = mantissa;
+    
+    if (exponent >= 0)
+    {
+        result *= exponent <= MAX_POWER ? powers[exponent] : std::pow(10.0L, exponent);
+    }
+    else
+    {
+        result /= -exponent <= MAX_POWER ? powers[-exponent] : std::pow(10.0L, -exponent);
+    }
+    
+    value = static_cast<double>(negative ? -result : result);
+    position = p;
+    
+    return true;
+}
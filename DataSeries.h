@@ -0,0 +1,104 @@
+//
+//  DataSeries.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__DataSeries__
+#define __MathGraph__DataSeries__
+
+#include "real.h"
+
+#include <QFile>
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+class DataFileError : public std::runtime_error
+{
+public:
+    DataFileError(const std::string &_what_arg);
+};
+
+// Measured (x, y) points loaded from a file, sorted by x. Text files have one point per line, the
+// first two numbers on a line separated by commas, semicolons or blanks, lines without two numbers
+// are skipped. Files ending in .bin or .raw hold x and y as pairs of native doubles.
+//
+// The file is memory-mapped and parsed once into a sidecar next to it, which holds the x and y
+// columns and a pyramid of coarser levels, each downsampled by LEVEL_FACTOR with Largest-Triangle-
+// Three-Buckets. Later loads map the sidecar directly. A view is drawn from the coarsest level that
+// still has enough points in it, so the work follows the number of pixels, not the number of points.
+class DataSeries
+{
+public:
+    typedef std::size_t size_type;
+    
+    // May throw DataFileError. If the sidecar cannot be written the columns are kept in memory.
+    DataSeries(const std::string &_path);
+    ~DataSeries();
+    
+    DataSeries(const DataSeries &) = delete;
+    DataSeries &operator=(const DataSeries &) = delete;
+    
+    const std::string &getPath() const;
+    
+    // The points of the file, sorted by x
+    size_type size() const;
+    const double *getX() const;
+    const double *getY() const;
+    
+    // About numPoints points that look like the data over [xFrom, xTo], with the closest point on
+    // each side so that the line continues out of the view
+    void sample(real xFrom, real xTo, size_type numPoints, std::vector<real> &xs, std::vector<real> &ys) const;
+    
+    // Keeps the first and the last point, and from each of numPoints - 2 buckets in between the point
+    // that makes the largest triangle with the point kept before it and the mean of the next bucket
+    static void downsample(const double *x, const double *y, size_type count, size_type numPoints, double *outX, double *outY);
+    
+    // Reads a number in plain or scientific notation at position, after blanks and a comma or semicolon,
+    // and moves position past it. Returns false if there is none, or if the field goes on after it.
+    static bool parseNumber(const char *&position, const char *end, double &value);
+    
+    static const std::string SIDECAR_SUFFIX;
+    
+private:
+    // Each level has about a LEVEL_FACTOR:th of the points of the one below, down to MIN_LEVEL_POINTS
+    static const size_type LEVEL_FACTOR = 8;
+    static const size_type MIN_LEVEL_POINTS = 4096;
+    static const size_type MAX_LEVELS = 16;
+    
+    // Text is split into chunks of about this many bytes that are parsed in parallel
+    static const size_type PARSE_CHUNK_SIZE = 1 << 22;
+    
+    // Start of the sidecar, the levels follow with the x column of each before its y column
+    struct Header
+    {
+        char magic[8];
+        std::uint64_t sourceSize;
+        std::int64_t sourceModified; // Milliseconds since the epoch
+        std::uint64_t numLevels;
+        std::uint64_t counts[MAX_LEVELS];
+    };
+    
+    std::string path;
+    
+    QFile sidecar;
+    uchar *mapped;
+    std::vector<double> columns; // Only if the sidecar could not be written
+    
+    std::vector<size_type> counts;
+    std::vector<const double *> levelX;
+    std::vector<const double *> levelY;
+    
+    bool mapSidecar(const Header &expected);
+    void setLevels(const Header &header, const double *body);
+    static void parseText(const char *text, size_type length, std::vector<double> &xs, std::vector<double> &ys);
+    static void parseBinary(const char *data, size_type length, std::vector<double> &xs, std::vector<double> &ys);
+};
+
+#endif /* defined(__MathGraph__DataSeries__) */
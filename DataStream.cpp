@@ -0,0 +1,308 @@
+//
+//  DataStream.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "DataStream.h"
+#include "DataSeries.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+DataStream::DataStream(const std::string &_socketPath, size_type windowLength)
+    : socketPath(_socketPath),
+      listenSocket(-1),
+      ring(RING_CAPACITY),
+      dropped(0),
+      windowX(std::max<size_type>(windowLength, 1)),
+      windowY(windowX.size()),
+      windowFirst(0),
+      windowSize(0),
+      reader()
+{
+    if (pipe(stopPipe) != 0) throw DataFileError("The stream could not be started.");
+    
+    if (!socketPath.empty())
+    {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        
+        if (socketPath.size() >= sizeof(address.sun_path))
+        {
+            close(stopPipe[0]);
+            close(stopPipe[1]);
+            throw DataFileError("The socket path " + socketPath + " is too long.");
+        }
+        
+        std::strcpy(address.sun_path, socketPath.c_str());
+        
+        // A socket left by an earlier run is replaced, other files are not
+        struct stat status;
+        if (stat(socketPath.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) unlink(socketPath.c_str());
+        
+        listenSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+        
+        if (listenSocket == -1 || bind(listenSocket, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0 || listen(listenSocket, 1) != 0)
+        {
+            if (listenSocket != -1) close(listenSocket);
+            close(stopPipe[0]);
+            close(stopPipe[1]);
+            throw DataFileError("No socket could be created at " + socketPath + ".");
+        }
+    }
+    
+    reader = std::thread(&DataStream::read, this);
+}
+
+DataStream::~DataStream()
+{
+    const char stop = 0;
+    while (write(stopPipe[1], &stop, 1) == -1 && errno == EINTR) {}
+    
+    reader.join();
+    
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    
+    if (listenSocket != -1)
+    {
+        close(listenSocket);
+        unlink(socketPath.c_str());
+    }
+}
+
+DataStream::size_type DataStream::drain()
+{
+    double x[DRAIN_SIZE];
+    double y[DRAIN_SIZE];
+    
+    // At most one ring full, so a fast producer cannot keep the consumer here
+    size_type total = 0;
+    size_type count;
+    
+    while (total < RING_CAPACITY && (count = ring.pop(x, y, DRAIN_SIZE)) != 0)
+    {
+        for (size_type i = 0; i != count; ++i)
+        {
+            const size_type next = windowIndex(windowSize == windowX.size() ? 0 : windowSize);
+            
+            windowX[next] = x[i];
+            windowY[next] = y[i];
+            
+            if (windowSize == windowX.size()) windowFirst = (windowFirst + 1) % windowX.size();
+            else ++windowSize;
+        }
+        
+        total += count;
+    }
+    
+    return total;
+}
+
+DataStream::size_type DataStream::size() const
+{
+    return windowSize;
+}
+
+real DataStream::getLatestX() const
+{
+    return windowSize == 0 ? 0 : windowX[windowIndex(windowSize - 1)];
+}
+
+DataStream::size_type DataStream::getDropped() const
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void DataStream::decimate(real xFrom, real xTo, int numColumns, std::vector<real> &xs, std::vector<real> &ys) const
+{
+    xs.clear();
+    ys.clear();
+    
+    if (windowSize == 0 || numColumns <= 0 || !(xTo > xFrom)) return;
+    
+    // The first sample at or after x in the window
+    auto lowerBound = [this](real x)
+    {
+        size_type low = 0;
+        size_type high = windowSize;
+        
+        while (low != high)
+        {
+            const size_type middle = low + (high - low) / 2;
+            
+            if (windowX[windowIndex(middle)] < x) low = middle + 1;
+            else high = middle;
+        }
+        
+        return low;
+    };
+    
+    size_type first = lowerBound(xFrom);
+    size_type last = lowerBound(std::nextafter(static_cast<double>(xTo), HUGE_VAL));
+    
+    if (first != 0) --first;
+    if (last != windowSize) ++last;
+    
+    // Column of a sample, in double since real division is slow and the columns are pixels
+    const double origin = static_cast<double>(xFrom);
+    const double columnsPerX = numColumns / static_cast<double>(xTo - xFrom);
+    
+    size_type i = first;
+    size_type position = windowIndex(i); // Of sample i in the arrays
+    
+    auto advance = [this, &i, &position]()
+    {
+        ++i;
+        if (++position == windowX.size()) position = 0;
+    };
+    
+    while (i != last)
+    {
+        const double currentColumn = std::floor((windowX[position] - origin) * columnsPerX);
+        
+        size_type kept[4] = {i, i, i, i}; // First, smallest, largest and last
+        double smallest = windowY[position];
+        double largest = windowY[position];
+        
+        for (advance(); i != last && std::floor((windowX[position] - origin) * columnsPerX) == currentColumn; advance())
+        {
+            const double y = windowY[position];
+            
+            if (y < smallest)
+            {
+                smallest = y;
+                kept[1] = i;
+            }
+            
+            if (y > largest)
+            {
+                largest = y;
+                kept[2] = i;
+            }
+            
+            kept[3] = i;
+        }
+        
+        std::sort(kept, kept + 4);
+        
+        for (size_type k = 0; k != 4; ++k)
+        {
+            if (k != 0 && kept[k] == kept[k - 1]) continue;
+            
+            xs.push_back(windowX[windowIndex(kept[k])]);
+            ys.push_back(windowY[windowIndex(kept[k])]);
+        }
+    }
+}
+
+void DataStream::read()
+{
+    size_type received = 0;
+    
+    if (listenSocket == -1)
+    {
+        readFrom(STDIN_FILENO, received);
+        return;
+    }
+    
+    while (waitFor(listenSocket))
+    {
+        const int client = accept(listenSocket, nullptr, nullptr);
+        
+        if (client == -1) continue;
+        
+        const bool stopped = !readFrom(client, received);
+        
+        close(client);
+        
+        if (stopped) return;
+    }
+}
+
+bool DataStream::readFrom(int fd, size_type &received)
+{
+    std::vector<char> buffer(READ_SIZE);
+    size_type used = 0; // Bytes of a line that is not complete yet
+    bool skipping = false; // In a line longer than the buffer, until its end
+    
+    while (waitFor(fd))
+    {
+        if (used == buffer.size())
+        {
+            used = 0;
+            skipping = true;
+        }
+        
+        const ssize_t count = ::read(fd, buffer.data() + used, buffer.size() - used);
+        
+        if (count == -1 && errno == EINTR) continue;
+        if (count <= 0) return true;
+        
+        used += count;
+        
+        const char *position = buffer.data();
+        const char *end = buffer.data() + used;
+        
+        while (const void *lineBreak = std::memchr(position, '\n', end - position))
+        {
+            if (!skipping) parseLine(position, static_cast<const char *>(lineBreak), received);
+            
+            skipping = false;
+            position = static_cast<const char *>(lineBreak) + 1;
+        }
+        
+        used = end - position;
+        std::memmove(buffer.data(), position, used);
+    }
+    
+    return false;
+}
+
+bool DataStream::waitFor(int fd) const
+{
+    pollfd fds[2] = {{fd, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+    
+    while (poll(fds, 2, -1) == -1)
+    {
+        if (errno != EINTR) return false;
+    }
+    
+    return fds[1].revents == 0;
+}
+
+void DataStream::parseLine(const char *begin, const char *end, size_type &received)
+{
+    double first;
+    double second;
+    
+    if (!DataSeries::parseNumber(begin, end, first)) return;
+    
+    const bool hasX = DataSeries::parseNumber(begin, end, second);
+    
+    const double x = hasX ? first : static_cast<double>(received);
+    const double y = hasX ? second : first;
+    
+    if (!std::isfinite(x) || !std::isfinite(y)) return;
+    
+    ++received;
+    
+    if (!ring.push(x, y)) dropped.fetch_add(1, std::memory_order_relaxed);
+}
+
+DataStream::size_type DataStream::windowIndex(size_type i) const
+{
+    return (windowFirst + i) % windowX.size();
+}
@@ -0,0 +1,86 @@
+//
+//  DataStream.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__DataStream__
+#define __MathGraph__DataStream__
+
+#include "real.h"
+#include "SampleRing.h"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Samples read live from standard input or a Unix socket, one per line as "x y" or only "y", which is
+// then placed at x = the number of samples before it. A thread of its own reads and parses the input
+// and pushes the samples into a ring. It never waits for the GUI, when the ring is full the samples
+// are dropped and counted. The GUI thread drains the ring into a window of the latest samples, so the
+// memory is bounded by the ring and the window length.
+class DataStream
+{
+public:
+    typedef std::size_t size_type;
+    
+    // An empty path reads standard input. Otherwise a socket is created at the path and its clients
+    // are read one at a time. May throw DataFileError.
+    DataStream(const std::string &_socketPath, size_type windowLength);
+    ~DataStream();
+    
+    DataStream(const DataStream &) = delete;
+    DataStream &operator=(const DataStream &) = delete;
+    
+    // Called from the consumer thread only. Moves the new samples into the window and returns how many
+    // there were.
+    size_type drain();
+    
+    // Samples in the window, and the x of the latest one
+    size_type size() const;
+    real getLatestX() const;
+    
+    // Samples that came while the ring was full
+    size_type getDropped() const;
+    
+    // The window over [xFrom, xTo] as the first, smallest, largest and last sample in each of numColumns
+    // columns, in the order they came, with the closest sample on each side of the range. Expects x
+    // not to decrease along the stream.
+    void decimate(real xFrom, real xTo, int numColumns, std::vector<real> &xs, std::vector<real> &ys) const;
+    
+private:
+    static const size_type RING_CAPACITY = 1 << 20;
+    
+    // Bytes read at a time, a longer line is dropped
+    static const size_type READ_SIZE = 1 << 16;
+    
+    // Samples moved from the ring to the window at a time
+    static const size_type DRAIN_SIZE = 4096;
+    
+    std::string socketPath;
+    int listenSocket; // -1 for standard input
+    int stopPipe[2]; // Written to stop the reader
+    
+    SampleRing ring;
+    std::atomic<size_type> dropped;
+    
+    // Circular, the oldest sample is at windowFirst
+    std::vector<double> windowX;
+    std::vector<double> windowY;
+    size_type windowFirst;
+    size_type windowSize;
+    
+    std::thread reader;
+    
+    void read();
+    bool readFrom(int fd, size_type &received);
+    bool waitFor(int fd) const;
+    void parseLine(const char *begin, const char *end, size_type &received);
+    size_type windowIndex(size_type i) const;
+};
+
+#endif /* defined(__MathGraph__DataStream__) */
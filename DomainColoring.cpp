@@ -0,0 +1,148 @@
+//
+//  DomainColoring.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "DomainColoring.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+DomainColoring::DomainColoring(const Expression &_expression, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight)
+    : expression(_expression),
+      xMin(_xMin),
+      xMax(_xMax),
+      yMin(_yMin),
+      yMax(_yMax),
+      pixelWidth(std::max(_pixelWidth, 0)),
+      pixelHeight(std::max(_pixelHeight, 0)),
+      coarseColumns((pixelWidth + COARSE_BLOCK_SIZE - 1) / COARSE_BLOCK_SIZE),
+      coarse(static_cast<std::size_t>(coarseColumns) * ((pixelHeight + COARSE_BLOCK_SIZE - 1) / COARSE_BLOCK_SIZE))
+{
+    const real xStep = (xMax - xMin) / pixelWidth * COARSE_BLOCK_SIZE;
+    const real yStep = (yMax - yMin) / pixelHeight * COARSE_BLOCK_SIZE;
+    
+    std::vector<real> re(coarse.size());
+    std::vector<real> im(coarse.size());
+    
+    for (std::size_t k = 0; k != coarse.size(); ++k)
+    {
+        re[k] = xMin + (k % coarseColumns + 0.5) * xStep;
+        im[k] = yMax - (k / coarseColumns + 0.5) * yStep;
+    }
+    
+    expression.evaluateComplex(re.data(), im.data(), re.data(), im.data(), coarse.size());
+    
+    for (std::size_t k = 0; k != coarse.size(); ++k)
+    {
+        coarse[k] = color(re[k], im[k]);
+    }
+}
+
+int DomainColoring::getPixelWidth() const
+{
+    return pixelWidth;
+}
+
+int DomainColoring::getPixelHeight() const
+{
+    return pixelHeight;
+}
+
+void DomainColoring::renderCoarse(std::uint32_t *pixels) const
+{
+    for (int py = 0; py != pixelHeight; ++py)
+    {
+        const std::uint32_t *row = coarse.data() + static_cast<std::size_t>(py / COARSE_BLOCK_SIZE) * coarseColumns;
+        std::uint32_t *out = pixels + static_cast<std::size_t>(py) * pixelWidth;
+        
+        for (int px = 0; px != pixelWidth; ++px)
+        {
+            out[px] = row[px / COARSE_BLOCK_SIZE];
+        }
+    }
+}
+
+bool DomainColoring::render(std::uint32_t *pixels, const std::atomic<bool> &cancelled) const
+{
+    const int tileColumns = (pixelWidth + TILE_SIZE - 1) / TILE_SIZE;
+    const int tileRows = (pixelHeight + TILE_SIZE - 1) / TILE_SIZE;
+    
+    const real xStep = (xMax - xMin) / pixelWidth;
+    const real yStep = (yMax - yMin) / pixelHeight;
+    
+    ThreadPool::globalInstance().parallelFor(static_cast<ThreadPool::size_type>(tileColumns) * tileRows, [&](ThreadPool::size_type tile)
+    {
+        if (cancelled) return;
+        
+        const int left = static_cast<int>(tile % tileColumns) * TILE_SIZE;
+        const int top = static_cast<int>(tile / tileColumns) * TILE_SIZE;
+        const int width = std::min(pixelWidth - left, static_cast<int>(TILE_SIZE));
+        const int height = std::min(pixelHeight - top, static_cast<int>(TILE_SIZE));
+        
+        real re[TILE_SIZE];
+        real im[TILE_SIZE];
+        real wRe[TILE_SIZE];
+        real wIm[TILE_SIZE];
+        
+        for (int i = 0; i != width; ++i)
+        {
+            re[i] = xMin + (left + i + 0.5) * xStep;
+        }
+        
+        for (int py = top; py != top + height; ++py)
+        {
+            std::fill(im, im + width, yMax - (py + 0.5) * yStep);
+            
+            expression.evaluateComplex(re, im, wRe, wIm, width);
+            
+            std::uint32_t *out = pixels + static_cast<std::size_t>(py) * pixelWidth + left;
+            for (int i = 0; i != width; ++i)
+            {
+                out[i] = color(wRe[i], wIm[i]);
+            }
+        }
+    });
+    
+    return !cancelled;
+}
+
+std::uint32_t DomainColoring::color(real re, real im)
+{
+    // Double precision is plenty for a color
+    const double x = static_cast<double>(re);
+    const double y = static_cast<double>(im);
+    
+    if (std::isnan(x) || std::isnan(y)) return 0;
+    
+    const double magnitude = std::hypot(x, y);
+    
+    if (magnitude == 0) return 0xff000000u;
+    if (std::isinf(magnitude)) return 0xffffffffu;
+    
+    // Hue from the argument, red on the positive real axis
+    const double pi = 3.14159265358979323846;
+    double hue = std::atan2(y, x) / (2 * pi);
+    if (hue < 0) hue += 1;
+    
+    // Brightness from 0.6 to 1 within every doubling of the magnitude
+    double rings = std::log2(magnitude);
+    double value = 0.6 + 0.4 * (rings - std::floor(rings));
+    
+    const double saturation = 0.9;
+    
+    // HSV to RGB, n selects the channel
+    auto channel = [&](double n) -> std::uint32_t
+    {
+        double k = std::fmod(n + hue * 6, 6);
+        double c = value - value * saturation * std::max(0.0, std::min(std::min(k, 4 - k), 1.0));
+        
+        return static_cast<std::uint32_t>(c * 255 + 0.5);
+    };
+    
+    return 0xff000000u | channel(5) << 16 | channel(3) << 8 | channel(1);
+}
@@ -0,0 +1,56 @@
+//
+//  DomainColoring.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__DomainColoring__
+#define __MathGraph__DomainColoring__
+
+#include "real.h"
+#include "Expression.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Shows a complex function w = f(z) by coloring every point z of the viewport by w. The hue is
+// the argument of w and the brightness repeats for every doubling of |w|, so zeros and poles are
+// where all colors meet. Like Heatmap a coarse preview is sampled in the constructor and the
+// full image is rendered in tiles on the thread pool.
+class DomainColoring
+{
+public:
+    DomainColoring(const Expression &_expression, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight);
+    
+    int getPixelWidth() const;
+    int getPixelHeight() const;
+    
+    // pixels holds pixelWidth * pixelHeight ARGB values row by row, undefined points are transparent
+    void renderCoarse(std::uint32_t *pixels) const;
+    
+    // Returns false if cancelled was set before all tiles were done
+    bool render(std::uint32_t *pixels, const std::atomic<bool> &cancelled) const;
+    
+private:
+    // Pixels per side of the coarse blocks and of the tiles
+    static const int COARSE_BLOCK_SIZE = 8;
+    static const int TILE_SIZE = 64;
+    
+    Expression expression;
+    real xMin, xMax;
+    real yMin, yMax;
+    int pixelWidth;
+    int pixelHeight;
+    
+    // Colors of the centers of the coarse blocks
+    int coarseColumns;
+    std::vector<std::uint32_t> coarse;
+    
+    static std::uint32_t color(real re, real im);
+};
+
+#endif /* defined(__MathGraph__DomainColoring__) */
@@ -8,9 +8,14 @@
 
 #include "Expression.h"
 #include "TokenReader.h"
+#include "CumulativeIntegral.h"
+#include "GridCache.h"
 
 #include <stack>
 #include <queue>
+#include <algorithm>
+#include <limits>
+#include <cmath>
 
 InvalidExpression::InvalidExpression(const std::string &_what_arg, ErrorType _errorType, size_type _position, size_type _length)
     : invalid_argument(_what_arg),
@@ -44,6 +49,10 @@ std::map<std::string, const real> Expression::constants = {
 
 std::map<std::string, real> Expression::variables;
 
+const std::size_t Expression::BLOCK_SIZE;
+
+std::atomic<unsigned long> Expression::variablesVersion(0);
+
 std::map<std::string, real (*)(real)> Expression::functions = {
     {"sin", real_functions::sin},
     {"cos", real_functions::cos},
@@ -54,10 +63,49 @@ std::map<std::string, real (*)(real)> Expression::functions = {
     {"sqrt", real_functions::sqrt},
     {"floor", real_functions::floor},
     {"ceil", real_functions::ceil},
+    {"abs", real_functions::abs},
     {"ln", real_functions::ln},
     {"log", real_functions::log10}
 };
 
+std::map<std::string, real (*)(real)> Expression::derivatives = {
+    {"sin", real_functions::cos},
+    {"cos", [](real x) -> real { return -real_functions::sin(x); }},
+    {"tan", [](real x) -> real { return 1 / (real_functions::cos(x) * real_functions::cos(x)); }},
+    {"arcsin", [](real x) -> real { return 1 / real_functions::sqrt(1 - x * x); }},
+    {"arccos", [](real x) -> real { return -1 / real_functions::sqrt(1 - x * x); }},
+    {"arctan", [](real x) -> real { return 1 / (1 + x * x); }},
+    {"sqrt", [](real x) -> real { return 1 / (2 * real_functions::sqrt(x)); }},
+    {"floor", [](real) -> real { return 0; }},
+    {"ceil", [](real) -> real { return 0; }},
+    {"abs", [](real x) -> real { return x < 0 ? -1 : x > 0 ? 1 : 0; }},
+    {"ln", [](real x) -> real { return 1 / x; }},
+    {"log", [](real x) -> real { return 1 / (x * real_functions::ln(10)); }}
+};
+
+std::map<std::string, std::complex<real> (*)(std::complex<real>)> Expression::complexFunctions = {
+    {"sin", [](std::complex<real> z) { return std::sin(z); }},
+    {"cos", [](std::complex<real> z) { return std::cos(z); }},
+    {"tan", [](std::complex<real> z) { return std::tan(z); }},
+    {"arcsin", [](std::complex<real> z) { return std::asin(z); }},
+    {"arccos", [](std::complex<real> z) { return std::acos(z); }},
+    {"arctan", [](std::complex<real> z) { return std::atan(z); }},
+    {"sqrt", [](std::complex<real> z) { return std::sqrt(z); }},
+    {"floor", [](std::complex<real> z) { return std::complex<real>(real_functions::floor(z.real()), real_functions::floor(z.imag())); }},
+    {"ceil", [](std::complex<real> z) { return std::complex<real>(real_functions::ceil(z.real()), real_functions::ceil(z.imag())); }},
+    {"abs", [](std::complex<real> z) { return std::complex<real>(std::abs(z)); }},
+    {"ln", [](std::complex<real> z) { return std::log(z); }},
+    {"log", [](std::complex<real> z) { return std::log10(z); }}
+};
+
+std::map<std::string, std::size_t> Expression::multiArgumentFunctions = {
+    {"if", 3},
+    {"min", 2},
+    {"max", 2}
+};
+
+std::map<std::string, std::shared_ptr<const Expression>> Expression::definitions;
+
 bool Expression::addVariable(std::string name, real initialValue)
 {
     bool wasCreated = false;
@@ -65,6 +113,7 @@ bool Expression::addVariable(std::string name, real initialValue)
     if (variables.find(name) == variables.end())
     {
         variables[name] = initialValue;
+        ++variablesVersion;
         
         wasCreated = true;
     }
@@ -79,6 +128,7 @@ bool Expression::setVariable(std::string name, real value)
     if (variables.find(name) != variables.end())
     {
         variables[name] = value;
+        ++variablesVersion;
         
         exists = true;
     }
@@ -86,16 +136,81 @@ bool Expression::setVariable(std::string name, real value)
     return exists;
 }
 
-void Expression::addFunction(std::string name, real (*functionPointer)(real))
+real Expression::getVariable(const std::string &name)
+{
+    auto variable = variables.find(name);
+    
+    return variable != variables.end() ? variable->second : NAN;
+}
+
+void Expression::addFunction(std::string name, real (*functionPointer)(real), real (*derivative)(real))
 {
     functions[name] = functionPointer;
+    complexFunctions.erase(name);
+    
+    if (derivative != nullptr)
+    {
+        derivatives[name] = derivative;
+    }
+    else
+    {
+        derivatives.erase(name);
+    }
+}
+
+void Expression::define(const Expression &definition)
+{
+    definitions[definition.name] = std::make_shared<const Expression>(definition);
+}
+
+void Expression::undefine(const std::string &name)
+{
+    definitions.erase(name);
+}
+
+bool Expression::isDefined(const std::string &name)
+{
+    return definitions.find(name) != definitions.end();
+}
+
+unsigned long Expression::getVariablesVersion()
+{
+    return variablesVersion;
 }
 
 Expression::Expression(std::string expression)
+    : Expression(expression, "x", true)
+{
+    source = expression;
+}
+
+Expression::Expression(const std::string &expression, const std::string &_argument, bool topLevel)
+    : program(),
+      stackSize(0),
+      differentiable(true),
+      equation(false),
+      kind(FUNCTION),
+      argument(_argument),
+      integrals(),
+      polynomials(),
+      cachedSubtrees(),
+      components(),
+      source(),
+      name(),
+      dependencies()
 {
+    if (topLevel && parseKind(expression)) return;
+    
     std::stack<std::string> tempStack;
     std::queue<std::string> outputQueue;
     
+    // (arguments read, arguments expected) for every open parenthesis
+    std::stack<std::pair<std::size_t, std::size_t>> calls;
+    
+    // Whether the current argument or parenthesis already has a comparison, at the top the whole expression
+    std::stack<bool> compared;
+    compared.push(false);
+    
     TokenReader r(expression);
     std::string token;
     
@@ -114,9 +229,27 @@ Expression::Expression(std::string expression)
                 ++numOperands;
                 break;
             case NAME:
-                if (constants.find(token) != constants.end())
+                if (token == "integral")
+                { // integral(f, a, x)
+                    outputQueue.push(parseIntegral(r, expression));
+                    
+                    isUnary = false;
+                    ++numOperands;
+                }
+                else if (token == argument || (token == "y" && argument == "x") || (token == "i" && argument == "z"))
+                { // argument, or the imaginary unit in complex functions
+                    outputQueue.push(token);
+                    
+                    isUnary = false;
+                    ++numOperands;
+                }
+                else if (token == "x" || token == "y")
+                {
+                    throw InvalidExpression("Use " + argument + " instead of x and y", InvalidExpression::UNDEFINED_NAME, r.getCurrentPosition() - token.length(), token.length());
+                }
+                else if (constants.find(token) != constants.end())
                 { // constant
-                    outputQueue.push(real_functions::toString(constants[token]));
+                    outputQueue.push(token);
                     
                     isUnary = false;
                     ++numOperands;
@@ -128,7 +261,7 @@ Expression::Expression(std::string expression)
                     isUnary = false;
                     ++numOperands;
                 }
-                else if (functions.find(token) != functions.end())
+                else if (isFunctionName(token))
                 { // function
                     tempStack.push(token);
                 }
@@ -155,6 +288,21 @@ Expression::Expression(std::string expression)
                 }
                 else
                 {
+                    if (token == "=")
+                    {
+                        if (equation)
+                            throw InvalidExpression("Only one '=' is allowed", InvalidExpression::INVALID_CHARACTER, r.getCurrentPosition() - 1, 1);
+                        
+                        equation = true;
+                    }
+                    else if (TokenReader::isComparison(token))
+                    { // a < b < c would compare the 0 or 1 of a < b to c
+                        if (compared.top())
+                            throw InvalidExpression("Comparisons can not be chained", InvalidExpression::INVALID_CHARACTER, r.getCurrentPosition() - token.length(), token.length());
+                        
+                        compared.top() = true;
+                    }
+                    
                     while (!tempStack.empty() && TokenReader::isOperator(tempStack.top()) &&
                            (
                             (TokenReader::isLeftAssociative(token) && TokenReader::operatorPrecedence(token) == TokenReader::  operatorPrecedence(tempStack.top())) ||
@@ -174,12 +322,18 @@ Expression::Expression(std::string expression)
                 isUnary = true;
                 break;
             case PARENTHESIS_START:
+                if (!tempStack.empty() && multiArgumentFunctions.find(tempStack.top()) != multiArgumentFunctions.end())
+                    calls.emplace(1, multiArgumentFunctions[tempStack.top()]);
+                else
+                    calls.emplace(1, 1);
+                
+                compared.push(false);
                 tempStack.push(token);
                 
                 isUnary = true;
                 break;
             case PARENTHESIS_END:
-                if (tempStack.empty())
+                if (calls.empty())
                     throw InvalidExpression("Parenthesis missmatch", InvalidExpression::PARENTHESIS_MISSMATCH, r.getCurrentPosition() - 1, 1);
                 
                 while (!tempStack.empty() && tempStack.top() != "(")
@@ -190,7 +344,13 @@ Expression::Expression(std::string expression)
                 
                 tempStack.pop(); // Discard '('
                 
-                if (!tempStack.empty() && functions.find(tempStack.top()) != functions.end())
+                if (calls.top().first != calls.top().second)
+                    throw InvalidExpression(tempStack.top() + " takes " + std::to_string(calls.top().second) + " arguments", InvalidExpression::INVALID_ARGUMENT, r.getCurrentPosition() - 1, 1);
+                
+                calls.pop();
+                compared.pop();
+                
+                if (!tempStack.empty() && isFunctionName(tempStack.top()))
                 {
                     outputQueue.push(tempStack.top());
                     tempStack.pop();
@@ -198,6 +358,23 @@ Expression::Expression(std::string expression)
                 
                 isUnary = false;
                 break;
+            case SEPARATOR:
+                if (calls.empty() || calls.top().first == calls.top().second)
+                    throw InvalidExpression("Unexpected ','", InvalidExpression::INVALID_CHARACTER, r.getCurrentPosition() - 1, 1);
+                
+                // Like a binary operator at the lowest precedence, inside the current parenthesis
+                while (tempStack.top() != "(")
+                {
+                    outputQueue.push(tempStack.top());
+                    tempStack.pop();
+                }
+                
+                ++calls.top().first;
+                compared.top() = false;
+                --numOperands;
+                
+                isUnary = true;
+                break;
             case BAD_TOKEN:
                 throw InvalidExpression("Invalid character", InvalidExpression::INVALID_CHARACTER, r.getCurrentPosition() - 1, 1);
                 break;
@@ -225,91 +402,2159 @@ Expression::Expression(std::string expression)
         tempStack.pop();
     }
     
+    long depth = 0;
+    
     while (!outputQueue.empty())
     {
         if (outputQueue.front() == "(")
             throw InvalidExpression("Expected ')'", InvalidExpression::PARENTHESIS_MISSMATCH, 0, expression.length());
         
-        compiledExpression += outputQueue.front() + " ";
+        // A call of a definition takes the argument and leaves the value in its place
+        const bool isCall = definitions.find(outputQueue.front()) != definitions.end();
+        
+        if (isCall && depth < 1)
+            throw InvalidExpression("Operand underflow", InvalidExpression::OPERAND_UNDERFLOW, 0, expression.length());
+        
+        // The integrals of a definition are of its own x
+        if (isCall && !definitions[outputQueue.front()]->integrals.empty() && (program.back().opCode != Instruction::ARGUMENT || operandBegin(program.size()) != program.size() - 1))
+            throw InvalidExpression(outputQueue.front() + " contains integrals and can only be called with " + argument, InvalidExpression::INVALID_ARGUMENT, 0, expression.length());
+        
+        compile(outputQueue.front());
         outputQueue.pop();
+        
+        // A function name without parenthesis, like "if x", leaves too few operands
+        if (!isCall) depth += stackEffect(program.back());
+        
+        if (depth < 1)
+            throw InvalidExpression("Operand underflow", InvalidExpression::OPERAND_UNDERFLOW, 0, expression.length());
     }
+    
+    collectPolynomials();
+    
+    // Inlined definitions may need more stack than their calls show
+    measureStackSize();
+    
+    kind = equation || dependsOnY() ? IMPLICIT : FUNCTION;
+    
+    partition();
 }
 
-real Expression::evaluate() const
+Expression Expression::parseArgument(const std::string &expression, std::string::size_type position, const std::string &argument)
+{
+    try
+    {
+        return Expression(expression, argument);
+    }
+    catch (const InvalidExpression &e)
+    { // Report the position in the whole expression
+        throw InvalidExpression(e.what(), e.getError(), position + e.getPosition(), e.getLength());
+    }
+}
+
+std::vector<std::string> Expression::splitArguments(TokenReader &r, const std::string &expression, std::string::size_type begin, bool parenthesized, std::vector<std::string::size_type> &positions)
 {
-    std::istringstream expressionStream(compiledExpression);
-    std::stack<real> numberStack;
+    std::vector<std::string> arguments;
     std::string token;
+    int depth = 0;
     
-    while (expressionStream >> token)
+    positions.assign(1, r.getCurrentPosition());
+    
+    // Split at top level commas, until the closing parenthesis or the end of the expression
+    while (arguments.size() != positions.size())
     {
-        real number;
-        if (TokenReader::isName(token))
+        TokenType tokenType = r.read(token);
+        
+        if (tokenType == END && parenthesized)
+            throw InvalidExpression("Expected ')'", InvalidExpression::PARENTHESIS_MISSMATCH, begin, expression.length() - begin);
+        
+        if (tokenType == END || ((tokenType == SEPARATOR || (tokenType == PARENTHESIS_END && parenthesized)) && depth == 0))
         {
-            if (variables.find(token) != variables.end())
-            {
-                numberStack.push(variables[token]);
-            }
-            else if (functions.find(token) != functions.end())
-            {
-                real arg = numberStack.top();
-                numberStack.pop();
-                
-                numberStack.push(functions[token](arg));
-            }
-            else
-            {
-                throw EvaluationError("Unkown name: " + token);
-            }
+            std::string::size_type separatorPosition = tokenType == END ? expression.length() : r.getCurrentPosition() - 1;
+            arguments.push_back(expression.substr(positions.back(), separatorPosition - positions.back()));
+            
+            if (tokenType == SEPARATOR) positions.push_back(separatorPosition + 1);
         }
-        else if(TokenReader::isOperator(token))
+        else if (tokenType == PARENTHESIS_START)
         {
-            if (TokenReader::isUnary(token))
-            {
-                real firstOperand = numberStack.top();
-                numberStack.pop();
-                
-                numberStack.push(-firstOperand); // There is only one unary operator
-            }
-            else
-            {
-                real secondOperand = numberStack.top();
-                numberStack.pop();
-                real firstOperand = numberStack.top();
-                numberStack.pop();
-                
-                switch (token[0])
-                {
-                    case '+':
-                        numberStack.push(firstOperand + secondOperand);
-                        break;
-                    case '-':
-                        numberStack.push(firstOperand - secondOperand);
-                        break;
-                    case '*':
-                        numberStack.push(firstOperand * secondOperand);
-                        break;
-                    case '/':
-                        numberStack.push(firstOperand / secondOperand);
-                        break;
-                    case '^':
-                        numberStack.push(real_functions::pow(firstOperand, secondOperand));
-                        break;
-                    default:
-                        throw EvaluationError("Unkown operator: " + token);
-                        break;
-                }
-            }
+            ++depth;
         }
-        else if (real_functions::parseReal(token, number))
+        else if (tokenType == PARENTHESIS_END)
         {
-            numberStack.push(number);
+            --depth;
         }
-        else
+    }
+    
+    return arguments;
+}
+
+bool Expression::parseKind(const std::string &expression)
+{
+    TokenReader r(expression);
+    std::string token;
+    std::vector<std::string> arguments;
+    std::vector<std::string::size_type> positions;
+    std::string parameter;
+    
+    if (parseInequality(expression) || parseDefinition(expression)) return true;
+    
+    TokenType tokenType = r.read(token);
+    
+    if (tokenType == NAME && token == "r")
+    { // r = f(theta), optionally followed by the range of theta
+        if (r.read(token) != OPERATOR || token != "=") return false;
+        
+        arguments = splitArguments(r, expression, 0, false, positions);
+        
+        if (arguments.size() != 1 && arguments.size() != 3)
+            throw InvalidExpression("A polar curve takes r or r, thetaMin, thetaMax", InvalidExpression::INVALID_ARGUMENT, 0, expression.length());
+        
+        kind = POLAR;
+        parameter = "theta";
+    }
+    else if (tokenType == PARENTHESIS_START)
+    { // (x(t), y(t)) or (x(t), y(t), tMin, tMax), anything else in parenthesis is a normal expression
+        arguments = splitArguments(r, expression, 0, true, positions);
+        
+        if (arguments.size() == 1) return false;
+        
+        if (r.read(token) != END)
+            throw InvalidExpression("Unexpected token after parametric curve", InvalidExpression::INVALID_CHARACTER, r.getCurrentPosition() - token.length(), token.length());
+        
+        if (arguments.size() != 2 && arguments.size() != 4)
+            throw InvalidExpression("A parametric curve takes (x, y) or (x, y, tMin, tMax)", InvalidExpression::INVALID_ARGUMENT, 0, expression.length());
+        
+        kind = PARAMETRIC;
+        parameter = "t";
+    }
+    else if (tokenType == NAME && token == "w")
+    { // w = f(z), a complex function
+        if (r.read(token) != OPERATOR || token != "=") return false;
+        
+        std::string::size_type position = r.getCurrentPosition();
+        *this = parseArgument(expression.substr(position), position, "z");
+        
+        if (equation || kind != FUNCTION)
+            throw InvalidExpression("w = f(z) can not contain another '=' or curves", InvalidExpression::INVALID_ARGUMENT, position, expression.length() - position);
+        
+        kind = COMPLEX;
+        
+        return true;
+    }
+    else if (tokenType == NAME && token == "dy")
+    { // dy/dx = f(x, y), the equation is just its right hand side
+        if (r.read(token) != OPERATOR || token != "/" || r.read(token) != NAME || token != "dx" || r.read(token) != OPERATOR || token != "=")
+            return false;
+        
+        std::string::size_type position = r.getCurrentPosition();
+        *this = parseArgument(expression.substr(position), position, "x");
+        
+        if (equation || (kind != FUNCTION && kind != IMPLICIT))
+            throw InvalidExpression("dy/dx = f(x, y) can not contain another '=' or curves", InvalidExpression::INVALID_ARGUMENT, position, expression.length() - position);
+        
+        kind = DIFFERENTIAL;
+        
+        return true;
+    }
+    else if (tokenType == NAME && token == "z")
+    { // z = f(x, y), the surface is just its function
+        if (r.read(token) != OPERATOR || token != "=") return false;
+        
+        std::string::size_type position = r.getCurrentPosition();
+        *this = parseArgument(expression.substr(position), position, "x");
+        
+        if (equation || (kind != FUNCTION && kind != IMPLICIT))
+            throw InvalidExpression("z = f(x, y) can not contain another '=' or curves", InvalidExpression::INVALID_ARGUMENT, position, expression.length() - position);
+        
+        kind = SURFACE;
+        
+        return true;
+    }
+    else
+    {
+        return false;
+    }
+    
+    const std::vector<std::string>::size_type numComponents = kind == PARAMETRIC ? 2 : 1;
+    
+    if (arguments.size() == numComponents)
+    { // One turn
+        arguments.push_back("0");
+        arguments.push_back("2*pi");
+        positions.push_back(expression.length());
+        positions.push_back(expression.length());
+    }
+    
+    for (std::vector<std::string>::size_type i = 0; i != arguments.size(); ++i)
+    {
+        components.push_back(std::make_shared<const Expression>(parseArgument(arguments[i], positions[i], i < numComponents ? parameter : "x")));
+        
+        if (components.back()->getKind() != FUNCTION)
+            throw InvalidExpression("Curves can not contain '=' or other curves", InvalidExpression::INVALID_ARGUMENT, positions[i], arguments[i].length());
+        
+        if (i >= numComponents && components.back()->dependsOnX())
+            throw InvalidExpression("The range of " + parameter + " must be constant", InvalidExpression::INVALID_ARGUMENT, positions[i], arguments[i].length());
+        
+        dependencies.insert(components.back()->dependencies.begin(), components.back()->dependencies.end());
+    }
+    
+    differentiable = false;
+    
+    return true;
+}
+
+bool Expression::parseInequality(const std::string &expression)
+{
+    TokenReader r(expression);
+    std::string token;
+    std::vector<std::string> sides;
+    std::vector<std::string::size_type> positions(1, 0);
+    std::vector<std::string> comparisons;
+    int depth = 0;
+    bool mentionsY = false;
+    
+    // Split at top level comparisons, equations are left to the other kinds
+    for (TokenType tokenType = r.read(token); tokenType != END; tokenType = r.read(token))
+    {
+        if (tokenType == NAME && token == "y")
+        {
+            mentionsY = true;
+        }
+        else if (tokenType == PARENTHESIS_START)
+        {
+            ++depth;
+        }
+        else if (tokenType == PARENTHESIS_END)
+        {
+            --depth;
+        }
+        else if (tokenType == OPERATOR && depth == 0 && token == "=")
+        {
+            return false;
+        }
+        else if (tokenType == OPERATOR && depth == 0 && TokenReader::isComparison(token))
         {
-            throw EvaluationError("Unkown token " + token);
+            std::string::size_type end = r.getCurrentPosition();
+            
+            sides.push_back(expression.substr(positions.back(), end - token.length() - positions.back()));
+            positions.push_back(end);
+            comparisons.push_back(token);
         }
     }
     
-    return numberStack.top();
+    // Comparisons of x alone are functions with the values 0 and 1
+    if (comparisons.empty() || !mentionsY) return false;
+    
+    sides.push_back(expression.substr(positions.back()));
+    
+    if (comparisons.size() > 2)
+        throw InvalidExpression("Only y < f(x), y > f(x) and f(x) < y < g(x) are allowed", InvalidExpression::INVALID_ARGUMENT, 0, expression.length());
+    
+    std::vector<std::string>::size_type ySide = sides.size();
+    for (std::vector<std::string>::size_type i = 0; i != sides.size(); ++i)
+    {
+        TokenReader side(sides[i]);
+        
+        if (side.read(token) == NAME && token == "y" && side.read(token) == END) ySide = i;
+    }
+    
+    if (ySide == sides.size() || (comparisons.size() == 2 && ySide != 1))
+        throw InvalidExpression("y must be alone on one side, or in the middle of two comparisons", InvalidExpression::INVALID_ARGUMENT, 0, expression.length());
+    
+    const bool less = comparisons.front()[0] == '<';
+    
+    if (comparisons.back()[0] != comparisons.front()[0])
+        throw InvalidExpression("Both comparisons must point the same way", InvalidExpression::INVALID_ARGUMENT, 0, expression.length());
+    
+    // components holds the lower and upper bound, either may be missing
+    components.assign(2, nullptr);
+    
+    for (std::vector<std::string>::size_type i = 0; i != sides.size(); ++i)
+    {
+        if (i == ySide) continue;
+        
+        std::shared_ptr<const Expression> bound = std::make_shared<const Expression>(parseArgument(sides[i], positions[i], "x"));
+        
+        if (bound->getKind() != FUNCTION)
+            throw InvalidExpression("The bounds of an inequality must be functions of x", InvalidExpression::INVALID_ARGUMENT, positions[i], sides[i].length());
+        
+        // Sides before y are lower bounds of "<" and upper bounds of ">"
+        components[(i < ySide) == less ? 0 : 1] = bound;
+        dependencies.insert(bound->dependencies.begin(), bound->dependencies.end());
+    }
+    
+    kind = INEQUALITY;
+    differentiable = false;
+    
+    return true;
+}
+
+bool Expression::parseDefinition(const std::string &expression)
+{
+    TokenReader r(expression);
+    std::string definedName;
+    std::string parameter;
+    std::string token;
+    
+    // f(x) = ..., where f is not a built in name. Equations like sin(x) = 0.5 are implicit curves.
+    if (r.read(definedName) != NAME || !isDefinableName(definedName)) return false;
+    
+    if (r.read(token) != PARENTHESIS_START || r.read(parameter) != NAME || r.read(token) != PARENTHESIS_END || r.read(token) != OPERATOR || token != "=")
+        return false;
+    
+    std::string::size_type position = r.getCurrentPosition();
+    
+    if (parameter != "x")
+        throw InvalidExpression("Define functions of x, like " + definedName + "(x) = ...", InvalidExpression::INVALID_ARGUMENT, 0, position);
+    
+    *this = parseArgument(expression.substr(position), position, "x");
+    
+    if (equation || kind != FUNCTION)
+        throw InvalidExpression(definedName + "(x) = ... can not contain y, another '=' or curves", InvalidExpression::INVALID_ARGUMENT, position, expression.length() - position);
+    
+    // Recursion can not be inlined. A definition that calls itself through others still has the old
+    // version of itself inlined, which is found here too.
+    if (calls(definedName))
+        throw InvalidExpression(definedName + " can not call itself", InvalidExpression::INVALID_ARGUMENT, position, expression.length() - position);
+    
+    name = definedName;
+    
+    return true;
+}
+
+bool Expression::isParameterName(const std::string &name)
+{
+    return name.length() == 1 && TokenReader::isName(name) && isDefinableName(name) && !isDefined(name);
+}
+
+bool Expression::isFunctionName(const std::string &token)
+{
+    return functions.find(token) != functions.end() || multiArgumentFunctions.find(token) != multiArgumentFunctions.end() || definitions.find(token) != definitions.end();
+}
+
+bool Expression::isDefinableName(const std::string &token)
+{
+    static const std::set<std::string> reserved = {"x", "y", "z", "r", "w", "t", "theta", "i", "dy", "dx", "integral"};
+    
+    if (reserved.find(token) != reserved.end() || constants.find(token) != constants.end() || variables.find(token) != variables.end())
+        return false;
+    
+    return functions.find(token) == functions.end() && multiArgumentFunctions.find(token) == multiArgumentFunctions.end();
+}
+
+std::string Expression::parseIntegral(TokenReader &r, const std::string &expression)
+{
+    std::string token;
+    std::string::size_type namePosition = r.getCurrentPosition() - 8;
+    
+    if (argument != "x")
+        throw InvalidExpression("integral can only be used in functions of x", InvalidExpression::INVALID_ARGUMENT, namePosition, 8);
+    
+    if (r.read(token) != PARENTHESIS_START)
+        throw InvalidExpression("Expected '('", InvalidExpression::PARENTHESIS_MISSMATCH, namePosition, 8);
+    
+    std::vector<std::string::size_type> argumentPositions;
+    std::vector<std::string> arguments = splitArguments(r, expression, namePosition, true, argumentPositions);
+    
+    if (arguments.size() != 3)
+        throw InvalidExpression("integral takes three arguments", InvalidExpression::INVALID_ARGUMENT, namePosition, r.getCurrentPosition() - namePosition);
+    
+    std::string::size_type first = arguments[2].find_first_not_of(" \t");
+    std::string::size_type last = arguments[2].find_last_not_of(" \t");
+    if (first == std::string::npos || arguments[2].substr(first, last - first + 1) != "x")
+        throw InvalidExpression("The upper limit must be x", InvalidExpression::INVALID_ARGUMENT, argumentPositions[2], arguments[2].length());
+    
+    std::vector<Expression> parsed;
+    for (std::vector<std::string>::size_type i = 0; i != 2; ++i)
+    {
+        parsed.push_back(parseArgument(arguments[i], argumentPositions[i], "x"));
+    }
+    
+    if (parsed[1].dependsOnX())
+        throw InvalidExpression("The lower limit may not depend on x", InvalidExpression::INVALID_ARGUMENT, argumentPositions[1], arguments[1].length());
+    
+    for (std::vector<Expression>::size_type i = 0; i != 2; ++i)
+    {
+        if (parsed[i].getKind() != FUNCTION)
+            throw InvalidExpression("integral can not contain y, '=' or curves", InvalidExpression::INVALID_ARGUMENT, argumentPositions[i], arguments[i].length());
+        
+        dependencies.insert(parsed[i].dependencies.begin(), parsed[i].dependencies.end());
+    }
+    
+    integrals.push_back(std::make_shared<const CumulativeIntegral>(parsed[0], parsed[1]));
+    
+    // Never produced by TokenReader, compile turns it into an INTEGRAL instruction
+    return "$" + std::to_string(integrals.size() - 1);
+}
+
+void Expression::compile(const std::string &token)
+{
+    Instruction instruction = {Instruction::NUMBER, 0, nullptr, nullptr, nullptr, nullptr, 0};
+    
+    if (token[0] == '$')
+    {
+        instruction.opCode = Instruction::INTEGRAL;
+        instruction.index = std::stoul(token.substr(1));
+    }
+    else if (TokenReader::isName(token))
+    {
+        if (definitions.find(token) != definitions.end())
+        {
+            inlineCall(token);
+            
+            return;
+        }
+        else if (constants.find(token) != constants.end())
+        {
+            instruction.number = constants[token];
+        }
+        else if (token == argument)
+        {
+            instruction.opCode = Instruction::ARGUMENT;
+        }
+        else if (token == "y")
+        {
+            instruction.opCode = Instruction::ARGUMENT_Y;
+        }
+        else if (token == "i" && argument == "z")
+        {
+            instruction.opCode = Instruction::IMAGINARY_UNIT;
+        }
+        else if (variables.find(token) != variables.end())
+        {
+            instruction.opCode = Instruction::VARIABLE;
+            instruction.variable = &variables[token];
+        }
+        else if (token == "if")
+        {
+            instruction.opCode = Instruction::SELECT;
+        }
+        else if (token == "min" || token == "max")
+        {
+            instruction.opCode = token == "min" ? Instruction::MINIMUM : Instruction::MAXIMUM;
+        }
+        else if (functions.find(token) != functions.end())
+        {
+            instruction.opCode = Instruction::FUNCTION;
+            instruction.function = functions[token];
+            
+            if (complexFunctions.find(token) != complexFunctions.end())
+                instruction.complexFunction = complexFunctions[token];
+            
+            if (derivatives.find(token) != derivatives.end())
+            {
+                instruction.derivative = derivatives[token];
+            }
+            else
+            {
+                differentiable = false;
+            }
+        }
+    }
+    else if (TokenReader::isOperator(token))
+    {
+        switch (token[0])
+        {
+            case '~':
+                instruction.opCode = Instruction::NEGATE;
+                break;
+            case '+':
+                instruction.opCode = Instruction::ADD;
+                break;
+            case '-':
+            case '=': // lhs = rhs is plotted where lhs - rhs = 0
+                instruction.opCode = Instruction::SUBTRACT;
+                break;
+            case '*':
+                instruction.opCode = Instruction::MULTIPLY;
+                break;
+            case '/':
+                instruction.opCode = Instruction::DIVIDE;
+                break;
+            case '^':
+                instruction.opCode = Instruction::POWER;
+                break;
+            case '<':
+                instruction.opCode = token.length() == 1 ? Instruction::LESS : Instruction::LESS_EQUAL;
+                break;
+            case '>':
+                instruction.opCode = token.length() == 1 ? Instruction::GREATER : Instruction::GREATER_EQUAL;
+                break;
+        }
+    }
+    else
+    {
+        real_functions::parseReal(token, instruction.number);
+    }
+    
+    program.push_back(instruction);
+    
+    if (instruction.opCode == Instruction::SELECT) insertBranch();
+}
+
+void Expression::insertBranch()
+{
+    // The program ends with the condition, both branches and SELECT
+    const std::vector<Instruction>::size_type select = program.size() - 1;
+    const std::vector<Instruction>::size_type elseBegin = operandBegin(select);
+    const std::vector<Instruction>::size_type thenBegin = operandBegin(elseBegin);
+    
+    Instruction branch = {Instruction::BRANCH, 0, nullptr, nullptr, nullptr, nullptr, 0};
+    Instruction otherwise = {Instruction::ELSE, 0, nullptr, nullptr, nullptr, nullptr, 0};
+    
+    // The jumps are relative, so they stay valid when outer branches are inserted around them
+    branch.index = elseBegin + 1 - thenBegin;
+    otherwise.index = select + 1 - elseBegin;
+    
+    program.insert(program.begin() + elseBegin, otherwise);
+    program.insert(program.begin() + thenBegin, branch);
+}
+
+void Expression::inlineCall(const std::string &definitionName)
+{
+    const Expression &definition = *definitions[definitionName];
+    
+    // The argument is the operand at the end of the program, it is copied in place of every ARGUMENT
+    const std::vector<Instruction>::size_type argumentBegin = operandBegin(program.size());
+    const std::vector<Instruction> argumentProgram(program.begin() + argumentBegin, program.end());
+    program.erase(program.begin() + argumentBegin, program.end());
+    
+    // Where each instruction of the definition ends up, relative to the first one
+    std::vector<std::vector<Instruction>::size_type> positions(definition.program.size() + 1, 0);
+    for (std::vector<Instruction>::size_type i = 0; i != definition.program.size(); ++i)
+    {
+        positions[i + 1] = positions[i] + (definition.program[i].opCode == Instruction::ARGUMENT ? argumentProgram.size() : 1);
+    }
+    
+    for (std::vector<Instruction>::size_type i = 0; i != definition.program.size(); ++i)
+    {
+        Instruction instruction = definition.program[i];
+        
+        switch (instruction.opCode)
+        {
+            case Instruction::ARGUMENT:
+                program.insert(program.end(), argumentProgram.begin(), argumentProgram.end());
+                continue;
+            case Instruction::BRANCH:
+            case Instruction::ELSE:
+                instruction.index = positions[i + instruction.index] - positions[i];
+                break;
+            case Instruction::INTEGRAL:
+                instruction.index += integrals.size();
+                break;
+            case Instruction::POLYNOMIAL:
+                instruction.index += polynomials.size();
+                break;
+            default:
+                break;
+        }
+        
+        program.push_back(instruction);
+    }
+    
+    integrals.insert(integrals.end(), definition.integrals.begin(), definition.integrals.end());
+    polynomials.insert(polynomials.end(), definition.polynomials.begin(), definition.polynomials.end());
+    differentiable = differentiable && definition.differentiable;
+    
+    dependencies.insert(definitionName);
+    dependencies.insert(definition.dependencies.begin(), definition.dependencies.end());
+}
+
+void Expression::collectPolynomials()
+{
+    struct Node
+    {
+        std::vector<Instruction>::size_type begin, end;
+        bool polynomial;
+        std::vector<real> coefficients; // Of x^0, x^1, ...
+    };
+    
+    // Expanding products like (x - 1)^5 would lose the precision of the factored form near
+    // their roots, so only sums of terms c * x^k are collected
+    auto isMonomial = [](const Node &node)
+    {
+        return node.polynomial && std::count_if(node.coefficients.begin(), node.coefficients.end(), [](real c) { return c != 0; }) <= 1;
+    };
+    
+    auto dependsOnX = [](const Node &node)
+    {
+        return std::any_of(node.coefficients.begin() + 1, node.coefficients.end(), [](real c) { return c != 0; });
+    };
+    
+    std::vector<Node> operands;
+    std::vector<Node> collected;
+    
+    for (std::vector<Instruction>::size_type pc = 0; pc != program.size(); ++pc)
+    {
+        const Instruction &instruction = program[pc];
+        
+        if (instruction.opCode == Instruction::BRANCH || instruction.opCode == Instruction::ELSE) continue;
+        
+        if (stackEffect(instruction) == 1)
+        {
+            Node node = {pc, pc + 1, instruction.opCode == Instruction::NUMBER || instruction.opCode == Instruction::ARGUMENT, std::vector<real>()};
+            
+            if (instruction.opCode == Instruction::NUMBER) node.coefficients = {instruction.number};
+            if (instruction.opCode == Instruction::ARGUMENT) node.coefficients = {0, 1};
+            
+            operands.push_back(node);
+            continue;
+        }
+        
+        const std::vector<Node>::size_type arity = 1 - stackEffect(instruction);
+        const Node *args = operands.data() + operands.size() - arity;
+        Node node = {args[0].begin, pc + 1, false, std::vector<real>()};
+        
+        bool operandsArePolynomials = true;
+        for (std::vector<Node>::size_type i = 0; i != arity; ++i) operandsArePolynomials = operandsArePolynomials && args[i].polynomial;
+        
+        if (operandsArePolynomials)
+        {
+            const std::vector<real> &a = args[0].coefficients;
+            const std::vector<real> &b = args[arity - 1].coefficients;
+            
+            switch (instruction.opCode)
+            {
+                case Instruction::FUNCTION:
+                    if (!dependsOnX(args[0])) node.coefficients = {instruction.function(a[0])};
+                    break;
+                case Instruction::POLYNOMIAL:
+                    // Inlined from a definition, called with x
+                    if (a == std::vector<real>({0, 1})) node.coefficients = polynomials[instruction.index];
+                    break;
+                case Instruction::NEGATE:
+                    for (real c : a) node.coefficients.push_back(-c);
+                    break;
+                case Instruction::ADD:
+                case Instruction::SUBTRACT:
+                    node.coefficients.assign(std::max(a.size(), b.size()), 0);
+                    for (std::vector<real>::size_type k = 0; k != a.size(); ++k) node.coefficients[k] += a[k];
+                    for (std::vector<real>::size_type k = 0; k != b.size(); ++k) node.coefficients[k] += instruction.opCode == Instruction::ADD ? b[k] : -b[k];
+                    break;
+                case Instruction::MULTIPLY:
+                    if (isMonomial(args[0]) || isMonomial(args[1]))
+                    {
+                        node.coefficients.assign(a.size() + b.size() - 1, 0);
+                        for (std::vector<real>::size_type j = 0; j != a.size(); ++j)
+                        {
+                            for (std::vector<real>::size_type k = 0; k != b.size(); ++k) node.coefficients[j + k] += a[j] * b[k];
+                        }
+                    }
+                    break;
+                case Instruction::DIVIDE:
+                    if (!dependsOnX(args[1]) && b[0] != 0)
+                    {
+                        for (real c : a) node.coefficients.push_back(c / b[0]);
+                    }
+                    break;
+                case Instruction::POWER:
+                {
+                    // (c * x^k)^n is c^n * x^(k * n), for whole n
+                    const real n = b[0];
+                    const std::vector<real>::size_type k = a.size() - 1;
+                    
+                    if (dependsOnX(args[1]) || !isMonomial(args[0]) || n != std::floor(n) || n < 0 || k * n > MAX_POLYNOMIAL_DEGREE) break;
+                    
+                    node.coefficients.assign(static_cast<std::vector<real>::size_type>(k * n) + 1, 0);
+                    node.coefficients.back() = real_functions::pow(a[k], n);
+                    break;
+                }
+                default:
+                    break;
+            }
+            
+            // Without trailing zeros the last coefficient is the one of the highest power
+            while (node.coefficients.size() > 1 && node.coefficients.back() == 0) node.coefficients.pop_back();
+            
+            node.polynomial = !node.coefficients.empty() && node.coefficients.size() <= MAX_POLYNOMIAL_DEGREE + 1;
+        }
+        
+        if (!node.polynomial)
+        {
+            for (std::vector<Node>::size_type i = 0; i != arity; ++i)
+            {
+                if (args[i].polynomial) collected.push_back(args[i]);
+            }
+        }
+        
+        operands.resize(operands.size() - arity);
+        operands.push_back(node);
+    }
+    
+    if (operands.size() == 1 && operands.back().polynomial) collected.push_back(operands.back());
+    
+    // x POLYNOMIAL is two instructions, a lone x or number is left as it is
+    collected.erase(std::remove_if(collected.begin(), collected.end(), [&](const Node &node)
+    {
+        return node.end - node.begin <= 2 || !dependsOnX(node);
+    }), collected.end());
+    
+    if (collected.empty()) return;
+    
+    std::sort(collected.begin(), collected.end(), [](const Node &a, const Node &b) { return a.begin < b.begin; });
+    
+    // Where each instruction ends up, the jumps of if are moved with them
+    std::vector<Instruction> compiled;
+    std::vector<std::vector<Instruction>::size_type> positions(program.size() + 1, 0);
+    std::vector<Node>::size_type next = 0;
+    
+    for (std::vector<Instruction>::size_type pc = 0; pc != program.size(); ++pc)
+    {
+        positions[pc] = compiled.size();
+        
+        if (next != collected.size() && collected[next].begin == pc)
+        {
+            Instruction argument = {Instruction::ARGUMENT, 0, nullptr, nullptr, nullptr, nullptr, 0};
+            Instruction polynomial = {Instruction::POLYNOMIAL, 0, nullptr, nullptr, nullptr, nullptr, polynomials.size()};
+            
+            polynomials.push_back(collected[next].coefficients);
+            
+            compiled.push_back(argument);
+            compiled.push_back(polynomial);
+            
+            pc = collected[next++].end - 1;
+            continue;
+        }
+        
+        compiled.push_back(program[pc]);
+    }
+    positions[program.size()] = compiled.size();
+    
+    for (std::vector<Instruction>::size_type pc = 0; pc != program.size(); ++pc)
+    {
+        if (program[pc].opCode == Instruction::BRANCH || program[pc].opCode == Instruction::ELSE)
+        {
+            compiled[positions[pc]].index = positions[pc + program[pc].index] - positions[pc];
+        }
+    }
+    
+    program = compiled;
+}
+
+void Expression::partition()
+{
+    // Without variables there is nothing to keep apart
+    if (!uses(Instruction::VARIABLE)) return;
+    
+    struct Node
+    {
+        std::vector<Instruction>::size_type begin, end;
+        bool dependsOnX;
+        bool cacheable; // Reads neither variables, y nor integrals
+    };
+    
+    // The operands on the stack while walking the program, and the largest cacheable subtrees
+    std::vector<Node> operands;
+    std::vector<std::pair<std::vector<Instruction>::size_type, std::vector<Instruction>::size_type>> subtrees;
+    
+    for (std::vector<Instruction>::size_type pc = 0; pc != program.size(); ++pc)
+    {
+        const Instruction::OpCode opCode = program[pc].opCode;
+        
+        // The condition and both branches are the operands of SELECT, BRANCH and ELSE lie between them
+        if (opCode == Instruction::BRANCH || opCode == Instruction::ELSE) continue;
+        
+        if (stackEffect(program[pc]) == 1)
+        {
+            operands.push_back({pc, pc + 1, opCode == Instruction::ARGUMENT, opCode == Instruction::NUMBER || opCode == Instruction::ARGUMENT});
+            continue;
+        }
+        
+        const std::vector<Node>::size_type arity = 1 - stackEffect(program[pc]);
+        Node node = {operands[operands.size() - arity].begin, pc + 1, false, true};
+        
+        for (std::vector<Node>::size_type i = operands.size() - arity; i != operands.size(); ++i)
+        {
+            node.dependsOnX = node.dependsOnX || operands[i].dependsOnX;
+            node.cacheable = node.cacheable && operands[i].cacheable;
+        }
+        
+        if (!node.cacheable)
+        {
+            for (std::vector<Node>::size_type i = operands.size() - arity; i != operands.size(); ++i)
+            { // A lone x is as fast to read as a cached value
+                if (operands[i].cacheable && operands[i].dependsOnX && operands[i].end - operands[i].begin > 1)
+                    subtrees.emplace_back(operands[i].begin, operands[i].end);
+            }
+        }
+        
+        operands.resize(operands.size() - arity);
+        operands.push_back(node);
+    }
+    
+    std::sort(subtrees.begin(), subtrees.end());
+    
+    for (const std::pair<std::vector<Instruction>::size_type, std::vector<Instruction>::size_type> &subtree : subtrees)
+    {
+        Expression part(*this);
+        part.program.assign(program.begin() + subtree.first, program.begin() + subtree.second);
+        part.integrals.clear();
+        part.cachedSubtrees.clear();
+        part.components.clear();
+        part.equation = false;
+        part.kind = FUNCTION;
+        part.measureStackSize();
+        
+        cachedSubtrees.push_back({subtree.first, subtree.second, std::make_shared<const GridCache>(part)});
+    }
+}
+
+void Expression::measureStackSize()
+{
+    long depth = 0;
+    stackSize = 0;
+    
+    for (const Instruction &instruction : program)
+    {
+        depth += stackEffect(instruction);
+        
+        if (stackSize < static_cast<std::vector<Instruction>::size_type>(depth)) stackSize = depth;
+    }
+}
+
+std::vector<Expression::Instruction>::size_type Expression::operandBegin(std::vector<Instruction>::size_type end) const
+{
+    // Walking back from the end of an operand, it begins where it has pushed exactly one value.
+    // Missing operands are reported by the constructor.
+    std::vector<Instruction>::size_type begin = end;
+    int pushed = 0;
+    
+    while (begin != 0)
+    {
+        pushed += stackEffect(program[--begin]);
+        
+        if (pushed == 1) break;
+    }
+    
+    return begin;
+}
+
+int Expression::stackEffect(const Instruction &instruction)
+{
+    switch (instruction.opCode)
+    {
+        case Instruction::NUMBER:
+        case Instruction::VARIABLE:
+        case Instruction::ARGUMENT:
+        case Instruction::ARGUMENT_Y:
+        case Instruction::IMAGINARY_UNIT:
+        case Instruction::INTEGRAL:
+            return 1;
+        case Instruction::FUNCTION:
+        case Instruction::POLYNOMIAL:
+        case Instruction::NEGATE:
+        case Instruction::BRANCH:
+        case Instruction::ELSE:
+            return 0;
+        case Instruction::SELECT:
+            return -2;
+        default:
+            return -1;
+    }
+}
+
+real Expression::evaluate() const
+{
+    auto x = variables.find("x");
+    
+    return evaluate(x != variables.end() ? x->second : 0);
+}
+
+real Expression::evaluate(real x) const
+{
+    return evaluate(x, 0);
+}
+
+real Expression::evaluate(real x, real y) const
+{
+    // Most expressions are shallow, only allocate for really deep ones
+    real localStack[32];
+    std::vector<real> heapStack;
+    real *stack = localStack;
+    
+    if (stackSize > 32)
+    {
+        heapStack.resize(stackSize);
+        stack = heapStack.data();
+    }
+    
+    real *top = stack - 1;
+    
+    for (std::vector<Instruction>::size_type pc = 0; pc < program.size(); ++pc)
+    {
+        const Instruction &instruction = program[pc];
+        
+        switch (instruction.opCode)
+        {
+            case Instruction::NUMBER:
+                *++top = instruction.number;
+                break;
+            case Instruction::VARIABLE:
+                *++top = *instruction.variable;
+                break;
+            case Instruction::ARGUMENT:
+                *++top = x;
+                break;
+            case Instruction::ARGUMENT_Y:
+                *++top = y;
+                break;
+            case Instruction::IMAGINARY_UNIT:
+                *++top = NAN;
+                break;
+            case Instruction::INTEGRAL:
+                *++top = integrals[instruction.index]->evaluate(x);
+                break;
+            case Instruction::FUNCTION:
+                *top = instruction.function(*top);
+                break;
+            case Instruction::POLYNOMIAL:
+            {
+                const std::vector<real> &coefficients = polynomials[instruction.index];
+                real value = coefficients.back();
+                
+                for (std::vector<real>::size_type k = coefficients.size() - 1; k-- != 0;) value = value * *top + coefficients[k];
+                
+                *top = value;
+                break;
+            }
+            case Instruction::NEGATE:
+                *top = -*top;
+                break;
+            case Instruction::ADD:
+                --top;
+                *top = *top + top[1];
+                break;
+            case Instruction::SUBTRACT:
+                --top;
+                *top = *top - top[1];
+                break;
+            case Instruction::MULTIPLY:
+                --top;
+                *top = *top * top[1];
+                break;
+            case Instruction::DIVIDE:
+                --top;
+                *top = *top / top[1];
+                break;
+            case Instruction::POWER:
+                --top;
+                *top = real_functions::pow(*top, top[1]);
+                break;
+            case Instruction::LESS:
+                --top;
+                *top = *top < top[1] ? 1 : *top >= top[1] ? 0 : NAN;
+                break;
+            case Instruction::LESS_EQUAL:
+                --top;
+                *top = *top <= top[1] ? 1 : *top > top[1] ? 0 : NAN;
+                break;
+            case Instruction::GREATER:
+                --top;
+                *top = *top > top[1] ? 1 : *top <= top[1] ? 0 : NAN;
+                break;
+            case Instruction::GREATER_EQUAL:
+                --top;
+                *top = *top >= top[1] ? 1 : *top < top[1] ? 0 : NAN;
+                break;
+            case Instruction::MINIMUM:
+                --top;
+                *top = *top < top[1] || std::isnan(*top) ? *top : top[1];
+                break;
+            case Instruction::MAXIMUM:
+                --top;
+                *top = *top > top[1] || std::isnan(*top) ? *top : top[1];
+                break;
+            case Instruction::BRANCH:
+                // Only one branch is evaluated, the other gets an unused slot on the stack
+                if (*top == 0 || std::isnan(*top))
+                {
+                    ++top;
+                    pc += instruction.index;
+                }
+                break;
+            case Instruction::ELSE:
+                // Reached at the end of the then branch, skip the else branch
+                ++top;
+                pc += instruction.index - 1;
+                break;
+            case Instruction::SELECT:
+                top -= 2;
+                *top = std::isnan(*top) ? *top : *top != 0 ? top[1] : top[2];
+                break;
+            default:
+                throw EvaluationError("Unkown instruction");
+                break;
+        }
+    }
+    return *top;
+}
+
+void Expression::evaluate(const real *x, real *result, std::size_t count) const
+{
+    evaluate(x, nullptr, result, count);
+}
+
+void Expression::evaluate(const real *x, const real *y, real *result, std::size_t count) const
+{
+    std::vector<std::vector<real>> integralValues(integrals.size());
+    for (std::vector<std::vector<real>>::size_type i = 0; i != integrals.size(); ++i)
+    {
+        integralValues[i].resize(count);
+        integrals[i]->evaluate(x, integralValues[i].data(), count);
+    }
+    
+    evaluateBlocks(x, y, result, count, integralValues);
+}
+
+void Expression::evaluateGrid(real step, long long first, std::size_t count, real *result) const
+{
+    // The samples of one period are the same as the next, up to rounding
+    const real period = getPeriod();
+    const real periodSteps = std::round(period / step);
+    
+    if (periodSteps >= 1 && periodSteps < count && std::abs(period / step - periodSteps) <= periodSteps * 1e-12L)
+    {
+        const std::size_t length = static_cast<std::size_t>(periodSteps);
+        
+        evaluateGrid(step, first, length, result);
+        
+        for (std::size_t i = length; i != count; ++i)
+        {
+            result[i] = result[i - length];
+        }
+        
+        return;
+    }
+    
+    std::vector<real> x(count);
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        x[i] = (first + static_cast<long long>(i)) * step;
+    }
+    
+    std::vector<std::vector<real>> integralValues(integrals.size());
+    for (std::vector<std::vector<real>>::size_type i = 0; i != integrals.size(); ++i)
+    {
+        integralValues[i].resize(count);
+        integrals[i]->evaluateGrid(step, first, count, integralValues[i].data());
+    }
+    
+    std::vector<std::vector<real>> subtreeValues(cachedSubtrees.size());
+    for (std::vector<CachedSubtree>::size_type i = 0; i != cachedSubtrees.size(); ++i)
+    {
+        subtreeValues[i].resize(count);
+        cachedSubtrees[i].cache->evaluateGrid(step, first, count, subtreeValues[i].data());
+    }
+    
+    evaluateBlocks(x.data(), nullptr, result, count, integralValues, &subtreeValues);
+}
+
+real Expression::getPeriod() const
+{
+    // Walks the program with what is known about every operand instead of its value
+    enum Shape
+    {
+        CONSTANT, // The value does not depend on x
+        LINEAR,   // a * x + b, the value is a
+        PERIODIC, // The value is a period
+        UNKNOWN
+    };
+    
+    struct Operand
+    {
+        Shape shape;
+        real value;
+    };
+    
+    if (program.empty() || uses(Instruction::ARGUMENT_Y) || uses(Instruction::INTEGRAL)) return 0;
+    
+    std::vector<Operand> operands;
+    
+    for (const Instruction &instruction : program)
+    {
+        switch (instruction.opCode)
+        {
+            case Instruction::NUMBER:
+                operands.push_back({CONSTANT, instruction.number});
+                continue;
+            case Instruction::VARIABLE:
+                operands.push_back({CONSTANT, *instruction.variable});
+                continue;
+            case Instruction::ARGUMENT:
+                operands.push_back({LINEAR, 1});
+                continue;
+            case Instruction::BRANCH:
+            case Instruction::ELSE:
+                continue;
+            default:
+                break;
+        }
+        
+        if (stackEffect(instruction) == 1) return 0;
+        
+        const std::vector<Operand>::size_type arity = 1 - stackEffect(instruction);
+        const Operand *args = operands.data() + operands.size() - arity;
+        Operand result = {UNKNOWN, 0};
+        
+        if (instruction.opCode == Instruction::FUNCTION)
+        {
+            const bool periodic = instruction.function == real_functions::sin || instruction.function == real_functions::cos || instruction.function == real_functions::tan;
+            const real basePeriod = instruction.function == real_functions::tan ? constants.at("pi") : 2 * constants.at("pi");
+            
+            if (args[0].shape == CONSTANT) result = {CONSTANT, instruction.function(args[0].value)};
+            else if (args[0].shape == PERIODIC) result = args[0];
+            else if (args[0].shape == LINEAR && periodic) result = {PERIODIC, basePeriod / std::abs(args[0].value)};
+        }
+        else if (instruction.opCode == Instruction::NEGATE)
+        {
+            result = {args[0].shape, args[0].shape == PERIODIC ? args[0].value : -args[0].value};
+        }
+        else if (instruction.opCode == Instruction::POLYNOMIAL)
+        {
+            const std::vector<real> &coefficients = polynomials[instruction.index];
+            
+            if (args[0].shape == CONSTANT) result = {CONSTANT, NAN};
+            else if (args[0].shape == PERIODIC) result = args[0];
+            else if (args[0].shape == LINEAR && coefficients.size() == 2) result = {LINEAR, args[0].value * coefficients[1]};
+        }
+        else if (arity == 2 && args[0].shape == CONSTANT && args[1].shape == CONSTANT)
+        {
+            const real a = args[0].value;
+            const real b = args[1].value;
+            
+            // Only needed as factors of x, the rest of the operations make an unknown constant
+            switch (instruction.opCode)
+            {
+                case Instruction::ADD: result = {CONSTANT, a + b}; break;
+                case Instruction::SUBTRACT: result = {CONSTANT, a - b}; break;
+                case Instruction::MULTIPLY: result = {CONSTANT, a * b}; break;
+                case Instruction::DIVIDE: result = {CONSTANT, a / b}; break;
+                case Instruction::POWER: result = {CONSTANT, real_functions::pow(a, b)}; break;
+                default: result = {CONSTANT, NAN}; break;
+            }
+        }
+        else if (arity == 2 && (args[0].shape == LINEAR || args[1].shape == LINEAR))
+        {
+            const Operand &linear = args[0].shape == LINEAR ? args[0] : args[1];
+            const Operand &other = args[0].shape == LINEAR ? args[1] : args[0];
+            const bool linearFirst = args[0].shape == LINEAR;
+            
+            if (other.shape == CONSTANT)
+            {
+                switch (instruction.opCode)
+                {
+                    case Instruction::ADD: result = linear; break;
+                    case Instruction::SUBTRACT: result = {LINEAR, linearFirst ? linear.value : -linear.value}; break;
+                    case Instruction::MULTIPLY: result = {LINEAR, linear.value * other.value}; break;
+                    case Instruction::DIVIDE: if (linearFirst) result = {LINEAR, linear.value / other.value}; break;
+                    default: break;
+                }
+            }
+            else if (other.shape == LINEAR)
+            {
+                if (instruction.opCode == Instruction::ADD) result = {LINEAR, args[0].value + args[1].value};
+                if (instruction.opCode == Instruction::SUBTRACT) result = {LINEAR, args[0].value - args[1].value};
+            }
+        }
+        else
+        { // Any function of periodic operands and constants, like sin(x) + cos(x) or if(sin(x) < 0, 0, sin(x))
+            result = {CONSTANT, NAN};
+            
+            for (std::vector<Operand>::size_type i = 0; i != arity && result.shape != UNKNOWN; ++i)
+            {
+                if (args[i].shape == PERIODIC)
+                {
+                    result.value = result.shape == PERIODIC ? commonPeriod(result.value, args[i].value) : args[i].value;
+                    result.shape = result.value > 0 ? PERIODIC : UNKNOWN;
+                }
+                else if (args[i].shape != CONSTANT)
+                {
+                    result = {UNKNOWN, 0};
+                }
+            }
+        }
+        
+        // x - x and sin(0 * x) are constant, but not found to be
+        if ((result.shape == LINEAR && !(std::isfinite(result.value) && result.value != 0)) || (result.shape == PERIODIC && !(std::isfinite(result.value) && result.value > 0)))
+            return 0;
+        
+        if (result.shape == UNKNOWN) return 0;
+        
+        operands.resize(operands.size() - arity);
+        operands.push_back(result);
+    }
+    
+    return operands.size() == 1 && operands.back().shape == PERIODIC ? operands.back().value : 0;
+}
+
+real Expression::commonPeriod(real a, real b)
+{
+    // The continued fraction of a / b, until it is p / q within rounding. Then q * a = p * b is a period of both.
+    const real ratio = a / b;
+    real remainder = ratio;
+    long long p = 1, previousP = 0;
+    long long q = 0, previousQ = 1;
+    
+    for (int i = 0; i != 2 * MAX_PERIOD_DENOMINATOR; ++i)
+    {
+        const real term = std::floor(remainder);
+        
+        if (!(term < MAX_PERIOD_DENOMINATOR * MAX_PERIOD_DENOMINATOR)) return 0;
+        
+        long long nextP = static_cast<long long>(term) * p + previousP;
+        long long nextQ = static_cast<long long>(term) * q + previousQ;
+        previousP = p;
+        previousQ = q;
+        p = nextP;
+        q = nextQ;
+        
+        if (q > MAX_PERIOD_DENOMINATOR) return 0;
+        
+        if (std::abs(ratio - static_cast<real>(p) / q) <= ratio * 1e-12L) return q * a;
+        
+        remainder = 1 / (remainder - term);
+    }
+    
+    return 0;
+}
+
+bool Expression::dependsOnX() const
+{
+    return uses(Instruction::ARGUMENT) || uses(Instruction::INTEGRAL);
+}
+
+bool Expression::dependsOnY() const
+{
+    return uses(Instruction::ARGUMENT_Y);
+}
+
+bool Expression::readsVariable(const std::string &variableName) const
+{
+    auto variable = variables.find(variableName);
+    
+    if (variable == variables.end()) return false;
+    
+    for (const Instruction &instruction : program)
+    {
+        if (instruction.opCode == Instruction::VARIABLE && instruction.variable == &variable->second) return true;
+    }
+    
+    for (const std::shared_ptr<const CumulativeIntegral> &integral : integrals)
+    {
+        if (integral->getIntegrand().readsVariable(variableName) || integral->getLowerLimit().readsVariable(variableName)) return true;
+    }
+    
+    // The bounds of inequalities may be missing
+    for (const std::shared_ptr<const Expression> &component : components)
+    {
+        if (component != nullptr && component->readsVariable(variableName)) return true;
+    }
+    
+    return false;
+}
+
+std::vector<std::string> Expression::getVariablesRead() const
+{
+    std::vector<std::string> names;
+    
+    for (const std::pair<const std::string, real> &variable : variables)
+    {
+        if (readsVariable(variable.first)) names.push_back(variable.first);
+    }
+    
+    return names;
+}
+
+const std::string &Expression::getSource() const
+{
+    return source;
+}
+
+const std::string &Expression::getName() const
+{
+    return name;
+}
+
+bool Expression::calls(const std::string &definitionName) const
+{
+    return dependencies.find(definitionName) != dependencies.end();
+}
+
+const std::set<std::string> &Expression::getDependencies() const
+{
+    return dependencies;
+}
+
+Expression Expression::bindVariable(const std::string &variableName, real value) const
+{
+    Expression bound(*this);
+    
+    if (!readsVariable(variableName)) return bound;
+    
+    const real *variable = &variables.find(variableName)->second;
+    
+    // The cached subtrees read no variables and stay shared
+    for (Instruction &instruction : bound.program)
+    {
+        if (instruction.opCode == Instruction::VARIABLE && instruction.variable == variable)
+        {
+            instruction.opCode = Instruction::NUMBER;
+            instruction.number = value;
+            instruction.variable = nullptr;
+        }
+    }
+    
+    for (std::shared_ptr<const CumulativeIntegral> &integral : bound.integrals)
+    {
+        if (integral->getIntegrand().readsVariable(variableName) || integral->getLowerLimit().readsVariable(variableName))
+            integral = std::make_shared<const CumulativeIntegral>(integral->getIntegrand().bindVariable(variableName, value), integral->getLowerLimit().bindVariable(variableName, value));
+    }
+    
+    for (std::shared_ptr<const Expression> &component : bound.components)
+    {
+        if (component != nullptr) component = std::make_shared<const Expression>(component->bindVariable(variableName, value));
+    }
+    
+    return bound;
+}
+
+Expression Expression::bindVariables(const std::string &keptName) const
+{
+    Expression bound(*this);
+    
+    for (const std::string &name : getVariablesRead())
+    {
+        if (name != keptName) bound = bound.bindVariable(name, variables.find(name)->second);
+    }
+    
+    return bound;
+}
+
+Expression::Kind Expression::getKind() const
+{
+    return kind;
+}
+
+std::pair<real, real> Expression::getParameterRange() const
+{
+    return std::pair<real, real>(components[components.size() - 2]->evaluate(), components.back()->evaluate());
+}
+
+void Expression::evaluateBounds(real step, long long first, std::size_t count, real *lower, real *upper) const
+{
+    if (components[0])
+        components[0]->evaluateGrid(step, first, count, lower);
+    else
+        std::fill(lower, lower + count, -std::numeric_limits<real>::infinity());
+    
+    if (components[1])
+        components[1]->evaluateGrid(step, first, count, upper);
+    else
+        std::fill(upper, upper + count, std::numeric_limits<real>::infinity());
+}
+
+void Expression::evaluateCurve(const real *t, real *x, real *y, std::size_t count) const
+{
+    if (kind == PARAMETRIC)
+    {
+        components[0]->evaluate(t, x, count);
+        components[1]->evaluate(t, y, count);
+    }
+    else if (kind == POLAR)
+    {
+        components[0]->evaluate(t, x, count);
+        
+        for (std::size_t i = 0; i != count; ++i)
+        {
+            real r = x[i];
+            x[i] = r * real_functions::cos(t[i]);
+            y[i] = r * real_functions::sin(t[i]);
+        }
+    }
+    else
+    {
+        throw EvaluationError("Not a curve");
+    }
+}
+
+void Expression::evaluateComplex(const real *re, const real *im, real *resultRe, real *resultIm, std::size_t count) const
+{
+    std::vector<real> stackRe(std::max<std::size_t>(stackSize, 1) * BLOCK_SIZE);
+    std::vector<real> stackIm(stackRe.size());
+    
+    for (std::size_t offset = 0; offset < count; offset += BLOCK_SIZE)
+    {
+        const std::size_t n = std::min(BLOCK_SIZE, count - offset);
+        
+        // a and b point to the first sample of the topmost block, the real and imaginary parts
+        real *a = nullptr;
+        real *b = nullptr;
+        
+        for (const Instruction &instruction : program)
+        {
+            switch (instruction.opCode)
+            {
+                case Instruction::NUMBER:
+                case Instruction::VARIABLE:
+                case Instruction::ARGUMENT:
+                case Instruction::ARGUMENT_Y:
+                case Instruction::IMAGINARY_UNIT:
+                case Instruction::INTEGRAL:
+                    a = a != nullptr ? a + BLOCK_SIZE : stackRe.data();
+                    b = b != nullptr ? b + BLOCK_SIZE : stackIm.data();
+                    
+                    if (instruction.opCode == Instruction::ARGUMENT)
+                    {
+                        std::copy(re + offset, re + offset + n, a);
+                        std::copy(im + offset, im + offset + n, b);
+                    }
+                    else if (instruction.opCode == Instruction::NUMBER || instruction.opCode == Instruction::VARIABLE)
+                    {
+                        std::fill(a, a + n, instruction.opCode == Instruction::NUMBER ? instruction.number : *instruction.variable);
+                        std::fill(b, b + n, 0);
+                    }
+                    else if (instruction.opCode == Instruction::IMAGINARY_UNIT)
+                    {
+                        std::fill(a, a + n, 0);
+                        std::fill(b, b + n, 1);
+                    }
+                    else
+                    { // Only in functions of x
+                        std::fill(a, a + n, NAN);
+                        std::fill(b, b + n, NAN);
+                    }
+                    break;
+                case Instruction::FUNCTION:
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        std::complex<real> w = instruction.complexFunction != nullptr ? instruction.complexFunction(std::complex<real>(a[i], b[i])) : std::complex<real>(NAN, NAN);
+                        a[i] = w.real();
+                        b[i] = w.imag();
+                    }
+                    break;
+                case Instruction::POLYNOMIAL:
+                {
+                    const std::vector<real> &coefficients = polynomials[instruction.index];
+                    
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        real valueRe = coefficients.back();
+                        real valueIm = 0;
+                        
+                        for (std::vector<real>::size_type k = coefficients.size() - 1; k-- != 0;)
+                        {
+                            const real re = valueRe * a[i] - valueIm * b[i] + coefficients[k];
+                            valueIm = valueRe * b[i] + valueIm * a[i];
+                            valueRe = re;
+                        }
+                        
+                        a[i] = valueRe;
+                        b[i] = valueIm;
+                    }
+                    break;
+                }
+                case Instruction::NEGATE:
+                    for (std::size_t i = 0; i != n; ++i) a[i] = -a[i];
+                    for (std::size_t i = 0; i != n; ++i) b[i] = -b[i];
+                    break;
+                case Instruction::ADD:
+                    a -= BLOCK_SIZE;
+                    b -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) a[i] += a[BLOCK_SIZE + i];
+                    for (std::size_t i = 0; i != n; ++i) b[i] += b[BLOCK_SIZE + i];
+                    break;
+                case Instruction::SUBTRACT:
+                    a -= BLOCK_SIZE;
+                    b -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) a[i] -= a[BLOCK_SIZE + i];
+                    for (std::size_t i = 0; i != n; ++i) b[i] -= b[BLOCK_SIZE + i];
+                    break;
+                case Instruction::MULTIPLY:
+                    a -= BLOCK_SIZE;
+                    b -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        real c = a[BLOCK_SIZE + i];
+                        real d = b[BLOCK_SIZE + i];
+                        real r = a[i] * c - b[i] * d;
+                        b[i] = a[i] * d + b[i] * c;
+                        a[i] = r;
+                    }
+                    break;
+                case Instruction::DIVIDE:
+                    a -= BLOCK_SIZE;
+                    b -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        real c = a[BLOCK_SIZE + i];
+                        real d = b[BLOCK_SIZE + i];
+                        real denominator = c * c + d * d;
+                        real r = (a[i] * c + b[i] * d) / denominator;
+                        b[i] = (b[i] * c - a[i] * d) / denominator;
+                        a[i] = r;
+                    }
+                    break;
+                case Instruction::POWER:
+                    a -= BLOCK_SIZE;
+                    b -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) complexPower(a[i], b[i], a[BLOCK_SIZE + i], b[BLOCK_SIZE + i]);
+                    break;
+                case Instruction::LESS:
+                case Instruction::LESS_EQUAL:
+                case Instruction::GREATER:
+                case Instruction::GREATER_EQUAL:
+                case Instruction::MINIMUM:
+                case Instruction::MAXIMUM:
+                case Instruction::SELECT:
+                    // Complex numbers are not ordered, both branches of if are evaluated
+                    a -= instruction.opCode == Instruction::SELECT ? 2 * BLOCK_SIZE : BLOCK_SIZE;
+                    b -= instruction.opCode == Instruction::SELECT ? 2 * BLOCK_SIZE : BLOCK_SIZE;
+                    std::fill(a, a + n, NAN);
+                    std::fill(b, b + n, NAN);
+                    break;
+                case Instruction::BRANCH:
+                case Instruction::ELSE:
+                    break;
+                default:
+                    throw EvaluationError("Unkown instruction");
+                    break;
+            }
+        }
+        
+        std::copy(a, a + n, resultRe + offset);
+        std::copy(b, b + n, resultIm + offset);
+    }
+}
+
+void Expression::complexPower(real &re, real &im, real exponentRe, real exponentIm)
+{
+    // Small integer powers like z^2 are by far the most common, multiplying is faster and exact at 0
+    if (exponentIm == 0 && exponentRe == real_functions::floor(exponentRe) && std::abs(exponentRe) <= 64)
+    {
+        long long n = static_cast<long long>(std::abs(exponentRe));
+        real powerRe = 1;
+        real powerIm = 0;
+        
+        for (; n != 0; n /= 2)
+        {
+            if (n % 2 == 1)
+            {
+                real r = powerRe * re - powerIm * im;
+                powerIm = powerRe * im + powerIm * re;
+                powerRe = r;
+            }
+            
+            real r = re * re - im * im;
+            im = 2 * re * im;
+            re = r;
+        }
+        
+        if (exponentRe < 0)
+        {
+            real denominator = powerRe * powerRe + powerIm * powerIm;
+            powerRe /= denominator;
+            powerIm = -powerIm / denominator;
+        }
+        
+        re = powerRe;
+        im = powerIm;
+    }
+    else
+    {
+        std::complex<real> w = std::pow(std::complex<real>(re, im), std::complex<real>(exponentRe, exponentIm));
+        re = w.real();
+        im = w.imag();
+    }
+}
+
+bool Expression::uses(Instruction::OpCode opCode) const
+{
+    for (const Instruction &instruction : program)
+    {
+        if (instruction.opCode == opCode) return true;
+    }
+    
+    return false;
+}
+
+void Expression::evaluateBlocks(const real *x, const real *y, real *result, std::size_t count, const std::vector<std::vector<real>> &integralValues, const std::vector<std::vector<real>> *subtreeValues) const
+{
+    std::vector<real> stack(std::max<std::size_t>(stackSize, 1) * BLOCK_SIZE);
+    
+    // For every BRANCH that continues into its then branch, whether ELSE should skip the else branch
+    std::vector<bool> skipElse;
+    
+    for (std::size_t offset = 0; offset < count; offset += BLOCK_SIZE)
+    {
+        const std::size_t n = std::min(BLOCK_SIZE, count - offset);
+        const real *blockX = x + offset;
+        const real *blockY = y != nullptr ? y + offset : nullptr;
+        
+        // top points to the first sample of the topmost block
+        real *top = nullptr;
+        
+        std::vector<CachedSubtree>::size_type subtree = 0;
+        
+        for (std::vector<Instruction>::size_type pc = 0; pc < program.size(); ++pc)
+        {
+            if (subtreeValues != nullptr)
+            { // The subtrees are sorted, branches that were jumped over may have some
+                while (subtree != cachedSubtrees.size() && cachedSubtrees[subtree].begin < pc) ++subtree;
+                
+                if (subtree != cachedSubtrees.size() && cachedSubtrees[subtree].begin == pc)
+                {
+                    top = top != nullptr ? top + BLOCK_SIZE : stack.data();
+                    std::copy((*subtreeValues)[subtree].begin() + offset, (*subtreeValues)[subtree].begin() + offset + n, top);
+                    
+                    pc = cachedSubtrees[subtree].end - 1;
+                    continue;
+                }
+            }
+            
+            const Instruction &instruction = program[pc];
+            
+            switch (instruction.opCode)
+            {
+                case Instruction::NUMBER:
+                case Instruction::VARIABLE:
+                case Instruction::ARGUMENT:
+                    top = top != nullptr ? top + BLOCK_SIZE : stack.data();
+                    
+                    if (instruction.opCode == Instruction::ARGUMENT)
+                        std::copy(blockX, blockX + n, top);
+                    else
+                        std::fill(top, top + n, instruction.opCode == Instruction::NUMBER ? instruction.number : *instruction.variable);
+                    break;
+                case Instruction::ARGUMENT_Y:
+                    top = top != nullptr ? top + BLOCK_SIZE : stack.data();
+                    
+                    if (blockY != nullptr)
+                        std::copy(blockY, blockY + n, top);
+                    else
+                        std::fill(top, top + n, 0);
+                    break;
+                case Instruction::INTEGRAL:
+                    top = top != nullptr ? top + BLOCK_SIZE : stack.data();
+                    std::copy(integralValues[instruction.index].begin() + offset, integralValues[instruction.index].begin() + offset + n, top);
+                    break;
+                case Instruction::IMAGINARY_UNIT:
+                    top = top != nullptr ? top + BLOCK_SIZE : stack.data();
+                    std::fill(top, top + n, NAN);
+                    break;
+                case Instruction::FUNCTION:
+                    for (std::size_t i = 0; i != n; ++i) top[i] = instruction.function(top[i]);
+                    break;
+                case Instruction::POLYNOMIAL:
+                {
+                    // Horner's scheme, one coefficient at a time over the whole block
+                    const std::vector<real> &coefficients = polynomials[instruction.index];
+                    real values[BLOCK_SIZE];
+                    
+                    std::fill(values, values + n, coefficients.back());
+                    
+                    for (std::vector<real>::size_type k = coefficients.size() - 1; k-- != 0;)
+                    {
+                        for (std::size_t i = 0; i != n; ++i) values[i] = values[i] * top[i] + coefficients[k];
+                    }
+                    
+                    std::copy(values, values + n, top);
+                    break;
+                }
+                case Instruction::NEGATE:
+                    for (std::size_t i = 0; i != n; ++i) top[i] = -top[i];
+                    break;
+                case Instruction::ADD:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] += top[BLOCK_SIZE + i];
+                    break;
+                case Instruction::SUBTRACT:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] -= top[BLOCK_SIZE + i];
+                    break;
+                case Instruction::MULTIPLY:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] *= top[BLOCK_SIZE + i];
+                    break;
+                case Instruction::DIVIDE:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] /= top[BLOCK_SIZE + i];
+                    break;
+                case Instruction::POWER:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] = real_functions::pow(top[i], top[BLOCK_SIZE + i]);
+                    break;
+                case Instruction::LESS:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] = top[i] < top[BLOCK_SIZE + i] ? 1 : top[i] >= top[BLOCK_SIZE + i] ? 0 : NAN;
+                    break;
+                case Instruction::LESS_EQUAL:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] = top[i] <= top[BLOCK_SIZE + i] ? 1 : top[i] > top[BLOCK_SIZE + i] ? 0 : NAN;
+                    break;
+                case Instruction::GREATER:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] = top[i] > top[BLOCK_SIZE + i] ? 1 : top[i] <= top[BLOCK_SIZE + i] ? 0 : NAN;
+                    break;
+                case Instruction::GREATER_EQUAL:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] = top[i] >= top[BLOCK_SIZE + i] ? 1 : top[i] < top[BLOCK_SIZE + i] ? 0 : NAN;
+                    break;
+                case Instruction::MINIMUM:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] = top[i] < top[BLOCK_SIZE + i] || std::isnan(top[i]) ? top[i] : top[BLOCK_SIZE + i];
+                    break;
+                case Instruction::MAXIMUM:
+                    top -= BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i) top[i] = top[i] > top[BLOCK_SIZE + i] || std::isnan(top[i]) ? top[i] : top[BLOCK_SIZE + i];
+                    break;
+                case Instruction::BRANCH:
+                {
+                    // A branch that no sample in the block takes is skipped and gets an unused block
+                    // on the stack, otherwise both are evaluated and SELECT blends them
+                    bool anyThen = false;
+                    bool anyElse = false;
+                    
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        bool then = top[i] != 0 && !std::isnan(top[i]);
+                        anyThen = anyThen || then;
+                        anyElse = anyElse || !then;
+                    }
+                    
+                    if (!anyThen)
+                    {
+                        top += BLOCK_SIZE;
+                        pc += instruction.index;
+                    }
+                    else
+                    {
+                        skipElse.push_back(!anyElse);
+                    }
+                    break;
+                }
+                case Instruction::ELSE:
+                    if (skipElse.back())
+                    {
+                        top += BLOCK_SIZE;
+                        pc += instruction.index - 1;
+                    }
+                    
+                    skipElse.pop_back();
+                    break;
+                case Instruction::SELECT:
+                    top -= 2 * BLOCK_SIZE;
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        real condition = top[i];
+                        top[i] = std::isnan(condition) ? condition : condition != 0 ? top[BLOCK_SIZE + i] : top[2 * BLOCK_SIZE + i];
+                    }
+                    break;
+                default:
+                    throw EvaluationError("Unkown instruction");
+                    break;
+            }
+        }
+        
+        std::copy(top, top + n, result + offset);
+    }
+}
+
+bool Expression::isDifferentiable() const
+{
+    return differentiable;
+}
+
+std::pair<real, real> Expression::evaluateDerivative(real x) const
+{
+    if (!differentiable)
+    {
+        throw EvaluationError("Expression has no known derivative");
+    }
+    
+    // Forward mode, every stack entry is a pair (value, derivative)
+    std::vector<std::pair<real, real>> stack;
+    stack.reserve(stackSize);
+    
+    for (const Instruction &instruction : program)
+    {
+        switch (instruction.opCode)
+        {
+            case Instruction::NUMBER:
+                stack.emplace_back(instruction.number, 0);
+                break;
+            case Instruction::VARIABLE:
+                stack.emplace_back(*instruction.variable, 0);
+                break;
+            case Instruction::ARGUMENT:
+                stack.emplace_back(x, 1);
+                break;
+            case Instruction::ARGUMENT_Y:
+                stack.emplace_back(0, 0);
+                break;
+            case Instruction::IMAGINARY_UNIT:
+                stack.emplace_back(NAN, NAN);
+                break;
+            case Instruction::INTEGRAL:
+                // d/dx of integral(f, a, x) is f(x)
+                stack.emplace_back(integrals[instruction.index]->evaluate(x), integrals[instruction.index]->getIntegrand().evaluate(x));
+                break;
+            case Instruction::FUNCTION:
+                stack.back().second *= instruction.derivative(stack.back().first);
+                stack.back().first = instruction.function(stack.back().first);
+                break;
+            case Instruction::POLYNOMIAL:
+            {
+                // p'(u) is found by the same Horner steps as p(u)
+                const std::vector<real> &coefficients = polynomials[instruction.index];
+                const real u = stack.back().first;
+                real value = coefficients.back();
+                real slope = 0;
+                
+                for (std::vector<real>::size_type k = coefficients.size() - 1; k-- != 0;)
+                {
+                    slope = slope * u + value;
+                    value = value * u + coefficients[k];
+                }
+                
+                stack.back().first = value;
+                stack.back().second *= slope;
+                break;
+            }
+            case Instruction::NEGATE:
+                stack.back().first = -stack.back().first;
+                stack.back().second = -stack.back().second;
+                break;
+            case Instruction::BRANCH:
+            case Instruction::ELSE:
+                // Both branches are evaluated
+                break;
+            case Instruction::SELECT:
+            {
+                std::pair<real, real> otherwise = stack.back();
+                stack.pop_back();
+                std::pair<real, real> then = stack.back();
+                stack.pop_back();
+                
+                real condition = stack.back().first;
+                stack.back() = std::isnan(condition) ? std::make_pair(condition, condition) : condition != 0 ? then : otherwise;
+                break;
+            }
+            default:
+            {
+                std::pair<real, real> b = stack.back();
+                stack.pop_back();
+                std::pair<real, real> &a = stack.back();
+                
+                switch (instruction.opCode)
+                {
+                    case Instruction::ADD:
+                        a = std::make_pair(a.first + b.first, a.second + b.second);
+                        break;
+                    case Instruction::SUBTRACT:
+                        a = std::make_pair(a.first - b.first, a.second - b.second);
+                        break;
+                    case Instruction::MULTIPLY:
+                        a = std::make_pair(a.first * b.first, a.second * b.first + a.first * b.second);
+                        break;
+                    case Instruction::DIVIDE:
+                        a = std::make_pair(a.first / b.first, (a.second * b.first - a.first * b.second) / (b.first * b.first));
+                        break;
+                    case Instruction::LESS:
+                    case Instruction::LESS_EQUAL:
+                    case Instruction::GREATER:
+                    case Instruction::GREATER_EQUAL:
+                    {
+                        // Piecewise constant, the jump itself is ignored
+                        real value = instruction.opCode == Instruction::LESS ? (a.first < b.first) :
+                                     instruction.opCode == Instruction::LESS_EQUAL ? (a.first <= b.first) :
+                                     instruction.opCode == Instruction::GREATER ? (a.first > b.first) : (a.first >= b.first);
+                        
+                        a = std::isnan(a.first) || std::isnan(b.first) ? std::pair<real, real>(NAN, NAN) : std::pair<real, real>(value, 0);
+                        break;
+                    }
+                    case Instruction::MINIMUM:
+                        if (!(a.first < b.first || std::isnan(a.first))) a = b;
+                        break;
+                    case Instruction::MAXIMUM:
+                        if (!(a.first > b.first || std::isnan(a.first))) a = b;
+                        break;
+                    case Instruction::POWER:
+                    {
+                        real value = real_functions::pow(a.first, b.first);
+                        real derivative = b.first * real_functions::pow(a.first, b.first - 1) * a.second;
+                        
+                        // The logarithm term vanishes for constant exponents, skip it to allow negative bases
+                        if (b.second != 0) derivative += value * real_functions::ln(a.first) * b.second;
+                        
+                        a = std::make_pair(value, derivative);
+                        break;
+                    }
+                    default:
+                        throw EvaluationError("Unkown instruction");
+                        break;
+                }
+                break;
+            }
+        }
+    }
+    return stack.back();
+}
+
+void Expression::evaluateGradient(const real *x, real *result, real *gradient, std::size_t count, const std::vector<std::string> &names) const
+{
+    if (!differentiable)
+    {
+        throw EvaluationError("Expression has no known derivative");
+    }
+    
+    const std::size_t numNames = names.size();
+    
+    std::vector<const real *> seeds(numNames, nullptr);
+    for (std::size_t k = 0; k != numNames; ++k)
+    {
+        auto variable = variables.find(names[k]);
+        if (variable != variables.end()) seeds[k] = &variable->second;
+    }
+    
+    // Integrals are only differentiated along x
+    std::vector<std::vector<real>> integralValues(integrals.size());
+    std::vector<std::vector<bool>> integralReads(integrals.size(), std::vector<bool>(numNames));
+    for (std::vector<std::vector<real>>::size_type i = 0; i != integrals.size(); ++i)
+    {
+        integralValues[i].resize(count);
+        integrals[i]->evaluate(x, integralValues[i].data(), count);
+        
+        for (std::size_t k = 0; k != numNames; ++k)
+        {
+            integralReads[i][k] = integrals[i]->getIntegrand().readsVariable(names[k]) || integrals[i]->getLowerLimit().readsVariable(names[k]);
+        }
+    }
+    
+    // Every stack entry is a block of values followed by a block of partial derivatives per name
+    const std::size_t entrySize = (numNames + 1) * BLOCK_SIZE;
+    std::vector<real> stack(std::max<std::size_t>(stackSize, 1) * entrySize);
+    real scratch[BLOCK_SIZE];
+    
+    for (std::size_t offset = 0; offset < count; offset += BLOCK_SIZE)
+    {
+        const std::size_t n = std::min(BLOCK_SIZE, count - offset);
+        
+        // top points to the values of the topmost entry
+        real *top = nullptr;
+        
+        for (const Instruction &instruction : program)
+        {
+            switch (instruction.opCode)
+            {
+                case Instruction::NUMBER:
+                case Instruction::VARIABLE:
+                case Instruction::ARGUMENT:
+                case Instruction::ARGUMENT_Y:
+                case Instruction::IMAGINARY_UNIT:
+                case Instruction::INTEGRAL:
+                    top = top != nullptr ? top + entrySize : stack.data();
+                    
+                    if (instruction.opCode == Instruction::ARGUMENT)
+                        std::copy(x + offset, x + offset + n, top);
+                    else if (instruction.opCode == Instruction::INTEGRAL)
+                        std::copy(integralValues[instruction.index].begin() + offset, integralValues[instruction.index].begin() + offset + n, top);
+                    else
+                        std::fill(top, top + n, instruction.opCode == Instruction::NUMBER ? instruction.number :
+                                                instruction.opCode == Instruction::VARIABLE ? *instruction.variable :
+                                                instruction.opCode == Instruction::IMAGINARY_UNIT ? NAN : 0);
+                    
+                    for (std::size_t k = 0; k != numNames; ++k)
+                    {
+                        real tangent = 0;
+                        
+                        if (instruction.opCode == Instruction::VARIABLE && instruction.variable == seeds[k]) tangent = 1;
+                        else if (instruction.opCode == Instruction::IMAGINARY_UNIT) tangent = NAN;
+                        else if (instruction.opCode == Instruction::INTEGRAL && integralReads[instruction.index][k]) tangent = NAN;
+                        
+                        std::fill(top + (k + 1) * BLOCK_SIZE, top + (k + 1) * BLOCK_SIZE + n, tangent);
+                    }
+                    break;
+                case Instruction::FUNCTION:
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        scratch[i] = instruction.derivative(top[i]);
+                        top[i] = instruction.function(top[i]);
+                    }
+                    
+                    for (std::size_t k = 1; k <= numNames; ++k)
+                    {
+                        real *tangent = top + k * BLOCK_SIZE;
+                        for (std::size_t i = 0; i != n; ++i) tangent[i] *= scratch[i];
+                    }
+                    break;
+                case Instruction::POLYNOMIAL:
+                {
+                    const std::vector<real> &coefficients = polynomials[instruction.index];
+                    
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        const real u = top[i];
+                        real value = coefficients.back();
+                        real slope = 0;
+                        
+                        for (std::vector<real>::size_type k = coefficients.size() - 1; k-- != 0;)
+                        {
+                            slope = slope * u + value;
+                            value = value * u + coefficients[k];
+                        }
+                        
+                        top[i] = value;
+                        scratch[i] = slope;
+                    }
+                    
+                    for (std::size_t k = 1; k <= numNames; ++k)
+                    {
+                        real *tangent = top + k * BLOCK_SIZE;
+                        for (std::size_t i = 0; i != n; ++i) tangent[i] *= scratch[i];
+                    }
+                    break;
+                }
+                case Instruction::NEGATE:
+                    for (std::size_t k = 0; k <= numNames; ++k)
+                    {
+                        real *component = top + k * BLOCK_SIZE;
+                        for (std::size_t i = 0; i != n; ++i) component[i] = -component[i];
+                    }
+                    break;
+                case Instruction::BRANCH:
+                case Instruction::ELSE:
+                    // Both branches are evaluated
+                    break;
+                case Instruction::SELECT:
+                {
+                    const real *otherwise = top;
+                    const real *then = top - entrySize;
+                    top -= 2 * entrySize;
+                    
+                    for (std::size_t i = 0; i != n; ++i)
+                    {
+                        const real condition = top[i];
+                        const real *chosen = condition != 0 ? then : otherwise;
+                        
+                        for (std::size_t k = 0; k <= numNames; ++k)
+                        {
+                            top[k * BLOCK_SIZE + i] = std::isnan(condition) ? condition : chosen[k * BLOCK_SIZE + i];
+                        }
+                    }
+                    break;
+                }
+                default:
+                {
+                    const real *b = top;
+                    real *a = top - entrySize;
+                    top = a;
+                    
+                    switch (instruction.opCode)
+                    {
+                        case Instruction::ADD:
+                        case Instruction::SUBTRACT:
+                            for (std::size_t k = 0; k <= numNames; ++k)
+                            {
+                                real *u = a + k * BLOCK_SIZE;
+                                const real *v = b + k * BLOCK_SIZE;
+                                
+                                if (instruction.opCode == Instruction::ADD)
+                                    for (std::size_t i = 0; i != n; ++i) u[i] += v[i];
+                                else
+                                    for (std::size_t i = 0; i != n; ++i) u[i] -= v[i];
+                            }
+                            break;
+                        case Instruction::MULTIPLY:
+                            // The tangents first, they need the values of both factors
+                            for (std::size_t k = 1; k <= numNames; ++k)
+                            {
+                                real *u = a + k * BLOCK_SIZE;
+                                const real *v = b + k * BLOCK_SIZE;
+                                for (std::size_t i = 0; i != n; ++i) u[i] = u[i] * b[i] + a[i] * v[i];
+                            }
+                            
+                            for (std::size_t i = 0; i != n; ++i) a[i] *= b[i];
+                            break;
+                        case Instruction::DIVIDE:
+                            for (std::size_t k = 1; k <= numNames; ++k)
+                            {
+                                real *u = a + k * BLOCK_SIZE;
+                                const real *v = b + k * BLOCK_SIZE;
+                                for (std::size_t i = 0; i != n; ++i) u[i] = (u[i] * b[i] - a[i] * v[i]) / (b[i] * b[i]);
+                            }
+                            
+                            for (std::size_t i = 0; i != n; ++i) a[i] /= b[i];
+                            break;
+                        case Instruction::LESS:
+                        case Instruction::LESS_EQUAL:
+                        case Instruction::GREATER:
+                        case Instruction::GREATER_EQUAL:
+                            // Piecewise constant, the jump itself is ignored
+                            for (std::size_t i = 0; i != n; ++i)
+                            {
+                                const bool undefined = std::isnan(a[i]) || std::isnan(b[i]);
+                                
+                                a[i] = undefined ? NAN :
+                                       instruction.opCode == Instruction::LESS ? (a[i] < b[i]) :
+                                       instruction.opCode == Instruction::LESS_EQUAL ? (a[i] <= b[i]) :
+                                       instruction.opCode == Instruction::GREATER ? (a[i] > b[i]) : (a[i] >= b[i]);
+                                
+                                for (std::size_t k = 1; k <= numNames; ++k) a[k * BLOCK_SIZE + i] = undefined ? NAN : 0;
+                            }
+                            break;
+                        case Instruction::MINIMUM:
+                        case Instruction::MAXIMUM:
+                            for (std::size_t i = 0; i != n; ++i)
+                            {
+                                const bool keep = std::isnan(a[i]) || (instruction.opCode == Instruction::MINIMUM ? a[i] < b[i] : a[i] > b[i]);
+                                
+                                if (keep) continue;
+                                
+                                for (std::size_t k = 0; k <= numNames; ++k) a[k * BLOCK_SIZE + i] = b[k * BLOCK_SIZE + i];
+                            }
+                            break;
+                        case Instruction::POWER:
+                            for (std::size_t i = 0; i != n; ++i)
+                            {
+                                const real value = real_functions::pow(a[i], b[i]);
+                                const real slope = b[i] * real_functions::pow(a[i], b[i] - 1);
+                                
+                                // The logarithm term vanishes for constant exponents, skip it to allow negative bases
+                                real logarithm = NAN;
+                                
+                                for (std::size_t k = 1; k <= numNames; ++k)
+                                {
+                                    real &u = a[k * BLOCK_SIZE + i];
+                                    const real v = b[k * BLOCK_SIZE + i];
+                                    
+                                    u *= slope;
+                                    
+                                    if (v != 0)
+                                    {
+                                        if (std::isnan(logarithm)) logarithm = real_functions::ln(a[i]);
+                                        u += value * logarithm * v;
+                                    }
+                                }
+                                
+                                a[i] = value;
+                            }
+                            break;
+                        default:
+                            throw EvaluationError("Unkown instruction");
+                            break;
+                    }
+                    break;
+                }
+            }
+        }
+        
+        std::copy(top, top + n, result + offset);
+        
+        for (std::size_t i = 0; i != n; ++i)
+        {
+            for (std::size_t k = 0; k != numNames; ++k)
+            {
+                gradient[(offset + i) * numNames + k] = top[(k + 1) * BLOCK_SIZE + i];
+            }
+        }
+    }
 }
@@ -11,9 +11,20 @@
 
 #include "real.h"
 
+#include <cstddef>
+#include <complex>
 #include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <atomic>
 #include <stdexcept>
 
+class TokenReader;
+class CumulativeIntegral;
+class GridCache;
+
 class InvalidExpression : public std::invalid_argument
 {
 public:
@@ -26,7 +37,8 @@ public:
         PARENTHESIS_MISSMATCH,
         INVALID_CHARACTER,
         OPERAND_UNDERFLOW,
-        OPERAND_OVERFLOW
+        OPERAND_OVERFLOW,
+        INVALID_ARGUMENT
     };
     
     InvalidExpression(const std::string &_what_arg, ErrorType _errorType, size_type _position, size_type _length);
@@ -49,22 +61,237 @@ public:
 
 class Expression
 {
+public:
+    enum Kind
+    {
+        FUNCTION,     // y = f(x)
+        IMPLICIT,     // f(x, y) = 0
+        PARAMETRIC,   // (x(t), y(t))
+        POLAR,        // r = f(theta)
+        SURFACE,      // z = f(x, y)
+        COMPLEX,      // w = f(z)
+        DIFFERENTIAL, // dy/dx = f(x, y)
+        INEQUALITY    // y < f(x), f(x) < y < g(x)
+    };
+    
+private:
+    struct Instruction
+    {
+        enum OpCode
+        {
+            NUMBER,
+            VARIABLE,
+            ARGUMENT,
+            ARGUMENT_Y,
+            IMAGINARY_UNIT,
+            FUNCTION,
+            NEGATE,
+            ADD,
+            SUBTRACT,
+            MULTIPLY,
+            DIVIDE,
+            POWER,
+            LESS,
+            LESS_EQUAL,
+            GREATER,
+            GREATER_EQUAL,
+            MINIMUM,
+            MAXIMUM,
+            BRANCH,
+            ELSE,
+            SELECT,
+            INTEGRAL,
+            POLYNOMIAL
+        };
+        
+        OpCode opCode;
+        real number;
+        const real *variable;
+        real (*function)(real);
+        real (*derivative)(real);
+        std::complex<real> (*complexFunction)(std::complex<real>);
+        std::size_t index; // Into integrals or polynomials, or the distance to jump from BRANCH to ELSE and from ELSE to SELECT
+    };
+    
     static std::map<std::string, const real> constants;
     static std::map<std::string, real> variables;
     static std::map<std::string, real (*)(real)> functions;
+    static std::map<std::string, real (*)(real)> derivatives;
+    static std::map<std::string, std::complex<real> (*)(std::complex<real>)> complexFunctions;
+    static std::map<std::string, std::size_t> multiArgumentFunctions; // if, min and max, with their number of arguments
+    static std::map<std::string, std::shared_ptr<const Expression>> definitions; // f(x) = ..., inlined where they are called
+    static std::atomic<unsigned long> variablesVersion;
+    
+    // Number of samples evaluated per instruction in batch evaluation
+    static const std::size_t BLOCK_SIZE = 64;
+    
+    // Periods are only combined when their ratio is a fraction with at most this denominator
+    static const int MAX_PERIOD_DENOMINATOR = 64;
+    
+    // Higher powers are left to pow
+    static const int MAX_POLYNOMIAL_DEGREE = 32;
     
-    std::string compiledExpression;
+    // Reverse polish program, the variables x and y are read from the arguments. if(c, a, b) is
+    // compiled to c BRANCH a ELSE b SELECT, so evaluation can jump over a branch that is not taken.
+    std::vector<Instruction> program;
+    std::vector<Instruction>::size_type stackSize;
+    bool differentiable;
+    bool equation;
+    Kind kind;
+    
+    // Name of the variable read by ARGUMENT instructions, t and theta in the components of curves
+    std::string argument;
+    
+    // integral(f, a, x) constructs, shared between copies together with their caches
+    std::vector<std::shared_ptr<const CumulativeIntegral>> integrals;
+    
+    // Coefficients of x^0, x^1, ... of polynomials written out as sums of terms, like 3*x^4 - 2*x^3 + x - 7.
+    // They are compiled to x POLYNOMIAL and evaluated with Horner's scheme, the operand is x or the argument
+    // of an inlined definition.
+    std::vector<std::vector<real>> polynomials;
+    
+    // Subtrees of the program that depend on x but not on variables, like sin(x) in a*sin(x) + b. Their
+    // values on the sample grid are cached, so setting a variable only evaluates the rest of the program.
+    struct CachedSubtree
+    {
+        std::vector<Instruction>::size_type begin, end;
+        std::shared_ptr<const GridCache> cache;
+    };
+    
+    std::vector<CachedSubtree> cachedSubtrees;
+    
+    // Curves have no program of their own: (x(t), y(t), tMin, tMax) or (r(theta), thetaMin, thetaMax).
+    // Neither have inequalities: (lower bound, upper bound), where a missing bound is null.
+    std::vector<std::shared_ptr<const Expression>> components;
+    
+    // The text as written, f for the definition f(x) = ..., and the definitions inlined into the program,
+    // also those called by them
+    std::string source;
+    std::string name;
+    std::set<std::string> dependencies;
+    
+    Expression(const std::string &expression, const std::string &_argument, bool topLevel = false);
+    static Expression parseArgument(const std::string &expression, std::string::size_type position, const std::string &argument);
+    static std::vector<std::string> splitArguments(TokenReader &r, const std::string &expression, std::string::size_type begin, bool parenthesized, std::vector<std::string::size_type> &positions);
+    bool parseKind(const std::string &expression);
+    bool parseInequality(const std::string &expression);
+    bool parseDefinition(const std::string &expression);
+    static bool isFunctionName(const std::string &token);
+    static bool isDefinableName(const std::string &token);
+    std::string parseIntegral(TokenReader &r, const std::string &expression);
+    void compile(const std::string &token);
+    void insertBranch();
+    void inlineCall(const std::string &definitionName);
+    void collectPolynomials();
+    void partition();
+    void measureStackSize();
+    std::vector<Instruction>::size_type operandBegin(std::vector<Instruction>::size_type end) const;
+    static int stackEffect(const Instruction &instruction);
+    static real commonPeriod(real a, real b);
+    void evaluateBlocks(const real *x, const real *y, real *result, std::size_t count, const std::vector<std::vector<real>> &integralValues, const std::vector<std::vector<real>> *subtreeValues = nullptr) const;
+    static void complexPower(real &re, real &im, real exponentRe, real exponentIm);
+    bool uses(Instruction::OpCode opCode) const;
     
 public:
     static bool addVariable(std::string name, real initialValue);
     static bool setVariable(std::string name, real value);
-    static void addFunction(std::string name, real (*)(real));
+    
+    // NaN if there is no variable with the name
+    static real getVariable(const std::string &name);
+    static void addFunction(std::string name, real (*)(real), real (*derivative)(real) = nullptr);
+    
+    // Makes a definition f(x) = ... callable from the expressions parsed after it, which get a
+    // copy of its program in place of every call. Expressions parsed earlier are not changed.
+    static void define(const Expression &definition);
+    static void undefine(const std::string &name);
+    static bool isDefined(const std::string &name);
+    
+    // Single letters that are not taken, for new variables
+    static bool isParameterName(const std::string &name);
+    
+    // Increased every time a variable is set, cached values depending on variables compare it
+    static unsigned long getVariablesVersion();
     
     // May throw InvalidExpression
     Expression(std::string expression);
     
     // May throw EvaluationError. However this indicates an error in the constructor
     real evaluate() const;
+    
+    // Does not touch the variables x and y, so several threads may evaluate the same expression
+    real evaluate(real x) const;
+    real evaluate(real x, real y) const;
+    
+    // Batch evaluation, result[i] = f(x[i]). Each instruction runs over a block of samples at a time
+    void evaluate(const real *x, real *result, std::size_t count) const;
+    void evaluate(const real *x, const real *y, real *result, std::size_t count) const;
+    
+    // Batch evaluation at x = (first + i) * step, grid aligned values can be cached between calls.
+    // If the period is a whole number of steps, only the first period is evaluated.
+    void evaluateGrid(real step, long long first, std::size_t count, real *result) const;
+    
+    // A period of f(x) that follows from the program, where sin, cos and tan have linear arguments
+    // and the ratios of their frequencies are fractions. Depends on the current values of the
+    // variables, 0 if no period could be proven.
+    real getPeriod() const;
+    
+    bool dependsOnX() const;
+    bool dependsOnY() const;
+    
+    // Also through integrals and the components of curves and inequalities
+    bool readsVariable(const std::string &name) const;
+    
+    // The names of the variables it reads, the parameters that can be fitted to data
+    std::vector<std::string> getVariablesRead() const;
+    
+    // A copy where the variable is the constant value, so several values can be evaluated at once
+    Expression bindVariable(const std::string &name, real value) const;
+    
+    // A copy where every variable but keptName is its current value, so it can be evaluated on
+    // other threads while the variables are set
+    Expression bindVariables(const std::string &keptName = std::string()) const;
+    
+    const std::string &getSource() const;
+    
+    // "f(x) = x^2" is the function y = x^2 named f, other expressions have no name
+    const std::string &getName() const;
+    
+    // Whether the definition of name was inlined, directly or through other definitions
+    bool calls(const std::string &name) const;
+    const std::set<std::string> &getDependencies() const;
+    
+    // Equations "lhs = rhs" evaluate to lhs - rhs. Equations and expressions in y are
+    // plotted as the implicit curve f(x, y) = 0 instead of y = f(x). Only functions and
+    // implicit curves can be evaluated with evaluate. "z = f(x, y)" evaluates to f(x, y)
+    // and is plotted as a heatmap with contour lines. "w = f(z)" is a complex function of
+    // z, where i is the imaginary unit, and is evaluated with evaluateComplex. The differential
+    // equation "dy/dx = f(x, y)" evaluates to f(x, y). Inequalities like "y < f(x)" and
+    // "f(x) < y < g(x)" are the region between their bounds, evaluated with evaluateBounds.
+    // Definitions "f(x) = ..." are functions.
+    Kind getKind() const;
+    
+    // Parametric and polar curves, the range defaults to [0, 2 pi]
+    std::pair<real, real> getParameterRange() const;
+    
+    // The bounds of an inequality on the same grid as evaluateGrid, missing bounds are infinite
+    void evaluateBounds(real step, long long first, std::size_t count, real *lower, real *upper) const;
+    
+    // Points on a parametric or polar curve, all components are evaluated over the same batch of t
+    void evaluateCurve(const real *t, real *x, real *y, std::size_t count) const;
+    
+    // Batch evaluation over complex arguments, the real and imaginary parts are kept in separate
+    // arrays so every instruction is a plain loop over reals. Functions added without a
+    // complex version evaluate to NaN.
+    void evaluateComplex(const real *re, const real *im, real *resultRe, real *resultIm, std::size_t count) const;
+    
+    // Returns (f(x), f'(x)), only available if every function used has a known derivative
+    bool isDifferentiable() const;
+    std::pair<real, real> evaluateDerivative(real x) const;
+    
+    // Batch forward mode along the variables instead of x, gradient[i * names.size() + k] is the
+    // partial derivative of f(x[i]) with respect to the variable names[k]. Integrals that read one
+    // of the variables have no known derivative with respect to it, and give NaN.
+    void evaluateGradient(const real *x, real *result, real *gradient, std::size_t count, const std::vector<std::string> &names) const;
 };
 
 
@@ -0,0 +1,116 @@
+//
+//  FunctionListModel.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "FunctionListModel.h"
+
+#include <QBrush>
+
+#include <algorithm>
+
+FunctionListModel::FunctionListModel(QObject *_parent)
+    : QAbstractListModel(_parent),
+      rows()
+{
+}
+
+int FunctionListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : static_cast<int>(rows.size());
+}
+
+QVariant FunctionListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= static_cast<int>(rows.size())) return QVariant();
+    
+    const Row &row = rows[index.row()];
+    
+    switch (role)
+    {
+        case Qt::DisplayRole:
+        case Qt::EditRole:
+            return row.expression;
+        case Qt::ForegroundRole:
+            return QBrush(row.color);
+        case Qt::CheckStateRole:
+            return row.enabled ? Qt::Checked : Qt::Unchecked;
+        default:
+            return QVariant();
+    }
+}
+
+bool FunctionListModel::setData(const QModelIndex &index, const QVariant &value, int role)
+{
+    if (!index.isValid() || index.row() >= static_cast<int>(rows.size())) return false;
+    
+    if (role == Qt::EditRole)
+    {
+        if (value.toString() != rows[index.row()].expression) emit expressionEdited(index.row(), value.toString());
+        
+        return true;
+    }
+    
+    if (role == Qt::CheckStateRole)
+    {
+        rows[index.row()].enabled = value.toInt() == Qt::Checked;
+        
+        emit dataChanged(index, index);
+        emit expressionToggled(index.row(), rows[index.row()].enabled);
+        
+        return true;
+    }
+    
+    return false;
+}
+
+Qt::ItemFlags FunctionListModel::flags(const QModelIndex &index) const
+{
+    if (!index.isValid()) return Qt::NoItemFlags;
+    
+    return Qt::ItemIsSelectable | Qt::ItemIsEnabled | Qt::ItemIsUserCheckable | Qt::ItemIsEditable;
+}
+
+void FunctionListModel::addExpression(Plotter::size_type plotterIndex, const QColor &color, const QString &expression)
+{
+    auto position = std::lower_bound(rows.begin(), rows.end(), plotterIndex, [](const Row &row, Plotter::size_type i) { return row.plotterIndex < i; });
+    const int row = static_cast<int>(position - rows.begin());
+    
+    beginInsertRows(QModelIndex(), row, row);
+    rows.insert(position, Row{plotterIndex, color, expression, true});
+    endInsertRows();
+}
+
+void FunctionListModel::removeExpression(int row)
+{
+    beginRemoveRows(QModelIndex(), row, row);
+    rows.erase(rows.begin() + row);
+    endRemoveRows();
+}
+
+int FunctionListModel::findRow(Plotter::size_type plotterIndex) const
+{
+    auto found = std::lower_bound(rows.begin(), rows.end(), plotterIndex, [](const Row &row, Plotter::size_type i) { return row.plotterIndex < i; });
+    
+    return found != rows.end() && found->plotterIndex == plotterIndex ? static_cast<int>(found - rows.begin()) : -1;
+}
+
+Plotter::size_type FunctionListModel::getPlotterIndex(int row) const
+{
+    return rows[row].plotterIndex;
+}
+
+QString FunctionListModel::getExpression(int row) const
+{
+    return rows[row].expression;
+}
+
+void FunctionListModel::setExpression(int row, const QString &expression)
+{
+    rows[row].expression = expression;
+    
+    emit dataChanged(index(row), index(row));
+}
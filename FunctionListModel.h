@@ -0,0 +1,65 @@
+//
+//  FunctionListModel.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__FunctionListModel__
+#define __MathGraph__FunctionListModel__
+
+#include "Plotter.h"
+
+#include <QAbstractListModel>
+#include <QColor>
+#include <QString>
+
+#include <vector>
+
+// The expressions of the function list, one row each in the order of their plotter indices. The
+// view only asks for the rows it shows, so the list stays fast with thousands of expressions. The
+// plotter index of an expression does not change when others are removed, and an expression added
+// at the index of a removed one takes its place in the list.
+class FunctionListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    
+public:
+    FunctionListModel(QObject *_parent = nullptr);
+    
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role) const;
+    bool setData(const QModelIndex &index, const QVariant &value, int role);
+    Qt::ItemFlags flags(const QModelIndex &index) const;
+    
+    void addExpression(Plotter::size_type plotterIndex, const QColor &color, const QString &expression);
+    void removeExpression(int row);
+    
+    // -1 if no row has the index
+    int findRow(Plotter::size_type plotterIndex) const;
+    
+    Plotter::size_type getPlotterIndex(int row) const;
+    QString getExpression(int row) const;
+    void setExpression(int row, const QString &expression);
+    
+signals:
+    // Edited text is only shown once it is set with setExpression
+    void expressionEdited(int row, const QString &text);
+    void expressionToggled(int row, bool enabled);
+    
+private:
+    struct Row
+    {
+        Plotter::size_type plotterIndex;
+        QColor color;
+        QString expression; // As plotted
+        bool enabled;
+    };
+    
+    // Sorted by the plotter index. A function that reuses a freed index is inserted at its sorted
+    // position, so rows are found by binary search.
+    std::vector<Row> rows;
+};
+
+#endif /* defined(__MathGraph__FunctionListModel__) */
@@ -0,0 +1,62 @@
+//
+//  GridCache.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "GridCache.h"
+
+#include <algorithm>
+
+GridCache::GridCache(const Expression &_expression)
+    : expression(_expression),
+      cacheMutex(),
+      cacheStep(0),
+      cacheFirst(0),
+      cacheValues()
+{
+}
+
+void GridCache::evaluateGrid(real step, long long first, std::size_t count, real *result) const
+{
+    if (count == 0) return;
+    
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    
+    long long last = first + static_cast<long long>(count) - 1;
+    long long cacheLast = cacheFirst + static_cast<long long>(cacheValues.size()) - 1;
+    
+    // Zooming invalidates everything, and so does a jump away from the cached samples
+    if (cacheValues.empty() || step != cacheStep || last < cacheFirst - 1 || first > cacheLast + 1 || cacheValues.size() + count > MAX_CACHE_SIZE)
+    {
+        cacheStep = step;
+        cacheFirst = first;
+        cacheValues.resize(count);
+        expression.evaluateGrid(step, first, count, cacheValues.data());
+        
+        cacheLast = last;
+    }
+    
+    // Extend to the left
+    if (first < cacheFirst)
+    {
+        std::vector<real> left(static_cast<std::size_t>(cacheFirst - first));
+        expression.evaluateGrid(step, first, left.size(), left.data());
+        
+        cacheValues.insert(cacheValues.begin(), left.begin(), left.end());
+        cacheFirst = first;
+    }
+    
+    // Extend to the right
+    if (last > cacheLast)
+    {
+        std::vector<real> right(static_cast<std::size_t>(last - cacheLast));
+        expression.evaluateGrid(step, cacheLast + 1, right.size(), right.data());
+        
+        cacheValues.insert(cacheValues.end(), right.begin(), right.end());
+    }
+    
+    std::copy(cacheValues.begin() + (first - cacheFirst), cacheValues.begin() + (first - cacheFirst) + count, result);
+}
@@ -0,0 +1,41 @@
+//
+//  GridCache.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__GridCache__
+#define __MathGraph__GridCache__
+
+#include "real.h"
+#include "Expression.h"
+
+#include <cstddef>
+#include <vector>
+#include <mutex>
+
+// Values of an expression that does not read any variables at x = (first + i) * step. They are
+// kept between calls, so setting a variable does not evaluate it again and panning only evaluates
+// the new samples.
+class GridCache
+{
+public:
+    GridCache(const Expression &_expression);
+    
+    void evaluateGrid(real step, long long first, std::size_t count, real *result) const;
+    
+private:
+    // Cached values are dropped instead of growing past this
+    static const std::size_t MAX_CACHE_SIZE = 1 << 20;
+    
+    Expression expression;
+    
+    mutable std::mutex cacheMutex;
+    mutable real cacheStep;
+    mutable long long cacheFirst;
+    mutable std::vector<real> cacheValues;
+};
+
+#endif /* defined(__MathGraph__GridCache__) */
@@ -0,0 +1,214 @@
+//
+//  Heatmap.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "Heatmap.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+
+Heatmap::Heatmap(const Expression &_expression, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight)
+    : expression(_expression),
+      xMin(_xMin),
+      xMax(_xMax),
+      yMin(_yMin),
+      yMax(_yMax),
+      pixelWidth(std::max(_pixelWidth, 0)),
+      pixelHeight(std::max(_pixelHeight, 0)),
+      coarseColumns((pixelWidth + COARSE_BLOCK_SIZE - 1) / COARSE_BLOCK_SIZE),
+      coarseRows((pixelHeight + COARSE_BLOCK_SIZE - 1) / COARSE_BLOCK_SIZE),
+      coarse(static_cast<std::size_t>(coarseColumns) * coarseRows),
+      low(0),
+      high(1)
+{
+    const real xStep = (xMax - xMin) / pixelWidth * COARSE_BLOCK_SIZE;
+    const real yStep = (yMax - yMin) / pixelHeight * COARSE_BLOCK_SIZE;
+    
+    std::vector<real> xs(coarse.size());
+    std::vector<real> ys(coarse.size());
+    
+    for (std::size_t k = 0; k != coarse.size(); ++k)
+    {
+        xs[k] = xMin + (k % coarseColumns + 0.5) * xStep;
+        ys[k] = yMax - (k / coarseColumns + 0.5) * yStep;
+    }
+    
+    expression.evaluate(xs.data(), ys.data(), coarse.data(), coarse.size());
+    
+    std::vector<real> finite;
+    std::copy_if(coarse.begin(), coarse.end(), std::back_inserter(finite), [](real v) { return std::isfinite(v); });
+    
+    if (!finite.empty())
+    {
+        std::vector<real>::size_type lowIndex = (finite.size() - 1) * LOW_PERCENTILE / 100;
+        std::vector<real>::size_type highIndex = (finite.size() - 1) * HIGH_PERCENTILE / 100;
+        
+        std::nth_element(finite.begin(), finite.begin() + lowIndex, finite.end());
+        low = finite[lowIndex];
+        
+        std::nth_element(finite.begin(), finite.begin() + highIndex, finite.end());
+        high = finite[highIndex];
+    }
+    
+    if (!(high > low))
+    { // Constant, center the value in the range
+        low -= 0.5;
+        high = low + 1;
+    }
+}
+
+int Heatmap::getPixelWidth() const
+{
+    return pixelWidth;
+}
+
+int Heatmap::getPixelHeight() const
+{
+    return pixelHeight;
+}
+
+std::pair<real, real> Heatmap::getRange() const
+{
+    return std::pair<real, real>(low, high);
+}
+
+std::vector<real> Heatmap::getContourLevels() const
+{
+    // Round the step to 1, 2 or 5 times a power of ten
+    real rawStep = (high - low) / NUM_LEVELS;
+    real magnitude = std::pow(real(10), std::floor(std::log10(rawStep)));
+    real mantissa = rawStep / magnitude;
+    
+    real step = magnitude * (mantissa < 1.5 ? 1 : mantissa < 3.5 ? 2 : mantissa < 7.5 ? 5 : 10);
+    
+    std::vector<real> levels;
+    
+    // Levels are whole multiples of the step
+    const real first = std::ceil(low / step);
+    const real last = std::floor(high / step);
+    
+    // A step below the precision of the values, like in z = 100000000 + x / 10^12, has no distinct levels
+    if (!std::isfinite(first) || !std::isfinite(last) || last - first >= MAX_LEVELS || first + 1 == first || (first + 1) * step == first * step)
+    {
+        return levels;
+    }
+    
+    for (int k = 0; k <= last - first; ++k)
+    {
+        real level = (first + k) * step;
+        
+        // Avoid values like 1e-17 in place of 0
+        levels.push_back(std::abs(level) < step * 1e-9 ? 0 : level);
+    }
+    
+    return levels;
+}
+
+void Heatmap::renderCoarse(std::uint32_t *pixels) const
+{
+    for (int py = 0; py != pixelHeight; ++py)
+    {
+        const real *row = coarse.data() + static_cast<std::size_t>(py / COARSE_BLOCK_SIZE) * coarseColumns;
+        std::uint32_t *out = pixels + static_cast<std::size_t>(py) * pixelWidth;
+        
+        for (int px = 0; px != pixelWidth; ++px)
+        {
+            out[px] = color(row[px / COARSE_BLOCK_SIZE]);
+        }
+    }
+}
+
+bool Heatmap::render(std::uint32_t *pixels, const std::atomic<bool> &cancelled) const
+{
+    const int tileColumns = (pixelWidth + TILE_SIZE - 1) / TILE_SIZE;
+    const int tileRows = (pixelHeight + TILE_SIZE - 1) / TILE_SIZE;
+    
+    const real xStep = (xMax - xMin) / pixelWidth;
+    const real yStep = (yMax - yMin) / pixelHeight;
+    
+    // Tiles are small enough that the pool balances uneven costs, like undefined regions
+    ThreadPool::globalInstance().parallelFor(static_cast<ThreadPool::size_type>(tileColumns) * tileRows, [&](ThreadPool::size_type tile)
+    {
+        if (cancelled) return;
+        
+        const int left = static_cast<int>(tile % tileColumns) * TILE_SIZE;
+        const int top = static_cast<int>(tile / tileColumns) * TILE_SIZE;
+        const int width = std::min(pixelWidth - left, static_cast<int>(TILE_SIZE));
+        const int height = std::min(pixelHeight - top, static_cast<int>(TILE_SIZE));
+        
+        real xs[TILE_SIZE];
+        real ys[TILE_SIZE];
+        real values[TILE_SIZE];
+        
+        for (int i = 0; i != width; ++i)
+        {
+            xs[i] = xMin + (left + i + 0.5) * xStep;
+        }
+        
+        for (int py = top; py != top + height; ++py)
+        {
+            std::fill(ys, ys + width, yMax - (py + 0.5) * yStep);
+            
+            expression.evaluate(xs, ys, values, width);
+            
+            std::uint32_t *out = pixels + static_cast<std::size_t>(py) * pixelWidth + left;
+            for (int i = 0; i != width; ++i)
+            {
+                out[i] = color(values[i]);
+            }
+        }
+    });
+    
+    return !cancelled;
+}
+
+std::uint32_t Heatmap::color(real value) const
+{
+    if (!std::isfinite(value)) return 0;
+    
+    const std::vector<std::uint32_t> &map = colorMap();
+    
+    real t = (value - low) / (high - low);
+    int index = static_cast<int>(std::max<real>(0, std::min<real>(1, t)) * (map.size() - 1) + 0.5);
+    
+    return map[index];
+}
+
+const std::vector<std::uint32_t> &Heatmap::colorMap()
+{
+    // Perceptually uniform dark blue to yellow, interpolated between a few stops
+    static const std::vector<std::uint32_t> map = []()
+    {
+        const int stops[][3] = {{68, 1, 84}, {72, 40, 120}, {62, 74, 137}, {49, 104, 142}, {38, 130, 142},
+                                {31, 158, 137}, {53, 183, 121}, {110, 206, 88}, {181, 222, 43}, {253, 231, 37}};
+        const int numStops = sizeof(stops) / sizeof(stops[0]);
+        
+        std::vector<std::uint32_t> result(256);
+        
+        for (int i = 0; i != 256; ++i)
+        {
+            double position = i / 255.0 * (numStops - 1);
+            int stop = std::min(static_cast<int>(position), numStops - 2);
+            double t = position - stop;
+            
+            std::uint32_t argb = 0xff000000u;
+            for (int channel = 0; channel != 3; ++channel)
+            {
+                double c = stops[stop][channel] + t * (stops[stop + 1][channel] - stops[stop][channel]);
+                argb |= static_cast<std::uint32_t>(c + 0.5) << (16 - 8 * channel);
+            }
+            
+            result[i] = argb;
+        }
+        
+        return result;
+    }();
+    
+    return map;
+}
@@ -0,0 +1,77 @@
+//
+//  Heatmap.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__Heatmap__
+#define __MathGraph__Heatmap__
+
+#include "real.h"
+#include "Expression.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Colors every pixel by the value of z = f(x, y). The constructor samples the viewport on a
+// coarse grid, which gives the color range and a preview that can be shown at once. The full
+// resolution image is rendered in square tiles on the thread pool, one batch per tile row.
+class Heatmap
+{
+public:
+    Heatmap(const Expression &_expression, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight);
+    
+    int getPixelWidth() const;
+    int getPixelHeight() const;
+    
+    // Values outside the range get the end colors, so a few large values do not wash out the rest
+    std::pair<real, real> getRange() const;
+    
+    // Round values spread over the range, for contour lines. Empty if the values are too close
+    // together to tell the levels apart.
+    std::vector<real> getContourLevels() const;
+    
+    // pixels holds pixelWidth * pixelHeight ARGB values row by row, undefined points are transparent
+    void renderCoarse(std::uint32_t *pixels) const;
+    
+    // Returns false if cancelled was set before all tiles were done
+    bool render(std::uint32_t *pixels, const std::atomic<bool> &cancelled) const;
+    
+    // 256 opaque ARGB colors from low to high values
+    static const std::vector<std::uint32_t> &colorMap();
+    
+private:
+    // Pixels per side of the coarse blocks and of the tiles
+    static const int COARSE_BLOCK_SIZE = 8;
+    static const int TILE_SIZE = 64;
+    
+    // About this many contour levels are chosen, and never more than the maximum
+    static const int NUM_LEVELS = 10;
+    static const int MAX_LEVELS = 4 * NUM_LEVELS;
+    
+    // The range covers the coarse samples between these percentiles
+    static const int LOW_PERCENTILE = 1;
+    static const int HIGH_PERCENTILE = 99;
+    
+    Expression expression;
+    real xMin, xMax;
+    real yMin, yMax;
+    int pixelWidth;
+    int pixelHeight;
+    
+    // Values at the centers of the coarse blocks
+    int coarseColumns;
+    int coarseRows;
+    std::vector<real> coarse;
+    
+    real low, high;
+    
+    std::uint32_t color(real value) const;
+};
+
+#endif /* defined(__MathGraph__Heatmap__) */
@@ -0,0 +1,110 @@
+//
+//  InequalityRegion.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "InequalityRegion.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+InequalityRegion::InequalityRegion(std::vector<real> _x, std::vector<real> _top, std::vector<real> _bottom, int _pixelWidth, int _pixelHeight)
+    : x(std::move(_x)),
+      top(std::move(_top)),
+      bottom(std::move(_bottom)),
+      pixelWidth(std::max(_pixelWidth, 0)),
+      pixelHeight(std::max(_pixelHeight, 0))
+{
+}
+
+int InequalityRegion::getPixelWidth() const
+{
+    return pixelWidth;
+}
+
+int InequalityRegion::getPixelHeight() const
+{
+    return pixelHeight;
+}
+
+void InequalityRegion::getBoundaries(SampleBuffer &boundaries) const
+{
+    boundaries.reserve(boundaries.size() + 2 * x.size());
+    
+    addBoundary(top, boundaries);
+    addBoundary(bottom, boundaries);
+}
+
+void InequalityRegion::fill(std::uint32_t color, std::uint32_t *pixels) const
+{
+    if (x.size() < 2) return;
+    
+    // Premultiply the color once, every pixel is then source + destination * (1 - alpha)
+    const std::uint32_t alpha = color >> 24;
+    const std::uint32_t inverseAlpha = 255 - alpha;
+    const std::uint32_t source = (alpha << 24) |
+                                 ((((color >> 16) & 0xff) * alpha / 255) << 16) |
+                                 ((((color >> 8) & 0xff) * alpha / 255) << 8) |
+                                 ((color & 0xff) * alpha / 255);
+    
+    std::vector<real>::size_type i = 0;
+    
+    for (int column = 0; column != pixelWidth; ++column)
+    {
+        const real center = column + real(0.5);
+        
+        while (i + 2 < x.size() && x[i + 1] < center) ++i;
+        
+        const real t = (center - x[i]) / (x[i + 1] - x[i]);
+        const real spanTop = interpolate(top, i, t);
+        const real spanBottom = interpolate(bottom, i, t);
+        
+        // Undefined where either bound is
+        if (std::isnan(spanTop) || std::isnan(spanBottom)) continue;
+        
+        const int first = static_cast<int>(std::max<real>(0, std::min<real>(pixelHeight, std::round(spanTop))));
+        const int last = static_cast<int>(std::max<real>(0, std::min<real>(pixelHeight, std::round(spanBottom))));
+        
+        std::uint32_t *pixel = pixels + static_cast<std::size_t>(first) * pixelWidth + column;
+        
+        for (int row = first; row < last; ++row, pixel += pixelWidth)
+        { // Two channels at a time, each scaled by inverseAlpha / 256
+            const std::uint32_t destination = *pixel;
+            
+            *pixel = source +
+                     ((((destination >> 8) & 0x00ff00ffu) * inverseAlpha) & 0xff00ff00u) +
+                     ((((destination & 0x00ff00ffu) * inverseAlpha) >> 8) & 0x00ff00ffu);
+        }
+    }
+}
+
+void InequalityRegion::addBoundary(const std::vector<real> &y, SampleBuffer &boundaries) const
+{
+    boundaries.breakPath();
+    
+    for (std::vector<real>::size_type i = 0; i != x.size(); ++i)
+    {
+        if (!std::isfinite(y[i]))
+        {
+            boundaries.breakPath();
+            continue;
+        }
+        
+        // Far outside the view the exact position does not matter
+        real clamped = std::max<real>(-pixelHeight, std::min<real>(2 * pixelHeight, y[i]));
+        
+        boundaries.add(static_cast<float>(x[i]), static_cast<float>(clamped));
+    }
+}
+
+real InequalityRegion::interpolate(const std::vector<real> &y, std::vector<real>::size_type i, real t)
+{
+    if (std::isfinite(y[i]) && std::isfinite(y[i + 1])) return y[i] + t * (y[i + 1] - y[i]);
+    
+    // Infinite bounds fill the column to the edge, take the nearest sample
+    return t < 0.5 ? y[i] : y[i + 1];
+}
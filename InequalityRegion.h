@@ -0,0 +1,49 @@
+//
+//  InequalityRegion.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__InequalityRegion__
+#define __MathGraph__InequalityRegion__
+
+#include "real.h"
+#include "SampleBuffer.h"
+
+#include <cstdint>
+#include <vector>
+
+// The region of y < f(x), y > f(x) or f(x) < y < g(x) on screen. It is kept as the samples the
+// bounds are drawn from and filled as one vertical span of pixels per column, straight into an
+// image, so filling costs no evaluations and no closed path has to be built for QPainter to fill.
+class InequalityRegion
+{
+public:
+    // Samples in pixels at increasing x, top is the upper bound and bottom the lower bound.
+    // Missing bounds are infinite, points where a bound is undefined are NaN.
+    InequalityRegion(std::vector<real> _x, std::vector<real> _top, std::vector<real> _bottom, int _pixelWidth, int _pixelHeight);
+    
+    int getPixelWidth() const;
+    int getPixelHeight() const;
+    
+    // Adds the bounds, broken where they are undefined or infinite
+    void getBoundaries(SampleBuffer &boundaries) const;
+    
+    // Blends the ARGB color over the region. pixels holds pixelWidth * pixelHeight premultiplied
+    // ARGB values row by row.
+    void fill(std::uint32_t color, std::uint32_t *pixels) const;
+    
+private:
+    std::vector<real> x;
+    std::vector<real> top;
+    std::vector<real> bottom;
+    int pixelWidth;
+    int pixelHeight;
+    
+    void addBoundary(const std::vector<real> &y, SampleBuffer &boundaries) const;
+    static real interpolate(const std::vector<real> &y, std::vector<real>::size_type i, real t);
+};
+
+#endif /* defined(__MathGraph__InequalityRegion__) */
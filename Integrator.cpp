@@ -0,0 +1,215 @@
+//
+//  Integrator.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "Integrator.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+// Gauss-Kronrod (7, 15) nodes and weights, from QUADPACK. Every other Kronrod node is a Gauss node.
+static const real KRONROD_NODES[8] = {
+    0.991455371120812639206854697526329L,
+    0.949107912342758524526189684047851L,
+    0.864864423359769072789712788640926L,
+    0.741531185599394439863864773280788L,
+    0.586087235467691130294144845693013L,
+    0.405845151377397166906606412076961L,
+    0.207784955007898467600689403773245L,
+    0.000000000000000000000000000000000L
+};
+
+static const real KRONROD_WEIGHTS[8] = {
+    0.022935322010529224963732008058970L,
+    0.063092092629978553290700663189204L,
+    0.104790010322250183839876322541518L,
+    0.140653259715525918745189590510238L,
+    0.169004726639267902826583426598550L,
+    0.190350578064785409913256402421014L,
+    0.204432940075298892414161999234649L,
+    0.209482141084727828012999174891714L
+};
+
+static const real GAUSS_WEIGHTS[4] = {
+    0.129484966168869693270611432679082L,
+    0.279705391489276667901467771423780L,
+    0.381830050505118944950369775488975L,
+    0.417959183673469387755102040816327L
+};
+
+Integrator::Integrator(const Expression &_expression, real _tolerance, int _maxPanels)
+    : expression(_expression),
+      tolerance(_tolerance),
+      maxPanels(_maxPanels)
+{
+}
+
+const Expression &Integrator::getExpression() const
+{
+    return expression;
+}
+
+std::pair<real, real> Integrator::integrate(real a, real b) const
+{
+    struct Panel
+    {
+        real a, b;
+        real integral, error;
+    };
+    
+    ThreadPool &pool = ThreadPool::globalInstance();
+    
+    if (a == b) return std::pair<real, real>(0, 0);
+    
+    // Start with a few panels per thread so the first round is already parallel
+    const size_t initialPanels = 4 * pool.numThreads();
+    
+    std::vector<Panel> panels(initialPanels);
+    
+    pool.parallelFor(initialPanels, [&](ThreadPool::size_type i)
+    {
+        Panel &panel = panels[i];
+        panel.a = a + (b - a) * i / initialPanels;
+        panel.b = i + 1 == initialPanels ? b : a + (b - a) * (i + 1) / initialPanels;
+        
+        std::pair<real, real> result = integratePanel(panel.a, panel.b);
+        panel.integral = result.first;
+        panel.error = result.second;
+    });
+    
+    real integral = 0, error = 0;
+    
+    while (true)
+    {
+        integral = 0;
+        error = 0;
+        
+        for (const Panel &panel : panels)
+        {
+            // Undefined somewhere in the panel, the interval leaves the domain and refining does not help
+            if (std::isnan(panel.integral)) return std::pair<real, real>(NAN, NAN);
+            
+            integral += panel.integral;
+            error += panel.error;
+        }
+        
+        real allowedError = tolerance * std::max<real>(1, std::fabs(integral));
+        
+        if (error <= allowedError || static_cast<int>(panels.size()) >= maxPanels) break;
+        
+        // Bisect every panel with more than its share of the allowed error, or at least the worst one
+        std::vector<size_t> refine;
+        size_t worst = 0;
+        for (size_t i = 0; i != panels.size(); ++i)
+        {
+            if (panels[i].error > allowedError * std::fabs((panels[i].b - panels[i].a) / (b - a))) refine.push_back(i);
+            
+            if (panels[i].error > panels[worst].error) worst = i;
+        }
+        
+        if (refine.empty()) refine.push_back(worst);
+        
+        // The errors no longer improve, roundoff or a singularity
+        const real epsilon = std::numeric_limits<real>::epsilon();
+        if (std::fabs(panels[worst].b - panels[worst].a) <= 100 * epsilon * std::max(std::fabs(panels[worst].a), std::fabs(panels[worst].b))) break;
+        
+        std::vector<Panel> halves(2 * refine.size());
+        
+        pool.parallelFor(refine.size(), [&](ThreadPool::size_type i)
+        {
+            const Panel &panel = panels[refine[i]];
+            real middle = (panel.a + panel.b) / 2;
+            
+            std::pair<real, real> left = integratePanel(panel.a, middle);
+            std::pair<real, real> right = integratePanel(middle, panel.b);
+            
+            halves[2 * i] = {panel.a, middle, left.first, left.second};
+            halves[2 * i + 1] = {middle, panel.b, right.first, right.second};
+        });
+        
+        // A pole that a node happened to hit is at the ends of the halves, which are not evaluated.
+        // Halves that are still not finite diverge.
+        for (const Panel &half : halves)
+        {
+            if (!std::isfinite(half.integral)) return std::pair<real, real>(NAN, NAN);
+        }
+        
+        for (size_t i = 0; i != refine.size(); ++i)
+        {
+            panels[refine[i]] = halves[2 * i];
+            panels.push_back(halves[2 * i + 1]);
+        }
+    }
+    
+    return std::pair<real, real>(integral, error);
+}
+
+std::pair<real, real> Integrator::integratePanel(real a, real b) const
+{
+    const real epsilon = std::numeric_limits<real>::epsilon();
+    
+    real center = (a + b) / 2;
+    real halfLength = (b - a) / 2;
+    
+    // Nodes 0-6 left of center, 7 center, 8-14 right of center
+    real x[15], f[15];
+    for (int i = 0; i != 7; ++i)
+    {
+        x[i] = center - halfLength * KRONROD_NODES[i];
+        x[14 - i] = center + halfLength * KRONROD_NODES[i];
+    }
+    x[7] = center;
+    
+    expression.evaluate(x, f, 15);
+    
+    real kronrod = KRONROD_WEIGHTS[7] * f[7];
+    real gauss = GAUSS_WEIGHTS[3] * f[7];
+    real absolute = std::fabs(kronrod);
+    
+    for (int i = 0; i != 7; ++i)
+    {
+        real pair = f[i] + f[14 - i];
+        
+        kronrod += KRONROD_WEIGHTS[i] * pair;
+        absolute += KRONROD_WEIGHTS[i] * (std::fabs(f[i]) + std::fabs(f[14 - i]));
+        
+        if (i % 2 == 1) gauss += GAUSS_WEIGHTS[i / 2] * pair;
+    }
+    
+    // Deviation from the mean, used by QUADPACK to scale the error estimate
+    real mean = kronrod / 2;
+    real deviation = KRONROD_WEIGHTS[7] * std::fabs(f[7] - mean);
+    for (int i = 0; i != 7; ++i)
+    {
+        deviation += KRONROD_WEIGHTS[i] * (std::fabs(f[i] - mean) + std::fabs(f[14 - i] - mean));
+    }
+    
+    real integral = kronrod * halfLength;
+    real error = std::fabs((kronrod - gauss) * halfLength);
+    deviation *= std::fabs(halfLength);
+    absolute *= std::fabs(halfLength);
+    
+    if (deviation != 0 && error != 0)
+    {
+        error = deviation * std::min<real>(1, std::pow(200 * error / deviation, 1.5L));
+    }
+    
+    if (absolute > std::numeric_limits<real>::min() / (50 * epsilon))
+    {
+        error = std::max(50 * epsilon * absolute, error);
+    }
+    
+    // Not a number, the panel contains a singularity or leaves the domain
+    if (!std::isfinite(integral) || !std::isfinite(error))
+    {
+        error = std::numeric_limits<real>::infinity();
+    }
+    
+    return std::pair<real, real>(integral, error);
+}
@@ -0,0 +1,39 @@
+//
+//  Integrator.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__Integrator__
+#define __MathGraph__Integrator__
+
+#include "real.h"
+#include "Expression.h"
+
+#include <utility>
+
+class Integrator
+{
+public:
+    // Converged when the error estimate is below tolerance * max(1, |integral|)
+    Integrator(const Expression &_expression, real _tolerance = 1e-10, int _maxPanels = 10000);
+    
+    // Adaptive Gauss-Kronrod quadrature, returns (integral, error estimate). The panels that
+    // have not converged are bisected in parallel, one round at a time. Both are NaN at once
+    // if the function is undefined in the interval or a panel diverges.
+    std::pair<real, real> integrate(real a, real b) const;
+    
+    // The 15 point Kronrod rule on a single panel, returns (integral, error estimate)
+    std::pair<real, real> integratePanel(real a, real b) const;
+    
+    const Expression &getExpression() const;
+    
+private:
+    Expression expression;
+    real tolerance;
+    int maxPanels;
+};
+
+#endif /* defined(__MathGraph__Integrator__) */
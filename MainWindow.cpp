@@ -8,7 +8,6 @@
 
 #include "MainWindow.h"
 #include "Expression.h"
-#include "QListWidgetFunctionItem.h"
 
 #include <QMenuBar>
 #include <QCursor>
@@ -18,6 +17,8 @@
 #include <QSplitter>
 #include <QLabel>
 #include <QApplication>
+#include <QFileDialog>
+#include <QInputDialog>
 
 MainWindow::MainWindow()
     : QWidget(),
@@ -73,6 +74,17 @@ MainWindow::MainWindow()
     
     toolbar->addWidget(selectionToolButton);
 
+    // Toolbar: Integration tool button
+    QPushButton *integrationToolButton = new QPushButton("∫");
+    integrationToolButton->setToolTip("Integration tool");
+    
+    integrationToolButton->setMinimumWidth(50);
+    integrationToolButton->setMaximumWidth(50);
+    integrationToolButton->setMinimumHeight(50);
+    integrationToolButton->setMaximumHeight(50);
+    
+    toolbar->addWidget(integrationToolButton);
+    
     toolbar->addSpacing(20);
 
     // Toolbar: Center origo button
@@ -86,9 +98,22 @@ MainWindow::MainWindow()
     // Output area
     QSplitter *outputArea = new QSplitter();
     
-    // Output area: Expression list
-    functionList = new QListWidget;
-    outputArea->addWidget(functionList);
+    // Output area: Expression list, with the parameters below it
+    QWidget *listArea = new QWidget;
+    QVBoxLayout *listLayout = new QVBoxLayout;
+    
+    // Rows have the same height, so the view does not measure the ones it does not show
+    functionListModel = new FunctionListModel(this);
+    functionList = new QListView;
+    functionList->setModel(functionListModel);
+    functionList->setUniformItemSizes(true);
+    listLayout->addWidget(functionList, 1);
+    
+    parameterLayout = new QVBoxLayout;
+    listLayout->addLayout(parameterLayout);
+    
+    listArea->setLayout(listLayout);
+    outputArea->addWidget(listArea);
     
     // Output area: Render area
     renderArea = new RenderArea;
@@ -124,10 +149,17 @@ MainWindow::MainWindow()
     connect(moveToolButton, SIGNAL(clicked()), this, SLOT(setMoveTool()));
     connect(zoomToolButton, SIGNAL(clicked()), this, SLOT(setZoomTool()));
     connect(selectionToolButton, SIGNAL(clicked()), this, SLOT(setSelectionTool()));
+    connect(integrationToolButton, SIGNAL(clicked()), this, SLOT(setIntegrationTool()));
     
     // Expression list
-    connect(functionList, SIGNAL(itemChanged(QListWidgetItem *)), this, SLOT(expressionChanged(QListWidgetItem *))); // used to check for checked items
-    connect(functionList, SIGNAL(itemSelectionChanged()), this, SLOT(expressionSelectionChanged()));
+    connect(functionListModel, SIGNAL(expressionEdited(int, const QString &)), this, SLOT(expressionEdited(int, const QString &)));
+    connect(functionListModel, SIGNAL(expressionToggled(int, bool)), this, SLOT(expressionToggled(int, bool)));
+    connect(functionList->selectionModel(), SIGNAL(selectionChanged(const QItemSelection &, const QItemSelection &)), this, SLOT(expressionSelectionChanged()));
+    
+    // Render area
+    connect(renderArea, SIGNAL(parameterAnimated(const QString &, double)), this, SLOT(parameterAnimated(const QString &, double)));
+    connect(renderArea, SIGNAL(parameterFitted(const QString &, double)), this, SLOT(parameterAnimated(const QString &, double)));
+    connect(renderArea, SIGNAL(curveClicked(int)), this, SLOT(curveClicked(int)));
     
     // Menu definition
     QMenu *editMenu = menuBar->addMenu("Edit");
@@ -136,6 +168,50 @@ MainWindow::MainWindow()
     adaptYAction->setStatusTip("Automatically set Y-scale");
     connect(adaptYAction, SIGNAL(triggered()), renderArea, SLOT(autoYBounds()));
     
+    QAction *analysisAction = editMenu->addAction("Show &roots and extrema");
+    analysisAction->setStatusTip("Mark roots, extrema and intersections of the visible functions");
+    analysisAction->setCheckable(true);
+    connect(analysisAction, SIGNAL(toggled(bool)), renderArea, SLOT(setAnalysisEnabled(bool)));
+    
+    QAction *rasterizerAction = editMenu->addAction("Draw curves in &parallel");
+    rasterizerAction->setStatusTip("Draw the curves with the multithreaded rasterizer instead of QPainter");
+    rasterizerAction->setCheckable(true);
+    connect(rasterizerAction, SIGNAL(toggled(bool)), renderArea, SLOT(setRasterizerEnabled(bool)));
+    
+    QAction *benchmarkAction = editMenu->addAction("&Benchmark curve drawing");
+    benchmarkAction->setStatusTip("Time drawing the current curves with QPainter and with the rasterizer");
+    connect(benchmarkAction, SIGNAL(triggered()), renderArea, SLOT(benchmarkCurveDrawing()));
+    
+    QAction *surfaceViewAction = editMenu->addAction("Show &3D view");
+    surfaceViewAction->setStatusTip("Show the selected surface in 3D");
+    connect(surfaceViewAction, SIGNAL(triggered()), renderArea, SLOT(showSurfaceView()));
+    
+    QAction *loadDataAction = editMenu->addAction("&Load data series...");
+    loadDataAction->setStatusTip("Plot measured points from a text or binary file");
+    connect(loadDataAction, SIGNAL(triggered()), this, SLOT(loadDataSeries()));
+    
+    QAction *clearDataAction = editMenu->addAction("Remove data series");
+    clearDataAction->setStatusTip("Remove all loaded data series from the graph");
+    connect(clearDataAction, SIGNAL(triggered()), renderArea, SLOT(clearDataSeries()));
+    
+    QAction *fitAction = editMenu->addAction("&Fit selected function to data");
+    fitAction->setStatusTip("Fit the parameters of the selected function to the last loaded data series");
+    connect(fitAction, SIGNAL(triggered()), renderArea, SLOT(fitSelectedToData()));
+    
+#ifdef Q_OS_UNIX
+    QAction *inputStreamAction = editMenu->addAction("Stream from standard &input");
+    inputStreamAction->setStatusTip("Plot samples written to standard input as they come");
+    connect(inputStreamAction, SIGNAL(triggered()), this, SLOT(streamFromInput()));
+    
+    QAction *socketStreamAction = editMenu->addAction("Stream from &socket...");
+    socketStreamAction->setStatusTip("Plot samples written to a Unix socket as they come");
+    connect(socketStreamAction, SIGNAL(triggered()), this, SLOT(streamFromSocket()));
+    
+    QAction *stopStreamAction = editMenu->addAction("Stop stream");
+    stopStreamAction->setStatusTip("Stop reading the stream and remove it from the graph");
+    connect(stopStreamAction, SIGNAL(triggered()), renderArea, SLOT(stopStream()));
+#endif
+    
     QMenu *helpMenu = menuBar->addMenu("Help");
     
     QAction *aboutAction = helpMenu->addAction("&About");
@@ -165,18 +241,113 @@ void MainWindow::addExpression()
         
         Plotter::size_type plotterItemIndex = renderArea->addFunction(expr);
         
-        QListWidgetItem *item = new QListWidgetFunctionItem(plotterItemIndex, renderArea->FUNCTION_COLORS[plotterItemIndex % renderArea->FUNCTION_COLORS.size()], expressionString.c_str());
-        
-        functionList->addItem(item);
+        functionListModel->addExpression(plotterItemIndex, renderArea->FUNCTION_COLORS[plotterItemIndex % renderArea->FUNCTION_COLORS.size()], expressionString.c_str());
         
         expressionLineEdit->setText("");
     }
     catch(const InvalidExpression &e)
     {
+        std::string name = expressionString.substr(e.getPosition(), e.getLength());
+        
+        if (e.getError() == InvalidExpression::UNDEFINED_NAME && Expression::isParameterName(name))
+        { // Try again with the parameter, which may find the next one
+            addParameter(name);
+            addExpression();
+            
+            return;
+        }
+        
         expressionLineEdit->setStyleSheet("background: #FF3333;");
     }
 }
 
+void MainWindow::addParameter(const std::string &name)
+{
+    const double initialValue = 1;
+    
+    Expression::addVariable(name, initialValue);
+    
+    ParameterSlider *slider = new ParameterSlider(name.c_str(), initialValue);
+    parameterLayout->addWidget(slider);
+    parameterSliders[name] = slider;
+    
+    connect(slider, SIGNAL(valueChanged(const QString &, double)), this, SLOT(parameterChanged(const QString &, double)));
+    connect(slider, SIGNAL(animationStarted(const QString &, double, double, double, int)), this, SLOT(animationStarted(const QString &, double, double, double, int)));
+    connect(slider, SIGNAL(animationStopped(const QString &)), this, SLOT(animationStopped(const QString &)));
+}
+
+void MainWindow::parameterChanged(const QString &name, double value)
+{
+    renderArea->setParameter(name.toStdString(), value);
+}
+
+void MainWindow::animationStarted(const QString &name, double value, double from, double to, int numValues)
+{
+    // Only one parameter is animated at a time
+    for (const std::pair<const std::string, ParameterSlider *> &parameter : parameterSliders)
+    {
+        if (parameter.first != name.toStdString()) parameter.second->setPlaying(false);
+    }
+    
+    renderArea->startAnimation(name.toStdString(), value, from, to, numValues);
+}
+
+void MainWindow::animationStopped(const QString &)
+{
+    renderArea->stopAnimation();
+}
+
+void MainWindow::parameterAnimated(const QString &name, double value)
+{
+    parameterSliders[name.toStdString()]->showValue(value);
+}
+
+void MainWindow::curveClicked(int expressionIndex)
+{
+    int row = functionListModel->findRow(expressionIndex);
+    
+    if (row != -1) functionList->setCurrentIndex(functionListModel->index(row));
+}
+
+void MainWindow::loadDataSeries()
+{
+    QString path = QFileDialog::getOpenFileName(this, "Load data series", QString(), "Data (*.csv *.txt *.dat *.bin *.raw);;All files (*)");
+    
+    if (!path.isEmpty()) renderArea->loadDataSeries(path);
+}
+
+#ifdef Q_OS_UNIX
+void MainWindow::streamFromInput()
+{
+    startStream("");
+}
+
+void MainWindow::streamFromSocket()
+{
+    bool ok;
+    QString path = QInputDialog::getText(this, "Stream from socket", "Socket path:", QLineEdit::Normal, "/tmp/mathgraph.sock", &ok);
+    
+    if (ok && !path.isEmpty()) startStream(path.toStdString());
+}
+
+void MainWindow::startStream(const std::string &socketPath)
+{
+    bool ok;
+    int windowLength = QInputDialog::getInt(this, "Stream", "Samples kept:", 1000000, 1000, 100000000, 1000, &ok);
+    
+    if (!ok) return;
+    
+    try
+    {
+        renderArea->startStream(socketPath, windowLength);
+    }
+    catch (const DataFileError &e)
+    {
+        QMessageBox::warning(this, "Stream", e.what());
+    }
+}
+#endif
+
 void MainWindow::centerOrigo()
 {
     renderArea->centerOrigo();
@@ -197,25 +368,36 @@ void MainWindow::setZoomTool()
     renderArea->setTool(ZOOM);
 }
 
-void MainWindow::expressionChanged(QListWidgetItem *item)
+void MainWindow::setIntegrationTool()
 {
-    QListWidgetFunctionItem *functionItem = static_cast<QListWidgetFunctionItem *>(item);
-    
-    renderArea->setEnabled(functionItem->getPlotterIndex(), functionItem->checkState() == Qt::Checked);
+    renderArea->setTool(INTEGRATION);
+}
+
+void MainWindow::expressionEdited(int row, const QString &text)
+{
+    try
+    {
+        renderArea->replaceFunction(functionListModel->getPlotterIndex(row), Expression(text.toStdString()));
+        functionListModel->setExpression(row, text);
+    }
+    catch (const InvalidExpression &e)
+    { // The row still shows the plotted expression
+        QMessageBox::warning(this, "Invalid expression", e.what());
+    }
+}
+
+void MainWindow::expressionToggled(int row, bool enabled)
+{
+    renderArea->setEnabled(functionListModel->getPlotterIndex(row), enabled);
 }
 
 void MainWindow::expressionSelectionChanged()
 {
     renderArea->clearSelection();
     
-    for (int i = 0; i < functionList->count(); ++i)
+    for (const QModelIndex &index : functionList->selectionModel()->selectedIndexes())
     {
-        QListWidgetFunctionItem *functionItem = static_cast<QListWidgetFunctionItem *>(functionList->item(i));
-        
-        if (functionItem->isSelected())
-        {
-            renderArea->select(functionItem->getPlotterIndex());
-        }
+        renderArea->select(functionListModel->getPlotterIndex(index.row()));
     }
 }
 
@@ -245,16 +427,8 @@ void MainWindow::keyPressEvent(QKeyEvent *event)
     {
         Plotter::size_type removedFunctionIndex = renderArea->removeSelectedFunction();
         if (removedFunctionIndex != Plotter::npos)
-        {
-            for (int i = static_cast<int>(removedFunctionIndex+1); i < functionList->count(); ++i)
-            {
-                QListWidgetFunctionItem *functionItem = static_cast<QListWidgetFunctionItem *>(functionList->item(i));
-            
-                functionItem->setPlotterIndex(functionItem->getPlotterIndex() - 1);
-                functionItem->setColor(renderArea->FUNCTION_COLORS[(i - 1) % renderArea->FUNCTION_COLORS.size()]);
-            }
-            
-            delete functionList->takeItem(static_cast<int>(removedFunctionIndex));
+        { // The other rows keep their indices and colors
+            functionListModel->removeExpression(functionListModel->findRow(removedFunctionIndex));
         }
     }
     
@@ -11,10 +11,15 @@
 
 #include "RenderArea.h"
 #include "HelpWindow.h"
+#include "ParameterSlider.h"
+#include "FunctionListModel.h"
 
 #include <QWidget>
-#include <QListWidget>
+#include <QListView>
 #include <QLineEdit>
+#include <QVBoxLayout>
+#include <map>
+#include <string>
 
 class MainWindow
     : public QWidget
@@ -32,9 +37,21 @@ public slots:
     void setMoveTool();
     void setSelectionTool();
     void setZoomTool();
+    void setIntegrationTool();
     
-    void expressionChanged(QListWidgetItem *item);
+    void expressionEdited(int row, const QString &text);
+    void expressionToggled(int row, bool enabled);
     void expressionSelectionChanged();
+    void parameterChanged(const QString &name, double value);
+    void animationStarted(const QString &name, double value, double from, double to, int numValues);
+    void animationStopped(const QString &name);
+    void parameterAnimated(const QString &name, double value);
+    void curveClicked(int expressionIndex);
+    void loadDataSeries();
+#ifdef Q_OS_UNIX
+    void streamFromInput();
+    void streamFromSocket();
+#endif
     
     void displayAboutWindow();
     void displayHelpWindow();
@@ -46,7 +63,18 @@ protected:
     void closeEvent(QCloseEvent *event);
     
 private:
-    QListWidget *functionList;
+    // Undefined single letters in new expressions become parameters with a slider
+    void addParameter(const std::string &name);
+    
+#ifdef Q_OS_UNIX
+    // Asks for the number of samples to keep, and starts the stream. An empty path is standard input.
+    void startStream(const std::string &socketPath);
+#endif
+    
+    QListView *functionList;
+    FunctionListModel *functionListModel;
+    QVBoxLayout *parameterLayout;
+    std::map<std::string, ParameterSlider *> parameterSliders;
     RenderArea *renderArea;
     QLineEdit *expressionLineEdit;
     
@@ -12,6 +12,7 @@ QT += core gui
 QT += widgets
 QT += webkit
 QT += webkitwidgets
+QT += concurrent
 
 TARGET = MathGraph
 TEMPLATE = app
@@ -26,8 +27,30 @@ SOURCES +=  Expression.cpp \
             TokenReader.cpp \
             main.cpp \
             real.cpp \
-            QListWidgetFunctionItem.cpp \
-            HelpWindow.cpp
+            FunctionListModel.cpp \
+            HelpWindow.cpp \
+            ThreadPool.cpp \
+            Analyzer.cpp \
+            Integrator.cpp \
+            CumulativeIntegral.cpp \
+            ContourTracer.cpp \
+            CurveSampler.cpp \
+            Heatmap.cpp \
+            DomainColoring.cpp \
+            OdeSolution.cpp \
+            SlopeField.cpp \
+            SurfacePlot.cpp \
+            SurfaceView.cpp \
+            InequalityRegion.cpp \
+            GridCache.cpp \
+            ParameterSlider.cpp \
+            Animation.cpp \
+            SampleBuffer.cpp \
+            PolylineRasterizer.cpp \
+            RangeExtrema.cpp \
+            CurveIndex.cpp \
+            DataSeries.cpp \
+            CurveFitter.cpp
 
 HEADERS  += Expression.h \
             MainWindow.h \
@@ -36,5 +59,36 @@ HEADERS  += Expression.h \
             RenderArea.h \
             TokenReader.h \
             real.h \
-            QListWidgetFunctionItem.h \
-            HelpWindow.h
+            FunctionListModel.h \
+            HelpWindow.h \
+            ThreadPool.h \
+            Analyzer.h \
+            Integrator.h \
+            CumulativeIntegral.h \
+            ContourTracer.h \
+            CurveSampler.h \
+            Heatmap.h \
+            DomainColoring.h \
+            OdeSolution.h \
+            SlopeField.h \
+            SurfacePlot.h \
+            SurfaceView.h \
+            InequalityRegion.h \
+            GridCache.h \
+            ParameterSlider.h \
+            Animation.h \
+            SampleBuffer.h \
+            PolylineRasterizer.h \
+            RangeExtrema.h \
+            CurveIndex.h \
+            DataSeries.h \
+            CurveFitter.h
+
+# Live streams read sockets and standard input with POSIX calls
+unix {
+    SOURCES += SampleRing.cpp \
+               DataStream.cpp
+
+    HEADERS += SampleRing.h \
+               DataStream.h
+}
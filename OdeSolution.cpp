@@ -0,0 +1,151 @@
+//
+//  OdeSolution.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "OdeSolution.h"
+
+#include <algorithm>
+#include <cmath>
+
+OdeSolution::OdeSolution(const Expression &_equation, real _x0, real _y0, real _tolerance)
+    : equation(_equation),
+      x0(_x0),
+      y0(_y0),
+      tolerance(_tolerance),
+      cacheMutex(),
+      cacheTrajectory(),
+      cacheXMin(0),
+      cacheXMax(0),
+      cacheYMin(0),
+      cacheYMax(0),
+      cacheXPixel(0),
+      cacheYPixel(0),
+      cacheVersion(0)
+{
+}
+
+real OdeSolution::getX0() const
+{
+    return x0;
+}
+
+real OdeSolution::getY0() const
+{
+    return y0;
+}
+
+OdeSolution::Trajectory OdeSolution::getTrajectory(real xMin, real xMax, real yMin, real yMax, real xPixel, real yPixel) const
+{
+    std::lock_guard<std::mutex> lock(cacheMutex);
+    
+    // A cached trajectory up to twice as fine is still cheap to draw
+    bool covered = cacheXPixel > 0 && xMin >= cacheXMin && xMax <= cacheXMax && yMin >= cacheYMin && yMax <= cacheYMax &&
+                   cacheXPixel <= xPixel && cacheYPixel <= yPixel && cacheXPixel * 2 >= xPixel && cacheYPixel * 2 >= yPixel;
+    
+    if (!covered || cacheVersion != Expression::getVariablesVersion())
+    {
+        const real width = xMax - xMin;
+        const real height = yMax - yMin;
+        
+        cacheXMin = xMin - width;
+        cacheXMax = xMax + width;
+        cacheYMin = yMin - height;
+        cacheYMax = yMax + height;
+        cacheXPixel = xPixel;
+        cacheYPixel = yPixel;
+        cacheVersion = Expression::getVariablesVersion();
+        
+        Trajectory backward;
+        integrate(cacheXMin, cacheYMin, cacheYMax, xPixel, yPixel, backward);
+        
+        cacheTrajectory.assign(backward.rbegin(), backward.rend());
+        integrate(cacheXMax, cacheYMin, cacheYMax, xPixel, yPixel, cacheTrajectory);
+    }
+    
+    return cacheTrajectory;
+}
+
+void OdeSolution::integrate(real xEnd, real yMin, real yMax, real xPixel, real yPixel, Trajectory &points) const
+{
+    // Dormand-Prince tableau, the last stage is the first stage of the next step
+    static const real c[7] = {0, 1.0L / 5, 3.0L / 10, 4.0L / 5, 8.0L / 9, 1, 1};
+    static const real a[7][6] = {
+        {},
+        {1.0L / 5},
+        {3.0L / 40, 9.0L / 40},
+        {44.0L / 45, -56.0L / 15, 32.0L / 9},
+        {19372.0L / 6561, -25360.0L / 2187, 64448.0L / 6561, -212.0L / 729},
+        {9017.0L / 3168, -355.0L / 33, 46732.0L / 5247, 49.0L / 176, -5103.0L / 18656},
+        {35.0L / 384, 0, 500.0L / 1113, 125.0L / 192, -2187.0L / 6784, 11.0L / 84}
+    };
+    
+    // Difference between the fifth and fourth order weights, gives the error estimate
+    static const real e[7] = {71.0L / 57600, 0, -71.0L / 16695, 71.0L / 1920, -17253.0L / 339200, 22.0L / 525, -1.0L / 40};
+    
+    const real direction = xEnd >= x0 ? 1 : -1;
+    const real maxStep = MAX_STEP_PIXELS * xPixel;
+    const real minStep = std::abs(xEnd - x0) * 1e-12;
+    
+    real x = x0;
+    real y = y0;
+    real h = maxStep;
+    real k[7];
+    
+    k[0] = equation.evaluate(x, y);
+    
+    if (!std::isfinite(k[0]) || y < yMin || y > yMax) return;
+    
+    points.emplace_back(x, y);
+    
+    for (std::size_t step = 0; step != MAX_STEPS && direction * (xEnd - x) > 0; ++step)
+    {
+        h = std::min(h, direction * (xEnd - x));
+        
+        real yNext = y;
+        real error = 0;
+        
+        for (int stage = 1; stage != 7; ++stage)
+        {
+            real yStage = y;
+            for (int j = 0; j != stage; ++j) yStage += direction * h * a[stage][j] * k[j];
+            
+            k[stage] = equation.evaluate(x + direction * c[stage] * h, yStage);
+            
+            if (stage == 6) yNext = yStage;
+        }
+        
+        for (int j = 0; j != 7; ++j) error += e[j] * k[j];
+        error = std::abs(h * error) / (tolerance * (1 + std::max(std::abs(y), std::abs(yNext))));
+        
+        // Steps that are too long on screen are rejected like inaccurate ones
+        real screenLength = std::hypot(h / xPixel, (yNext - y) / yPixel);
+        
+        if (!std::isfinite(yNext) || !std::isfinite(error))
+        {
+            h /= 4;
+        }
+        else if (error > 1 || screenLength > MAX_STEP_PIXELS)
+        {
+            h *= std::max<real>(0.2, std::min<real>(0.9 * std::pow(std::max<real>(error, 1e-10), -0.2), MAX_STEP_PIXELS / screenLength));
+        }
+        else
+        {
+            x += direction * h;
+            y = yNext;
+            k[0] = k[6];
+            
+            points.emplace_back(x, y);
+            
+            if (y < yMin || y > yMax) return;
+            
+            h = std::min(maxStep, h * std::max<real>(0.2, std::min<real>(5, 0.9 * std::pow(std::max<real>(error, 1e-10), -0.2))));
+        }
+        
+        // Too small steps mean a singularity or a vertical tangent
+        if (h < minStep) return;
+    }
+}
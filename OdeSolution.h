@@ -0,0 +1,60 @@
+//
+//  OdeSolution.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__OdeSolution__
+#define __MathGraph__OdeSolution__
+
+#include "real.h"
+#include "Expression.h"
+
+#include <cstddef>
+#include <vector>
+#include <utility>
+#include <mutex>
+
+// The solution of dy/dx = f(x, y) through an initial point, integrated in both directions with the
+// adaptive Dormand-Prince 5(4) method. The step size is limited both by the error tolerance and by
+// the screen resolution, so the curve stays smooth where f is smooth but steep.
+class OdeSolution
+{
+public:
+    typedef std::vector<std::pair<real, real>> Trajectory;
+    
+    OdeSolution(const Expression &_equation, real _x0, real _y0, real _tolerance = 1e-8);
+    
+    real getX0() const;
+    real getY0() const;
+    
+    // Points (x, y) in ascending x that cover the view, which has pixels xPixel by yPixel large. The
+    // solution is integrated a view beyond every side and cached, so panning reuses it until the view
+    // leaves the covered area or is zoomed in.
+    Trajectory getTrajectory(real xMin, real xMax, real yMin, real yMax, real xPixel, real yPixel) const;
+    
+private:
+    // Steps are at most this many pixels long on screen
+    static const int MAX_STEP_PIXELS = 4;
+    
+    // Integration stops after this many steps in each direction
+    static const std::size_t MAX_STEPS = 1 << 16;
+    
+    Expression equation;
+    real x0, y0;
+    real tolerance;
+    
+    mutable std::mutex cacheMutex;
+    mutable Trajectory cacheTrajectory;
+    mutable real cacheXMin, cacheXMax;
+    mutable real cacheYMin, cacheYMax;
+    mutable real cacheXPixel, cacheYPixel;
+    mutable unsigned long cacheVersion;
+    
+    // Appends the points from (x0, y0) towards xEnd, stops early if y leaves [yMin, yMax]
+    void integrate(real xEnd, real yMin, real yMax, real xPixel, real yPixel, Trajectory &points) const;
+};
+
+#endif /* defined(__MathGraph__OdeSolution__) */
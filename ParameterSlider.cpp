@@ -0,0 +1,79 @@
+//
+//  ParameterSlider.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "ParameterSlider.h"
+
+#include <QHBoxLayout>
+#include <cmath>
+
+ParameterSlider::ParameterSlider(const QString &_name, double value, QWidget *_parent)
+    : QWidget(_parent),
+      name(_name),
+      label(new QLabel),
+      slider(new QSlider(Qt::Horizontal)),
+      playButton(new QPushButton("Play"))
+{
+    slider->setRange(-MAX_VALUE * STEPS_PER_UNIT, MAX_VALUE * STEPS_PER_UNIT);
+    slider->setValue(static_cast<int>(std::round(value * STEPS_PER_UNIT)));
+    
+    // Wide enough for "a = -10.0"
+    label->setMinimumWidth(60);
+    label->setText(name + " = " + QString::number(value, 'f', 1));
+    
+    playButton->setCheckable(true);
+    playButton->setToolTip("Sweep " + name + " back and forth");
+    
+    QHBoxLayout *layout = new QHBoxLayout;
+    layout->addWidget(label);
+    layout->addWidget(slider, 1);
+    layout->addWidget(playButton);
+    setLayout(layout);
+    
+    connect(slider, SIGNAL(valueChanged(int)), this, SLOT(sliderMoved(int)));
+    connect(playButton, SIGNAL(toggled(bool)), this, SLOT(playToggled(bool)));
+}
+
+void ParameterSlider::showValue(double value)
+{
+    slider->blockSignals(true);
+    slider->setValue(static_cast<int>(std::round(value * STEPS_PER_UNIT)));
+    slider->blockSignals(false);
+    
+    label->setText(name + " = " + QString::number(value, 'f', 1));
+}
+
+void ParameterSlider::setPlaying(bool playing)
+{
+    playButton->blockSignals(true);
+    playButton->setChecked(playing);
+    playButton->setText(playing ? "Stop" : "Play");
+    playButton->blockSignals(false);
+}
+
+void ParameterSlider::sliderMoved(int position)
+{
+    double value = static_cast<double>(position) / STEPS_PER_UNIT;
+    
+    label->setText(name + " = " + QString::number(value, 'f', 1));
+    
+    emit valueChanged(name, value);
+}
+
+void ParameterSlider::playToggled(bool playing)
+{
+    playButton->setText(playing ? "Stop" : "Play");
+    
+    if (playing)
+    { // One frame per step of the slider
+        emit animationStarted(name, static_cast<double>(slider->value()) / STEPS_PER_UNIT, -MAX_VALUE, MAX_VALUE, 2 * MAX_VALUE * STEPS_PER_UNIT + 1);
+    }
+    else
+    {
+        emit animationStopped(name);
+    }
+}
@@ -0,0 +1,53 @@
+//
+//  ParameterSlider.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__ParameterSlider__
+#define __MathGraph__ParameterSlider__
+
+#include <QWidget>
+#include <QLabel>
+#include <QSlider>
+#include <QPushButton>
+#include <QString>
+
+// A parameter of the expressions, like a in a*sin(x), with its value, a slider to set it and a
+// button that animates it over the range of the slider
+class ParameterSlider : public QWidget
+{
+    Q_OBJECT
+    
+public:
+    ParameterSlider(const QString &_name, double value, QWidget *parent = nullptr);
+    
+    // Moves the slider without emitting valueChanged, while animating
+    void showValue(double value);
+    void setPlaying(bool playing);
+    
+signals:
+    void valueChanged(const QString &name, double value);
+    
+    // numValues values from from to to, including both
+    void animationStarted(const QString &name, double value, double from, double to, int numValues);
+    void animationStopped(const QString &name);
+    
+private slots:
+    void sliderMoved(int position);
+    void playToggled(bool playing);
+    
+private:
+    // The slider goes from -MAX_VALUE to MAX_VALUE in steps of 1 / STEPS_PER_UNIT
+    static const int MAX_VALUE = 10;
+    static const int STEPS_PER_UNIT = 10;
+    
+    QString name;
+    QLabel *label;
+    QSlider *slider;
+    QPushButton *playButton;
+};
+
+#endif /* defined(__MathGraph__ParameterSlider__) */
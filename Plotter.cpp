@@ -7,6 +7,16 @@
 //
 
 #include "Plotter.h"
+#include "Integrator.h"
+#include "ContourTracer.h"
+#include "CurveSampler.h"
+#include "SlopeField.h"
+#include "DataSeries.h"
+#ifdef Q_OS_UNIX
+#include "DataStream.h"
+#endif
+#include "CurveFitter.h"
+#include <algorithm>
 #include <cmath>
 #include <limits>
 
@@ -24,30 +34,68 @@ Plotter::Plotter(int _pixelWidth, int _pixelHeight, real _xMin, real _xMax, real
       yMin(_yMin),
       yMax(_yMax),
       samplingRate(_samplingRate),
-      pixelMarkerGap(_pixelMarkerGap)
+      pixelMarkerGap(_pixelMarkerGap),
+      xMarkerCache(),
+      yMarkerCache(),
+      functionSamples()
 {
     Expression::addVariable("x", 0);
+    Expression::addVariable("y", 0);
 }
 
 Plotter::Plotter(int _pixelWidth, int _pixelHeight) : Plotter(_pixelWidth, _pixelHeight, -10, 10, -10, 10) {}
 
 Plotter::Plotter() : Plotter(0, 0) {}
 
-void Plotter::addExpression(const std::string &expression)
+std::vector<Plotter::size_type> Plotter::addExpression(const std::string &expression)
 {
-    expressions.emplace_back(expression);
-    expressionIsHidden.push_back(false);
+    return addExpression(Expression(expression));
 }
 
-void Plotter::addExpression(const Expression &expression)
+std::vector<Plotter::size_type> Plotter::addExpression(const Expression &expression)
 {
-    expressions.emplace_back(expression);
-    expressionIsHidden.push_back(false);
+    const size_type expressionIndex = freeIndices.empty() ? expressions.size() : *freeIndices.begin();
+    
+    std::vector<std::pair<size_type, Expression>> recompiled;
+    updateDefinitions(expressionIndex, expression, recompiled);
+    
+    if (expressionIndex == expressions.size())
+    {
+        expressions.push_back(expression);
+        expressionIsHidden.push_back(false);
+        solutions.emplace_back();
+        functionSamples.emplace_back();
+    }
+    else
+    {
+        expressions[expressionIndex] = expression;
+        expressionIsHidden[expressionIndex] = false;
+        freeIndices.erase(freeIndices.begin());
+    }
+    
+    return storeRecompiled(expressionIndex, recompiled);
+}
+
+std::vector<Plotter::size_type> Plotter::replaceExpression(size_type expressionIndex, const Expression &expression)
+{
+    std::vector<std::pair<size_type, Expression>> recompiled;
+    updateDefinitions(expressionIndex, expression, recompiled);
+    
+    expressions[expressionIndex] = expression;
+    
+    return storeRecompiled(expressionIndex, recompiled);
 }
 
 void Plotter::removeExpression(size_type expressionIndex)
 {
-    expressions.erase(expressions.begin() + expressionIndex);
+    if (!expressions[expressionIndex].getName().empty()) Expression::undefine(expressions[expressionIndex].getName());
+    
+    // A constant in place of the expression, hidden until the index is used again
+    expressions[expressionIndex] = Expression("0");
+    expressionIsHidden[expressionIndex] = true;
+    solutions[expressionIndex].clear();
+    functionSamples[expressionIndex].reset();
+    freeIndices.insert(expressionIndex);
     
     if (selectedExpression == expressionIndex) selectedExpression = npos;
 }
@@ -69,6 +117,16 @@ void Plotter::setBounds(real _xMin, real _xMax, real _yMin, real _yMax)
     yMax = _yMax;
 }
 
+bool Plotter::scrollTo(real _xMax)
+{
+    if (_xMax == xMax) return false;
+    
+    xMin += _xMax - xMax;
+    xMax = _xMax;
+    
+    return true;
+}
+
 void Plotter::setBounds(int xPixelMin, int xPixelMax, int yPixelMin, int yPixelMax)
 {
     setBounds(xPxToPt(xPixelMin), xPxToPt(xPixelMax), yPxToPt(yPixelMax), yPxToPt(yPixelMin));
@@ -76,31 +134,44 @@ void Plotter::setBounds(int xPixelMin, int xPixelMax, int yPixelMin, int yPixelM
 
 std::pair<real, real> Plotter::getYBounds(size_type expressionIndex) const
 {
-    real newYMin = std::numeric_limits<real>::max();
-    real newYMax = std::numeric_limits<real>::lowest();
+    return getYBounds(expressionIndex, xMin, xMax);
+}
+
+std::pair<real, real> Plotter::getYBounds(size_type expressionIndex, real xFrom, real xTo) const
+{
+    const std::pair<real, real> none(std::numeric_limits<real>::max(), std::numeric_limits<real>::lowest());
     
     const Expression &currentExpression = expressions[expressionIndex];
     
-    real step = (xMax - xMin) * samplingRate / pixelWidth;
-    real y;
-    for (real x = xMin; x < xMax + step; x += step)
+    // Only functions of x have y values of their own, curves do not affect the bounds
+    if (currentExpression.getKind() != Expression::FUNCTION) return none;
+    
+    real step;
+    long long first;
+    std::size_t count;
+    getSampleGrid(step, first, count, currentExpression.getPeriod());
+    
+    if (count == 0) return none;
+    
+    std::shared_ptr<const FunctionSamples> samples = functionSamples[expressionIndex];
+    
+    // The view moved past the samples, or a variable changed since they were taken
+    if (samples == nullptr || samples->step != step || samples->version != Expression::getVariablesVersion() ||
+        first < samples->first || first + static_cast<long long>(count) > samples->first + static_cast<long long>(samples->extrema.size()))
     {
-        Expression::setVariable("x", x);
-        y = currentExpression.evaluate();
-        
-        if (y < newYMin)
-        {
-            newYMin = y;
-        }
-        
-        if (y > newYMax)
-        {
-            newYMax = y;
-        }
+        std::vector<real> ys(count);
+        currentExpression.evaluateGrid(step, first, count, ys.data());
         
+        storeFunctionSamples(expressionIndex, step, first, ys);
+        samples = functionSamples[expressionIndex];
     }
     
-    return std::pair<real, real>(newYMin, newYMax);
+    const long long from = std::max(first, static_cast<long long>(std::ceil(std::max(xFrom, xMin) / step)));
+    const long long to = std::min(first + static_cast<long long>(count) - 1, static_cast<long long>(std::floor(std::min(xTo, xMax) / step)));
+    
+    if (from > to) return none;
+    
+    return samples->extrema.get(static_cast<std::size_t>(from - samples->first), static_cast<std::size_t>(to - samples->first));
 }
 
 void Plotter::autoYBounds(size_type expressionIndex)
@@ -211,41 +282,70 @@ Point<int> Plotter::getOrigo() const
     return Point<int>(xPtToPx(0), yPtToPx(0));
 }
 
-std::vector<std::pair<int, std::string>> Plotter::getXMarkers() const
+Point<int> Plotter::ptToPx(real x, real y) const
 {
-    std::vector<std::pair<int, std::string>> markers;
-    
-    real step = pixelMarkerGap * (xMax - xMin) / pixelWidth;
-    step = real_functions::round(step, static_cast<int>(real_functions::floor(real_functions::log10(step))));
-    
-    real start = std::ceil(xMin / step) * step;
+    return Point<int>(xPtToPx(x), yPtToPx(y));
+}
+
+Point<real> Plotter::pxToPt(real x, real y) const
+{
+    return Point<real>(xPxToPt(x), yPxToPt(y));
+}
+
+const std::vector<std::pair<int, std::string>> &Plotter::getXMarkers() const
+{
+    updateMarkers(false, xMarkerCache);
     
-    real pixelsPerPoint = pixelWidth / (xMax - xMin);
-    for (real x = start; x <= xMax; x += step)
-    {
-        if (x != 0) markers.emplace_back(xPtToPx(x, pixelsPerPoint), real_functions::toString(x));
-    }
+    return xMarkerCache.markers;
+}
+
+const std::vector<std::pair<int, std::string>> &Plotter::getYMarkers() const
+{
+    updateMarkers(true, yMarkerCache);
     
-    return markers;
+    return yMarkerCache.markers;
 }
 
-std::vector<std::pair<int, std::string>> Plotter::getYMarkers() const
+void Plotter::updateMarkers(bool vertical, MarkerCache &cache) const
 {
-    std::vector<std::pair<int, std::string>> markers;
+    const real min = vertical ? yMin : xMin;
+    const real max = vertical ? yMax : xMax;
+    const int pixels = vertical ? pixelHeight : pixelWidth;
+    
+    if (cache.min == min && cache.max == max && cache.pixels == pixels) return;
     
-    real step = pixelMarkerGap * (yMax - yMin) / pixelHeight;
-    step = real_functions::round(step, static_cast<int>(real_functions::floor(real_functions::log10(step))));
+    cache.min = min;
+    cache.max = max;
+    cache.pixels = pixels;
+    cache.markers.clear();
     
-    real start = std::ceil(yMin / step) * step;
+    // One digit times a power of ten, rounded down
+    const real rawStep = pixelMarkerGap * (max - min) / pixels;
+    if (!(rawStep > 0) || !std::isfinite(rawStep)) return;
     
-    real yDiff = yMax - yMin;
-    real pixelsPerPoint = pixelHeight / yDiff;
-    for (real y = start; y <= yMax; y += step)
+    const int exponent = static_cast<int>(real_functions::floor(real_functions::log10(rawStep)));
+    const real power = real_functions::pow(10, exponent);
+    const long long digit = std::max(1LL, static_cast<long long>(rawStep / power));
+    const real step = digit * power;
+    
+    // Too far from 0 for the markers to differ
+    const real first = std::ceil(min / step);
+    if (real_functions::abs(first) > 1e15) return;
+    
+    // Markers are whole multiples of the step, so the values are made from integers and not by
+    // adding up steps, which keeps them exact enough for short labels
+    const double scale = std::pow(10.0, std::abs(exponent));
+    const real pixelsPerPoint = pixels / (max - min);
+    
+    for (long long n = static_cast<long long>(first); n * step <= max; ++n)
     {
-        if (y != 0) markers.emplace_back(yPtToPx(y, pixelsPerPoint, yDiff), real_functions::toString(y));
+        if (n == 0) continue;
+        
+        const double value = exponent >= 0 ? static_cast<double>(n * digit) * scale : static_cast<double>(n * digit) / scale;
+        const int position = vertical ? yPtToPx(value, pixelsPerPoint, max - min) : xPtToPx(value, pixelsPerPoint);
+        
+        cache.markers.emplace_back(position, real_functions::toShortString(value));
     }
-    
-    return markers;
 }
 
 Plotter::size_type Plotter::numExpressions() const
@@ -278,42 +378,349 @@ bool Plotter::isSelected(size_type expressionIndex) const
     return expressionIndex == selectedExpression;
 }
 
-std::vector<Point<int>> Plotter::getPlotSamples(Plotter::size_type expressionIndex) const
+void Plotter::getPlotSamples(Plotter::size_type expressionIndex, SampleBuffer &samples) const
 {
-    std::vector<Point<int>> result;
+    samples.clear();
+    
+    const Expression &currentExpression = expressions[expressionIndex];
+    
+    real step;
+    long long first;
+    std::size_t count;
+    getSampleGrid(step, first, count, currentExpression.getPeriod());
+    
+    std::vector<real> xs(count);
+    std::vector<real> ys(count);
+    currentExpression.evaluateGrid(step, first, count, ys.data());
     
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        xs[i] = (first + static_cast<long long>(i)) * step;
+    }
+    
+    addSamples(xs.data(), ys.data(), count, samples);
+}
+
+void Plotter::getPlotPaths(size_type expressionIndex, SampleBuffer &paths) const
+{
+    paths.clear();
+    
+    const Expression &currentExpression = expressions[expressionIndex];
+    
+    switch (currentExpression.getKind())
+    {
+        case Expression::IMPLICIT:
+        {
+            ContourTracer tracer(currentExpression, xMin, xMax, yMin, yMax, pixelWidth, pixelHeight, samplingRate);
+            
+            tracer.trace(paths);
+            break;
+        }
+        case Expression::PARAMETRIC:
+        case Expression::POLAR:
+        {
+            CurveSampler sampler(currentExpression, xMin, xMax, yMin, yMax, pixelWidth, pixelHeight, samplingRate);
+            
+            sampler.sample(paths);
+            break;
+        }
+        case Expression::SURFACE:
+        {
+            ContourTracer tracer(currentExpression, xMin, xMax, yMin, yMax, pixelWidth, pixelHeight, samplingRate, getHeatmap(expressionIndex).getContourLevels());
+            
+            tracer.trace(paths);
+            break;
+        }
+        case Expression::COMPLEX:
+            break;
+        case Expression::DIFFERENTIAL:
+        {
+            SlopeField field(currentExpression, xMin, xMax, yMin, yMax, pixelWidth, pixelHeight);
+            field.getSegments(paths);
+            
+            real xPixel = (xMax - xMin) / pixelWidth;
+            real yPixel = (yMax - yMin) / pixelHeight;
+            
+            for (const std::shared_ptr<const OdeSolution> &solution : solutions[expressionIndex])
+            {
+                std::vector<std::pair<real, real>> trajectory = solution->getTrajectory(xMin, xMax, yMin, yMax, xPixel, yPixel);
+                std::vector<real> xs(trajectory.size());
+                std::vector<real> ys(trajectory.size());
+                
+                for (std::vector<std::pair<real, real>>::size_type i = 0; i != trajectory.size(); ++i)
+                {
+                    xs[i] = trajectory[i].first;
+                    ys[i] = trajectory[i].second;
+                }
+                
+                paths.breakPath();
+                addSamples(xs.data(), ys.data(), xs.size(), paths);
+            }
+            break;
+        }
+        case Expression::INEQUALITY:
+            getRegion(expressionIndex).getBoundaries(paths);
+            break;
+        default:
+            getFunctionPaths(expressionIndex, paths);
+            break;
+    }
+}
+
+void Plotter::getFunctionPaths(size_type expressionIndex, SampleBuffer &paths) const
+{
     const Expression &currentExpression = expressions[expressionIndex];
     
-    real xDiff = xMax - xMin;
-    real yDiff = yMax - yMin;
-    real xPixelsPerPoint = pixelWidth / xDiff;
-    real yPixelsPerPoint = pixelHeight / yDiff;
+    real xPixelsPerPoint = pixelWidth / (xMax - xMin);
+    real yPixelsPerPoint = pixelHeight / (yMax - yMin);
+    
+    real step;
+    long long first;
+    std::size_t count;
+    getSampleGrid(step, first, count, currentExpression.getPeriod());
+    
+    std::vector<real> xs(count);
+    std::vector<real> ys(count);
+    currentExpression.evaluateGrid(step, first, count, ys.data());
+    
+    storeFunctionSamples(expressionIndex, step, first, ys);
+    
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        xs[i] = (first + static_cast<long long>(i)) * step;
+    }
+    
+    // Bisect the steep steps towards the larger change, all of them as one batch per round.
+    // Where the function is continuous the change shrinks with the step, at a jump it does not.
+    std::vector<std::size_t> steep;
+    for (std::size_t i = 0; i + 1 < count; ++i)
+    {
+        if (std::isfinite(ys[i]) && std::isfinite(ys[i + 1]) && std::abs(ys[i + 1] - ys[i]) * yPixelsPerPoint > MIN_JUMP_PIXELS) steep.push_back(i);
+    }
+    
+    std::vector<real> left(steep.size());
+    std::vector<real> right(steep.size());
+    std::vector<real> leftY(steep.size());
+    std::vector<real> rightY(steep.size());
+    
+    for (std::size_t k = 0; k != steep.size(); ++k)
+    {
+        left[k] = xs[steep[k]];
+        right[k] = xs[steep[k] + 1];
+        leftY[k] = ys[steep[k]];
+        rightY[k] = ys[steep[k] + 1];
+    }
+    
+    // Steps that shrink below a pixel are continuous and are dropped from the batch
+    std::vector<std::size_t> active;
+    for (std::size_t k = 0; k != steep.size(); ++k) active.push_back(k);
+    
+    std::vector<real> middle;
+    std::vector<real> middleY;
+    
+    for (int round = 0; round != JUMP_ROUNDS && !active.empty(); ++round)
+    {
+        middle.resize(active.size());
+        middleY.resize(active.size());
+        
+        for (std::size_t j = 0; j != active.size(); ++j)
+        {
+            middle[j] = (left[active[j]] + right[active[j]]) / 2;
+        }
+        
+        currentExpression.evaluate(middle.data(), middleY.data(), middle.size());
+        
+        std::size_t remaining = 0;
+        for (std::size_t j = 0; j != active.size(); ++j)
+        {
+            const std::size_t k = active[j];
+            
+            if (std::abs(middleY[j] - leftY[k]) > std::abs(rightY[k] - middleY[j]))
+            {
+                right[k] = middle[j];
+                rightY[k] = middleY[j];
+            }
+            else
+            {
+                left[k] = middle[j];
+                leftY[k] = middleY[j];
+            }
+            
+            // Undefined points in between are kept, they break the path like a jump
+            if (!(std::abs(rightY[k] - leftY[k]) * yPixelsPerPoint < 1)) active[remaining++] = k;
+        }
+        
+        active.resize(remaining);
+    }
+    
+    std::vector<std::size_t> jumps;
+    for (std::size_t k : active)
+    {
+        const std::size_t i = steep[k];
+        
+        if (!(std::abs(rightY[k] - leftY[k]) < std::abs(ys[i + 1] - ys[i]) / 2)) jumps.push_back(k);
+    }
+    
+    // All samples are moved to the viewport at once, the ends of the jumps with them
+    std::vector<float> pixelX(count + 2 * steep.size());
+    std::vector<float> pixelY(pixelX.size());
+    SampleBuffer::toPixels(xs.data(), count, xMin, xPixelsPerPoint, pixelX.data());
+    SampleBuffer::toPixels(ys.data(), count, yMax, -yPixelsPerPoint, pixelY.data());
+    SampleBuffer::toPixels(left.data(), steep.size(), xMin, xPixelsPerPoint, pixelX.data() + count);
+    SampleBuffer::toPixels(leftY.data(), steep.size(), yMax, -yPixelsPerPoint, pixelY.data() + count);
+    SampleBuffer::toPixels(right.data(), steep.size(), xMin, xPixelsPerPoint, pixelX.data() + count + steep.size());
+    SampleBuffer::toPixels(rightY.data(), steep.size(), yMax, -yPixelsPerPoint, pixelY.data() + count + steep.size());
     
-    real step = xDiff * samplingRate / pixelWidth;
-    real y;
-    for (real x = xMin; x < xMax + step; x += step)
+    // Break the path where the function is undefined and at the jumps, which are continued up to
+    // the ends of their last bisection
+    paths.reserve(count + 2 * jumps.size());
+    std::vector<std::size_t>::size_type nextJump = 0;
+    
+    for (std::size_t i = 0; i != count; ++i)
     {
-        Expression::setVariable("x", x);
-        y = currentExpression.evaluate();
+        if (!std::isfinite(ys[i]))
+        {
+            paths.breakPath();
+            continue;
+        }
+        
+        paths.add(pixelX[i], pixelY[i]);
         
-        result.emplace_back(xPtToPx(x, xPixelsPerPoint), yPtToPx(y, yPixelsPerPoint, yDiff));
+        if (nextJump != jumps.size() && steep[jumps[nextJump]] == i)
+        {
+            const std::size_t k = jumps[nextJump++];
+            
+            if (std::isfinite(leftY[k])) paths.add(pixelX[count + k], pixelY[count + k]);
+            paths.breakPath();
+            if (std::isfinite(rightY[k])) paths.add(pixelX[count + steep.size() + k], pixelY[count + steep.size() + k]);
+        }
     }
+}
+
+void Plotter::getDataPaths(const DataSeries &series, SampleBuffer &paths) const
+{
+    std::vector<real> xs;
+    std::vector<real> ys;
+    series.sample(xMin, xMax, static_cast<DataSeries::size_type>(pixelWidth) * DATA_POINTS_PER_PIXEL, xs, ys);
     
-    return result;
+    getPointPaths(xs, ys, paths);
+}
+
+#ifdef Q_OS_UNIX
+void Plotter::getStreamPaths(const DataStream &stream, SampleBuffer &paths) const
+{
+    std::vector<real> xs;
+    std::vector<real> ys;
+    stream.decimate(xMin, xMax, pixelWidth, xs, ys);
+    
+    getPointPaths(xs, ys, paths);
+}
+#endif
+
+void Plotter::getPointPaths(const std::vector<real> &xs, const std::vector<real> &ys, SampleBuffer &paths) const
+{
+    std::vector<float> pixelX(xs.size());
+    std::vector<float> pixelY(ys.size());
+    SampleBuffer::toPixels(xs.data(), xs.size(), xMin, pixelWidth / (xMax - xMin), pixelX.data());
+    SampleBuffer::toPixels(ys.data(), ys.size(), yMax, -pixelHeight / (yMax - yMin), pixelY.data());
+    
+    paths.clear();
+    paths.reserve(xs.size());
+    
+    for (std::vector<float>::size_type i = 0; i != pixelX.size(); ++i)
+    {
+        paths.add(pixelX[i], pixelY[i]);
+    }
+}
+
+Heatmap Plotter::getHeatmap(size_type expressionIndex) const
+{
+    return Heatmap(expressions[expressionIndex].bindVariables(), xMin, xMax, yMin, yMax, pixelWidth, pixelHeight);
+}
+
+DomainColoring Plotter::getDomainColoring(size_type expressionIndex) const
+{
+    return DomainColoring(expressions[expressionIndex].bindVariables(), xMin, xMax, yMin, yMax, pixelWidth, pixelHeight);
+}
+
+InequalityRegion Plotter::getRegion(size_type expressionIndex) const
+{
+    real xPixelsPerPoint = pixelWidth / (xMax - xMin);
+    real yPixelsPerPoint = pixelHeight / (yMax - yMin);
+    
+    real step;
+    long long first;
+    std::size_t count;
+    getSampleGrid(step, first, count);
+    
+    std::vector<real> xs(count);
+    std::vector<real> lower(count);
+    std::vector<real> upper(count);
+    expressions[expressionIndex].evaluateBounds(step, first, count, lower.data(), upper.data());
+    
+    // To pixels, without rounding so the spans can be interpolated between the samples
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        xs[i] = xPixelsPerPoint * ((first + static_cast<long long>(i)) * step - xMin);
+        lower[i] = yPixelsPerPoint * (yMax - lower[i]);
+        upper[i] = yPixelsPerPoint * (yMax - upper[i]);
+    }
+    
+    return InequalityRegion(xs, upper, lower, pixelWidth, pixelHeight);
+}
+
+void Plotter::getPlotSamples(size_type expressionIndex, real xFrom, real xTo, SampleBuffer &samples) const
+{
+    samples.clear();
+    
+    real step = (xMax - xMin) * samplingRate / pixelWidth;
+    
+    std::vector<real> xs;
+    for (real x = xFrom; x < xTo; x += step)
+    {
+        xs.push_back(x);
+    }
+    
+    // End exactly at the end of the interval
+    xs.push_back(xTo);
+    
+    std::vector<real> ys(xs.size());
+    expressions[expressionIndex].evaluate(xs.data(), ys.data(), xs.size());
+    
+    addSamples(xs.data(), ys.data(), xs.size(), samples);
+}
+
+void Plotter::addSamples(const real *xs, const real *ys, std::size_t count, SampleBuffer &samples) const
+{
+    const SampleBuffer::size_type offset = samples.size();
+    std::vector<float> pixelX(count);
+    std::vector<float> pixelY(count);
+    
+    SampleBuffer::toPixels(xs, count, xMin, pixelWidth / (xMax - xMin), pixelX.data());
+    SampleBuffer::toPixels(ys, count, yMax, -(pixelHeight / (yMax - yMin)), pixelY.data());
+    
+    samples.reserve(offset + count);
+    
+    for (std::size_t i = 0; i != count; ++i)
+    { // Undefined points are left out
+        if (!std::isnan(pixelX[i]) && !std::isnan(pixelY[i])) samples.add(pixelX[i], pixelY[i]);
+    }
 }
 
 std::pair<Point<int>, Point<std::string>> Plotter::getPointFromSelected(int x) const
 {
     if (selectedExpression == npos)
     {
-        throw InvalidSelection("No expression selected");
+        throw InvalidSelection("No function is selected.");
+    }
+    else if (expressions[selectedExpression].getKind() != Expression::FUNCTION)
+    {
+        throw InvalidSelection("The selected function is not a function of x.");
     }
     else
     {
         real real_x = xPxToPt(x);
-        Expression::setVariable("x", real_x);
-        
-        real real_y = expressions[selectedExpression].evaluate();
+        real real_y = expressions[selectedExpression].evaluate(real_x);
         
         int y = yPtToPx(real_y);
         
@@ -327,6 +734,148 @@ std::pair<Point<int>, Point<std::string>> Plotter::getPointFromSelected(int x) c
     }
 }
 
+void Plotter::addSolutionToSelected(int x, int y)
+{
+    if (selectedExpression == npos)
+    {
+        throw InvalidSelection("No function is selected.");
+    }
+    else if (expressions[selectedExpression].getKind() != Expression::DIFFERENTIAL)
+    {
+        throw InvalidSelection("The selected function is not a differential equation.");
+    }
+    else
+    {
+        solutions[selectedExpression].push_back(std::make_shared<const OdeSolution>(expressions[selectedExpression], xPxToPt(x), yPxToPt(y)));
+    }
+}
+
+void Plotter::clearSolutionsOfSelected()
+{
+    if (selectedExpression == npos)
+    {
+        throw InvalidSelection("No function is selected.");
+    }
+    else
+    {
+        solutions[selectedExpression].clear();
+    }
+}
+
+SurfacePlot Plotter::getSurfacePlotFromSelected(int resolution) const
+{
+    if (selectedExpression == npos)
+    {
+        throw InvalidSelection("No function is selected.");
+    }
+    else if (expressions[selectedExpression].getKind() != Expression::SURFACE)
+    {
+        throw InvalidSelection("The selected function is not a surface z = f(x, y).");
+    }
+    
+    return SurfacePlot(expressions[selectedExpression], xMin, xMax, yMin, yMax, resolution);
+}
+
+std::pair<real, real> Plotter::getIntegralFromSelected(real xFrom, real xTo, real tolerance) const
+{
+    if (selectedExpression == npos)
+    {
+        throw InvalidSelection("No function is selected.");
+    }
+    else if (expressions[selectedExpression].getKind() != Expression::FUNCTION)
+    {
+        throw InvalidSelection("The selected function is not a function of x.");
+    }
+    
+    Integrator integrator(expressions[selectedExpression], tolerance);
+    
+    return integrator.integrate(xFrom, xTo);
+}
+
+FitResult Plotter::fitSelectedToData(const DataSeries &series) const
+{
+    if (selectedExpression == npos)
+    {
+        throw InvalidSelection("No function is selected.");
+    }
+    
+    const Expression &expression = expressions[selectedExpression];
+    
+    if (expression.getKind() != Expression::FUNCTION)
+    {
+        throw InvalidSelection("The selected function is not a function of x.");
+    }
+    else if (!expression.isDifferentiable())
+    {
+        throw InvalidSelection("The selected function has no known derivative.");
+    }
+    
+    std::vector<std::string> parameters = expression.getVariablesRead();
+    
+    if (parameters.empty())
+    {
+        throw InvalidSelection("The selected function has no parameters to fit.");
+    }
+    
+    CurveFitter fitter(expression, parameters);
+    
+    return fitter.fit(series.getX(), series.getY(), series.size());
+}
+
+Plotter Plotter::bindVariable(const std::string &name, real value) const
+{
+    Plotter bound(*this);
+    
+    for (size_type i = 0; i != bound.expressions.size(); ++i)
+    {
+        if (!expressions[i].readsVariable(name)) continue;
+        
+        bound.expressions[i] = expressions[i].bindVariable(name, value);
+        bound.functionSamples[i].reset();
+        
+        for (std::shared_ptr<const OdeSolution> &solution : bound.solutions[i])
+        {
+            solution = std::make_shared<const OdeSolution>(bound.expressions[i], solution->getX0(), solution->getY0());
+        }
+    }
+    
+    return bound;
+}
+
+Plotter Plotter::bindVariables(const std::string &keptName) const
+{
+    Plotter bound(*this);
+    
+    for (size_type i = 0; i != bound.expressions.size(); ++i)
+    {
+        std::vector<std::string> names = expressions[i].getVariablesRead();
+        
+        if (names.empty() || (names.size() == 1 && names[0] == keptName)) continue;
+        
+        // The values are the same, so the cached samples still hold
+        bound.expressions[i] = expressions[i].bindVariables(keptName);
+        
+        for (std::shared_ptr<const OdeSolution> &solution : bound.solutions[i])
+        {
+            solution = std::make_shared<const OdeSolution>(bound.expressions[i], solution->getX0(), solution->getY0());
+        }
+    }
+    
+    return bound;
+}
+
+Analyzer Plotter::getAnalyzer() const
+{
+    Analyzer analyzer(xMin, xMax, (xMax - xMin) * samplingRate / pixelWidth);
+    
+    for (size_type i = 0; i != expressions.size(); ++i)
+    {
+        if (!expressionIsHidden[i] && expressions[i].getKind() == Expression::FUNCTION) analyzer.addExpression(i, expressions[i].bindVariables());
+    }
+    
+    return analyzer;
+}
+
 Plotter::const_iterator Plotter::cbegin() const
 {
     return expressions.cbegin();
@@ -337,6 +886,111 @@ Plotter::const_iterator Plotter::cend() const
     return expressions.cend();
 }
 
+void Plotter::updateDefinitions(size_type expressionIndex, const Expression &expression, std::vector<std::pair<size_type, Expression>> &recompiled) const
+{
+    const std::string oldName = expressionIndex < expressions.size() ? expressions[expressionIndex].getName() : "";
+    const std::string newName = expression.getName();
+    const std::string::size_type length = expression.getSource().length();
+    
+    if (!newName.empty() && newName != oldName && Expression::isDefined(newName))
+        throw InvalidExpression(newName + " is already defined", InvalidExpression::INVALID_ARGUMENT, 0, length);
+    
+    // Every caller of a definition also calls the definitions it calls, so sorting by the number of
+    // dependencies recompiles definitions before the expressions calling them
+    std::vector<size_type> callers;
+    if (!oldName.empty() || !newName.empty())
+    {
+        for (size_type i = 0; i != expressions.size(); ++i)
+        {
+            if (i != expressionIndex && ((!oldName.empty() && expressions[i].calls(oldName)) || (!newName.empty() && expressions[i].calls(newName))))
+                callers.push_back(i);
+        }
+    }
+    
+    std::stable_sort(callers.begin(), callers.end(), [this](size_type a, size_type b)
+    {
+        return expressions[a].getDependencies().size() < expressions[b].getDependencies().size();
+    });
+    
+    if (!oldName.empty()) Expression::undefine(oldName);
+    if (!newName.empty()) Expression::define(expression);
+    
+    try
+    {
+        for (size_type i : callers)
+        {
+            try
+            {
+                recompiled.emplace_back(i, Expression(expressions[i].getSource()));
+            }
+            catch (const InvalidExpression &e)
+            { // Reported for the new expression, the caller is not where the user is typing
+                throw InvalidExpression(expressions[i].getSource() + ": " + e.what(), e.getError(), 0, length);
+            }
+            
+            if (!recompiled.back().second.getName().empty()) Expression::define(recompiled.back().second);
+        }
+    }
+    catch (const InvalidExpression &)
+    { // Put the definitions back as they were
+        if (!newName.empty()) Expression::undefine(newName);
+        
+        for (const std::pair<size_type, Expression> &caller : recompiled)
+        {
+            if (!caller.second.getName().empty()) Expression::undefine(caller.second.getName());
+        }
+        
+        for (const Expression &current : expressions)
+        {
+            if (!current.getName().empty()) Expression::define(current);
+        }
+        
+        recompiled.clear();
+        throw;
+    }
+}
+
+std::vector<Plotter::size_type> Plotter::storeRecompiled(size_type expressionIndex, std::vector<std::pair<size_type, Expression>> &recompiled)
+{
+    std::vector<size_type> changed(1, expressionIndex);
+    
+    for (std::pair<size_type, Expression> &caller : recompiled)
+    {
+        expressions[caller.first] = std::move(caller.second);
+        changed.push_back(caller.first);
+    }
+    
+    for (size_type i : changed)
+    {
+        solutions[i].clear();
+        functionSamples[i].reset();
+    }
+    
+    return changed;
+}
+
+void Plotter::storeFunctionSamples(size_type expressionIndex, real step, long long first, const std::vector<real> &ys) const
+{
+    functionSamples[expressionIndex] = std::make_shared<const FunctionSamples>(FunctionSamples{step, first, Expression::getVariablesVersion(), RangeExtrema(ys.data(), ys.size())});
+}
+
+void Plotter::getSampleGrid(real &step, long long &first, std::size_t &count, real period) const
+{
+    step = (xMax - xMin) * samplingRate / pixelWidth;
+    
+    // evaluateGrid then evaluates one period and copies it
+    if (period / step >= MIN_PERIOD_SAMPLES) step = period / std::ceil(period / step);
+    
+    first = 0;
+    count = 0;
+    
+    if (pixelWidth > 0 && step > 0)
+    {
+        first = static_cast<long long>(std::floor(xMin / step));
+        count = static_cast<std::size_t>(static_cast<long long>(std::ceil(xMax / step)) - first) + 1;
+    }
+}
+
 int Plotter::xPtToPx(real x) const
 {
     return static_cast<int>(pixelWidth * (x - xMin) / (xMax - xMin));
@@ -357,7 +1011,7 @@ int Plotter::yPtToPx(real y, real pixelsPerPoint, real yDiff) const
     return static_cast<int>(pixelsPerPoint * (yDiff - (y - yMin)));
 }
 
-real Plotter::xPxToPt(int x) const
+real Plotter::xPxToPt(real x) const
 {
     return x * (xMax - xMin) / pixelWidth + xMin;
 }
@@ -367,7 +1021,7 @@ real Plotter::xPxToPt(int x, real pointsPerPixel) const
     return x * pointsPerPixel + xMin;
 }
 
-real Plotter::yPxToPt(int y) const
+real Plotter::yPxToPt(real y) const
 {
     return (pixelHeight - y) * (yMax - yMin) / pixelHeight + yMin;
 }
@@ -12,9 +12,23 @@
 #include "real.h"
 #include "Expression.h"
 #include "Point.h"
+#include "Analyzer.h"
+#include "Heatmap.h"
+#include "DomainColoring.h"
+#include "OdeSolution.h"
+#include "SurfacePlot.h"
+#include "InequalityRegion.h"
+#include "SampleBuffer.h"
+#include "RangeExtrema.h"
 
 #include <vector>
+#include <set>
 #include <utility>
+#include <memory>
+
+class DataSeries;
+class DataStream;
+struct FitResult;
 
 class InvalidSelection : public std::logic_error
 {
@@ -33,13 +47,28 @@ public:
     Plotter(int _pixelWidth, int _pixelHeight);
     Plotter();
     
-    void addExpression(const std::string &expression);
-    void addExpression(const Expression &expression);
+    // A definition f(x) = ... can be called from the expressions added after it. Adding or replacing
+    // one recompiles the expressions that call it, add and replace return the indices of all expressions
+    // that changed, the new one first. Removing one leaves its copies in the callers, and leaves its
+    // index empty and hidden so that no other index changes, until a new expression is added at the
+    // lowest such index. May throw InvalidExpression, for example when a name is defined twice or a
+    // caller no longer compiles, then nothing is changed.
+    std::vector<size_type> addExpression(const std::string &expression);
+    std::vector<size_type> addExpression(const Expression &expression);
+    std::vector<size_type> replaceExpression(size_type expressionIndex, const Expression &expression);
     void removeExpression(size_type expressionIndex);
     
     void centerOrigo();
     void setBounds(real _xMin, real _xMax, real _yMin, real _yMax);
+    
+    // Moves the view sideways so that its right edge is at _xMax, false if it already was
+    bool scrollTo(real _xMax);
+    
+    // Smallest and largest value of a function over the view, or over [xFrom, xTo] within the view. The
+    // samples of the last plot are looked up in its range index if they are still valid, otherwise the
+    // function is sampled again. (max(), lowest()) for curves, which have no y values of their own.
     std::pair<real, real> getYBounds(size_type expressionIndex) const;
+    std::pair<real, real> getYBounds(size_type expressionIndex, real xFrom, real xTo) const;
     void autoYBounds(size_type expressionIndex);
     void setBounds(int xPixelMin, int xPixelMax, int yPixelMin, int yPixelMax);
     void setSamplingRate(real _samplingRate);
@@ -49,8 +78,12 @@ public:
     void zoom(int steps, int x = -1, int y = -1);
     
     Point<int> getOrigo() const;
-    std::vector<std::pair<int, std::string>> getXMarkers() const;
-    std::vector<std::pair<int, std::string>> getYMarkers() const;
+    Point<int> ptToPx(real x, real y) const;
+    Point<real> pxToPt(real x, real y) const;
+    
+    // Positions and labels of the markers on the axes, kept until the view changes
+    const std::vector<std::pair<int, std::string>> &getXMarkers() const;
+    const std::vector<std::pair<int, std::string>> &getYMarkers() const;
     
     size_type numExpressions() const;
     void setHidden(size_type expressionIndex, bool hidden);
@@ -58,8 +91,53 @@ public:
     void select(size_type expressionIndex);
     void clearSelection();
     bool isSelected(size_type expressionIndex) const;
-    std::vector<Point<int>> getPlotSamples(size_type expressionIndex) const;
+    
+    // The samples replace the contents of the buffer, whose memory is reused
+    void getPlotSamples(size_type expressionIndex, SampleBuffer &samples) const;
+    
+    // One path for y = f(x), curves may consist of any number of paths. Surfaces are drawn
+    // as their contour lines, on top of the heatmap. Complex functions have no paths.
+    // Differential equations are drawn as a slope field and their solution curves.
+    // Inequalities are drawn as their bounds, getRegion gives the region between them.
+    // The paths replace the contents of the buffer.
+    void getPlotPaths(size_type expressionIndex, SampleBuffer &paths) const;
+    Heatmap getHeatmap(size_type expressionIndex) const;
+    DomainColoring getDomainColoring(size_type expressionIndex) const;
+    InequalityRegion getRegion(size_type expressionIndex) const;
+    void getPlotSamples(size_type expressionIndex, real xFrom, real xTo, SampleBuffer &samples) const;
+    
+    // The points of a data series in the view, joined by lines and downsampled to a few per pixel
+    void getDataPaths(const DataSeries &series, SampleBuffer &paths) const;
+    
+    // The window of a stream in the view, its extremes in each pixel column joined by lines. Unix only.
+    void getStreamPaths(const DataStream &stream, SampleBuffer &paths) const;
     std::pair<Point<int>, Point<std::string>> getPointFromSelected(int x) const;
+    
+    // Solution curves of the selected differential equation, the initial point is in pixels
+    void addSolutionToSelected(int x, int y);
+    void clearSolutionsOfSelected();
+    
+    // The selected surface over the current view, for the 3D view
+    SurfacePlot getSurfacePlotFromSelected(int resolution = 256) const;
+    
+    // Returns (integral, error estimate) of the selected expression over [xFrom, xTo]
+    std::pair<real, real> getIntegralFromSelected(real xFrom, real xTo, real tolerance = 1e-10) const;
+    
+    // Fits the variables the selected function reads to the points of the series by least squares,
+    // and leaves them at the fitted values
+    FitResult fitSelectedToData(const DataSeries &series) const;
+    
+    // A copy of the view where the variable is the constant value in every expression, so the
+    // copies can be plotted on other threads while the variable changes
+    Plotter bindVariable(const std::string &name, real value) const;
+    
+    // A copy of the view where every variable but keptName is its current value, for work on
+    // other threads that must not read the variables while they are set
+    Plotter bindVariables(const std::string &keptName = std::string()) const;
+    
+    // Finds roots, extrema and intersections of the visible expressions, the analyzer
+    // holds its own copies with the variables bound so it can be run on another thread
+    Analyzer getAnalyzer() const;
 
     const_iterator cbegin() const;
     const_iterator cend() const;
@@ -79,16 +157,78 @@ private:
     
     std::vector<Expression> expressions;
     std::vector<bool> expressionIsHidden;
+    std::vector<std::vector<std::shared_ptr<const OdeSolution>>> solutions;
     size_type selectedExpression = npos;
     
+    // Indices of removed expressions, used again by the next expressions added
+    std::set<size_type> freeIndices;
+    
+    // Markers for the bounds and size they were made for
+    struct MarkerCache
+    {
+        real min, max;
+        int pixels;
+        std::vector<std::pair<int, std::string>> markers;
+    };
+    
+    mutable MarkerCache xMarkerCache;
+    mutable MarkerCache yMarkerCache;
+    
+    // Samples of each function from its last plot, at x = (first + i) * step and with the variables
+    // of version
+    struct FunctionSamples
+    {
+        real step;
+        long long first;
+        unsigned long version;
+        RangeExtrema extrema;
+    };
+    
+    mutable std::vector<std::shared_ptr<const FunctionSamples>> functionSamples;
+    
+    // Updates the definitions for expression, which is new at expressionIndex, and recompiles its callers
+    // into recompiled in order. The expressions themselves are not touched.
+    void updateDefinitions(size_type expressionIndex, const Expression &expression, std::vector<std::pair<size_type, Expression>> &recompiled) const;
+    
+    // Stores the recompiled callers and clears the cached results of them and of expressionIndex,
+    // returns their indices with expressionIndex first
+    std::vector<size_type> storeRecompiled(size_type expressionIndex, std::vector<std::pair<size_type, Expression>> &recompiled);
+    
+    // Samples are taken at x = (first + i) * step, the same x values are kept when panning. With a
+    // period of the function the step is shortened a little to a whole number of steps per period,
+    // unless there would be fewer than MIN_PERIOD_SAMPLES.
+    void getSampleGrid(real &step, long long &first, std::size_t &count, real period = 0) const;
+    
+    static const int MIN_PERIOD_SAMPLES = 4;
+    
+    // Steps of a function longer than this are bisected to find jumps, a step that has not
+    // shrunk to less than half after JUMP_ROUNDS bisections is a jump and breaks the path
+    static const int MIN_JUMP_PIXELS = 8;
+    static const int JUMP_ROUNDS = 12;
+    
+    // Points of a data series drawn per pixel of width, the rest are left out by downsampling
+    static const int DATA_POINTS_PER_PIXEL = 2;
+    
+    void getFunctionPaths(size_type expressionIndex, SampleBuffer &paths) const;
+    void getPointPaths(const std::vector<real> &xs, const std::vector<real> &ys, SampleBuffer &paths) const;
+    
+    // Keeps the samples of a function for getYBounds
+    void storeFunctionSamples(size_type expressionIndex, real step, long long first, const std::vector<real> &ys) const;
+    
+    // Adds the points in pixels to the last path of samples, except the undefined ones
+    void addSamples(const real *xs, const real *ys, std::size_t count, SampleBuffer &samples) const;
+    
+    // Remakes the markers of the x- or y-axis if the bounds or size changed
+    void updateMarkers(bool vertical, MarkerCache &cache) const;
+    
     int xPtToPx(real x) const;
     int xPtToPx(real x, real pixelsPerPoint) const;
     int yPtToPx(real y) const;
     int yPtToPx(real y, real pixelsPerPoint, real yDiff) const;
     
-    real xPxToPt(int x) const;
+    real xPxToPt(real x) const;
     real xPxToPt(int x, real pointsPerPixel) const;
-    real yPxToPt(int y) const;
+    real yPxToPt(real y) const;
     real yPxToPt(int y, real pointsPerPixel) const;
 };
 
@@ -0,0 +1,191 @@
+//
+//  PolylineRasterizer.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "PolylineRasterizer.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+
+PolylineRasterizer::PolylineRasterizer(int _pixelWidth, int _pixelHeight)
+    : pixelWidth(std::max(_pixelWidth, 0)),
+      pixelHeight(std::max(_pixelHeight, 0)),
+      curves()
+{
+}
+
+void PolylineRasterizer::add(const SampleBuffer &paths, std::uint32_t color, float width)
+{
+    curves.push_back({&paths, color, width});
+}
+
+void PolylineRasterizer::render(std::uint32_t *pixels) const
+{
+    if (pixelWidth == 0 || pixelHeight == 0) return;
+    
+    // Sort the segments into the bands they cover, pixels further than reach from a line are not touched
+    const int numBands = (pixelHeight + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    std::vector<std::vector<Segment>> bands(numBands);
+    
+    for (std::vector<Curve>::size_type c = 0; c != curves.size(); ++c)
+    {
+        const SampleBuffer &paths = *curves[c].paths;
+        const float reach = curves[c].width / 2 + 1;
+        const float *x = paths.getX();
+        const float *y = paths.getY();
+        
+        for (SampleBuffer::size_type path = 0; path != paths.numPaths(); ++path)
+        {
+            const SampleBuffer::size_type begin = paths.getPathBegin(path);
+            const SampleBuffer::size_type end = paths.getPathEnd(path);
+            
+            for (SampleBuffer::size_type i = begin; i == begin || i + 1 < end; ++i)
+            {
+                const SampleBuffer::size_type j = std::min(i + 1, end - 1);
+                
+                const float top = std::min(y[i], y[j]) - reach;
+                const float bottom = std::max(y[i], y[j]) + reach;
+                
+                if (bottom < 0 || top >= pixelHeight) continue;
+                if (std::max(x[i], x[j]) + reach < 0 || std::min(x[i], x[j]) - reach >= pixelWidth) continue;
+                
+                const int first = std::max(0, static_cast<int>(top) / BAND_HEIGHT);
+                const int last = std::min(numBands - 1, static_cast<int>(bottom) / BAND_HEIGHT);
+                
+                for (int band = first; band <= last; ++band) bands[band].push_back({c, i, j});
+            }
+        }
+    }
+    
+    ThreadPool::globalInstance().parallelFor(numBands, [&](ThreadPool::size_type band)
+    {
+        const int top = static_cast<int>(band) * BAND_HEIGHT;
+        const int bottom = std::min(pixelHeight, top + BAND_HEIGHT);
+        
+        std::vector<float> coverage(static_cast<std::size_t>(bottom - top) * pixelWidth, 0);
+        
+        // Columns of each row of the mask that may have been drawn to since it was last blended
+        int left[BAND_HEIGHT];
+        int right[BAND_HEIGHT];
+        std::fill(left, left + BAND_HEIGHT, pixelWidth);
+        std::fill(right, right + BAND_HEIGHT, -1);
+        
+        for (std::vector<Segment>::size_type k = 0; k != bands[band].size(); ++k)
+        {
+            const Segment &segment = bands[band][k];
+            const Curve &curve = curves[segment.curve];
+            
+            drawSegment(curve, segment, top, bottom, coverage.data(), left, right);
+            
+            // Blend at the end of every curve
+            if (k + 1 == bands[band].size() || bands[band][k + 1].curve != segment.curve)
+            {
+                for (int row = 0; row != bottom - top; ++row)
+                {
+                    if (left[row] > right[row]) continue;
+                    
+                    float *mask = coverage.data() + static_cast<std::size_t>(row) * pixelWidth + left[row];
+                    const int count = right[row] - left[row] + 1;
+                    
+                    blend(curve.color, mask, pixels + static_cast<std::size_t>(top + row) * pixelWidth + left[row], count);
+                    std::fill(mask, mask + count, 0.0f);
+                    
+                    left[row] = pixelWidth;
+                    right[row] = -1;
+                }
+            }
+        }
+    });
+}
+
+void PolylineRasterizer::drawSegment(const Curve &curve, const Segment &segment, int top, int bottom, float *coverage, int *left, int *right) const
+{
+    const float *x = curve.paths->getX();
+    const float *y = curve.paths->getY();
+    
+    const float x0 = x[segment.first];
+    const float y0 = y[segment.first];
+    const float dx = x[segment.last] - x0;
+    const float dy = y[segment.last] - y0;
+    const float length2 = dx * dx + dy * dy;
+    
+    // Coverage falls off linearly over the pixel at the edge of the line
+    const float reach = curve.width / 2 + 0.5f;
+    
+    const int firstRow = std::max(top, static_cast<int>(std::floor(std::min(y0, y0 + dy) - reach)));
+    const int lastRow = std::min(bottom - 1, static_cast<int>(std::ceil(std::max(y0, y0 + dy) + reach)));
+    
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        const float centerY = row + 0.5f;
+        
+        // The part of the segment within reach of the row, and the columns within reach of that part
+        float t0 = 0;
+        float t1 = 1;
+        
+        if (std::abs(dy) > 1e-6f)
+        {
+            t0 = std::max(0.0f, std::min(1.0f, (centerY - reach - y0) / dy));
+            t1 = std::max(0.0f, std::min(1.0f, (centerY + reach - y0) / dy));
+        }
+        
+        const float low = std::min(x0 + t0 * dx, x0 + t1 * dx) - reach;
+        const float high = std::max(x0 + t0 * dx, x0 + t1 * dx) + reach;
+        
+        const int firstColumn = std::max(0, static_cast<int>(std::ceil(low - 0.5f)));
+        const int lastColumn = std::min(pixelWidth - 1, static_cast<int>(std::floor(high - 0.5f)));
+        
+        if (firstColumn > lastColumn) continue;
+        
+        left[row - top] = std::min(left[row - top], firstColumn);
+        right[row - top] = std::max(right[row - top], lastColumn);
+        
+        float *mask = coverage + static_cast<std::size_t>(row - top) * pixelWidth;
+        
+        for (int column = firstColumn; column <= lastColumn; ++column)
+        {
+            const float px = column + 0.5f - x0;
+            const float py = centerY - y0;
+            
+            // Distance to the closest point of the segment
+            const float t = length2 > 0 ? std::max(0.0f, std::min(1.0f, (px * dx + py * dy) / length2)) : 0;
+            const float ex = px - t * dx;
+            const float ey = py - t * dy;
+            const float distance2 = ex * ex + ey * ey;
+            
+            if (distance2 >= reach * reach) continue;
+            
+            const float value = reach - std::sqrt(distance2);
+            
+            if (value > mask[column]) mask[column] = std::min(value, 1.0f);
+        }
+    }
+}
+
+void PolylineRasterizer::blend(std::uint32_t color, const float *coverage, std::uint32_t *pixels, int count)
+{
+    const float alpha = (color >> 24) / 255.0f;
+    
+    for (int i = 0; i != count; ++i)
+    {
+        if (coverage[i] <= 0) continue;
+        
+        // Premultiplied source over destination, channel by channel
+        const float a = alpha * coverage[i];
+        const std::uint32_t destination = pixels[i];
+        std::uint32_t result = static_cast<std::uint32_t>(255 * a + (destination >> 24) * (1 - a) + 0.5f) << 24;
+        
+        for (int shift = 0; shift != 24; shift += 8)
+        {
+            const float source = ((color >> shift) & 0xff) * a;
+            result |= static_cast<std::uint32_t>(source + ((destination >> shift) & 0xff) * (1 - a) + 0.5f) << shift;
+        }
+        
+        pixels[i] = result;
+    }
+}
@@ -0,0 +1,60 @@
+//
+//  PolylineRasterizer.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__PolylineRasterizer__
+#define __MathGraph__PolylineRasterizer__
+
+#include "SampleBuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Draws polylines with antialiased lines straight into an image, without QPainter. The segments are
+// sorted into horizontal bands of the image, and the bands are drawn in parallel on the thread pool.
+// Within a band every polyline is drawn into a coverage mask first, taking the largest coverage where
+// its segments overlap, so the joints are not blended twice.
+class PolylineRasterizer
+{
+public:
+    PolylineRasterizer(int _pixelWidth, int _pixelHeight);
+    
+    // The paths are not copied and must be kept until render returns. color is ARGB, not premultiplied.
+    void add(const SampleBuffer &paths, std::uint32_t color, float width);
+    
+    // Blends the polylines over pixels in the order they were added. pixels holds pixelWidth * pixelHeight
+    // premultiplied ARGB values row by row.
+    void render(std::uint32_t *pixels) const;
+    
+private:
+    // Rows of pixels per band
+    static const int BAND_HEIGHT = 16;
+    
+    struct Curve
+    {
+        const SampleBuffer *paths;
+        std::uint32_t color;
+        float width;
+    };
+    
+    // From point first to point last of a curve, the same point for a polyline of one point
+    struct Segment
+    {
+        std::vector<Curve>::size_type curve;
+        SampleBuffer::size_type first, last;
+    };
+    
+    int pixelWidth;
+    int pixelHeight;
+    std::vector<Curve> curves;
+    
+    void drawSegment(const Curve &curve, const Segment &segment, int top, int bottom, float *coverage, int *left, int *right) const;
+    static void blend(std::uint32_t color, const float *coverage, std::uint32_t *pixels, int count);
+};
+
+#endif /* defined(__MathGraph__PolylineRasterizer__) */
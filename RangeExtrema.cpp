@@ -0,0 +1,129 @@
+//
+//  RangeExtrema.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "RangeExtrema.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+RangeExtrema::RangeExtrema(const real *values, std::size_t count)
+    : low(count),
+      high(count),
+      prefixLow(count),
+      prefixHigh(count),
+      suffixLow(count),
+      suffixHigh(count),
+      blockLow(),
+      blockHigh()
+{
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const bool finite = std::isfinite(values[i]);
+        
+        low[i] = finite ? values[i] : std::numeric_limits<real>::infinity();
+        high[i] = finite ? values[i] : -std::numeric_limits<real>::infinity();
+    }
+    
+    const std::size_t numBlocks = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    
+    blockLow.emplace_back(numBlocks);
+    blockHigh.emplace_back(numBlocks);
+    
+    for (std::size_t block = 0; block != numBlocks; ++block)
+    {
+        const std::size_t begin = block * BLOCK_SIZE;
+        const std::size_t end = std::min(begin + BLOCK_SIZE, count);
+        
+        prefixLow[begin] = low[begin];
+        prefixHigh[begin] = high[begin];
+        
+        for (std::size_t i = begin + 1; i != end; ++i)
+        {
+            prefixLow[i] = std::min(prefixLow[i - 1], low[i]);
+            prefixHigh[i] = std::max(prefixHigh[i - 1], high[i]);
+        }
+        
+        suffixLow[end - 1] = low[end - 1];
+        suffixHigh[end - 1] = high[end - 1];
+        
+        for (std::size_t i = end - 1; i != begin; --i)
+        {
+            suffixLow[i - 1] = std::min(suffixLow[i], low[i - 1]);
+            suffixHigh[i - 1] = std::max(suffixHigh[i], high[i - 1]);
+        }
+        
+        blockLow[0][block] = prefixLow[end - 1];
+        blockHigh[0][block] = prefixHigh[end - 1];
+    }
+    
+    // Each level combines two runs of the level below
+    for (std::size_t length = 2; length <= numBlocks; length *= 2)
+    {
+        const std::vector<real> &previousLow = blockLow.back();
+        const std::vector<real> &previousHigh = blockHigh.back();
+        
+        std::vector<real> levelLow(numBlocks - length + 1);
+        std::vector<real> levelHigh(numBlocks - length + 1);
+        
+        for (std::size_t block = 0; block != levelLow.size(); ++block)
+        {
+            levelLow[block] = std::min(previousLow[block], previousLow[block + length / 2]);
+            levelHigh[block] = std::max(previousHigh[block], previousHigh[block + length / 2]);
+        }
+        
+        blockLow.push_back(std::move(levelLow));
+        blockHigh.push_back(std::move(levelHigh));
+    }
+}
+
+std::size_t RangeExtrema::size() const
+{
+    return low.size();
+}
+
+std::pair<real, real> RangeExtrema::get(std::size_t first, std::size_t last) const
+{
+    real min = std::numeric_limits<real>::infinity();
+    real max = -std::numeric_limits<real>::infinity();
+    
+    const std::size_t firstBlock = first / BLOCK_SIZE;
+    const std::size_t lastBlock = last / BLOCK_SIZE;
+    
+    if (firstBlock == lastBlock)
+    { // Shorter than a block
+        for (std::size_t i = first; i <= last; ++i)
+        {
+            min = std::min(min, low[i]);
+            max = std::max(max, high[i]);
+        }
+    }
+    else
+    {
+        min = std::min(suffixLow[first], prefixLow[last]);
+        max = std::max(suffixHigh[first], prefixHigh[last]);
+        
+        // The whole blocks in between are covered by two runs of the same length, which may overlap
+        if (lastBlock - firstBlock > 1)
+        {
+            const std::size_t blocks = lastBlock - firstBlock - 1;
+            
+            std::size_t level = 0;
+            while (std::size_t(2) << level <= blocks) ++level;
+            
+            const std::size_t second = lastBlock - (std::size_t(1) << level);
+            
+            min = std::min(min, std::min(blockLow[level][firstBlock + 1], blockLow[level][second]));
+            max = std::max(max, std::max(blockHigh[level][firstBlock + 1], blockHigh[level][second]));
+        }
+    }
+    
+    if (min > max) return std::pair<real, real>(std::numeric_limits<real>::max(), std::numeric_limits<real>::lowest());
+    
+    return std::pair<real, real>(min, max);
+}
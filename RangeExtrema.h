@@ -0,0 +1,49 @@
+//
+//  RangeExtrema.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__RangeExtrema__
+#define __MathGraph__RangeExtrema__
+
+#include "real.h"
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Smallest and largest value of any range of an array in constant time. The array is split into
+// blocks, each value knows the extremes from the start of its block and to its end, and a sparse
+// table holds the extremes of every power of two run of blocks. Building it is linear in practice,
+// the table has size / BLOCK_SIZE * log(size / BLOCK_SIZE) entries. Values that are not finite
+// are left out.
+class RangeExtrema
+{
+public:
+    RangeExtrema(const real *values, std::size_t count);
+    
+    std::size_t size() const;
+    
+    // (min, max) of the values first to last, inclusive. (max(), lowest()) if none of them is finite.
+    std::pair<real, real> get(std::size_t first, std::size_t last) const;
+    
+private:
+    static const std::size_t BLOCK_SIZE = 32;
+    
+    // The values, with +inf and -inf in place of the ones that are left out
+    std::vector<real> low;
+    std::vector<real> high;
+    
+    // Extremes from the start of the block to each value, and from each value to the end of the block
+    std::vector<real> prefixLow, prefixHigh;
+    std::vector<real> suffixLow, suffixHigh;
+    
+    // Level k holds the extremes of the blocks b to b + 2^k - 1
+    std::vector<std::vector<real>> blockLow;
+    std::vector<std::vector<real>> blockHigh;
+};
+
+#endif /* defined(__MathGraph__RangeExtrema__) */
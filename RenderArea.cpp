@@ -8,9 +8,17 @@
 
 #include "renderarea.h"
 #include "real.h"
+#include "SurfaceView.h"
+#include "CurveFitter.h"
 
 #include <QIcon>
+#include <QApplication>
+#include <QtConcurrent>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <numeric>
 
 RenderArea::RenderArea(QWidget *_parent)
     : QWidget(_parent),
@@ -19,9 +27,50 @@ RenderArea::RenderArea(QWidget *_parent)
       currentPosition(-1, -1),
       leftDrag(false),
       selectedCoordinateString(),
+      hasIntegral(false),
+      integrationInterval(0, 0),
+      integralString(),
+      integralArea(),
+      markerLabels(),
       plotter(),
       functionCache(),
       selectedFunction(npos),
+      sampleCache(),
+      curveBatches(FUNCTION_COLORS.size()),
+      curveBatchIsOutdated(FUNCTION_COLORS.size(), false),
+      integralSamples(),
+      rasterizerEnabled(false),
+      curveImage(),
+      curveImageIsOutdated(true),
+      curveIndex(),
+      analysisEnabled(false),
+      criticalPoints(),
+      analysisCancelled(std::make_shared<std::atomic<bool>>(false)),
+      analysisWatcher(),
+      surfaceImage(),
+      surfaceImageCancelled(std::make_shared<std::atomic<bool>>(false)),
+      surfaceImageWatcher(),
+      regionCache(),
+      regionImage(),
+      animation(),
+      animationFrame(0),
+      animationDirection(1),
+      animationTimer(),
+      animationCancelled(std::make_shared<std::atomic<bool>>(false)),
+      animationWatcher(),
+      dataSeries(),
+      dataCache(),
+      dataSamples(),
+      pendingDataFiles(),
+      dataSeriesError(),
+      dataSeriesWatcher(),
+#ifdef Q_OS_UNIX
+      stream(),
+      streamTimer(),
+      streamAnimationTimer(),
+      streamAnimationIsOutdated(false),
+#endif
+      streamCache(),
       invalidSelectionErrorDialog(_parent)
 {
     setCursor(Qt::OpenHandCursor);
@@ -35,6 +84,18 @@ RenderArea::RenderArea(QWidget *_parent)
     zoomPlusCursor = QCursor(QIcon(":images/cursor_zoom_plus.gif").pixmap(16, 16));
     zoomMinusCursor = QCursor(QIcon(":images/cursor_zoom_minus.gif").pixmap(16, 16));
     cropCursor = QCursor(QIcon(":images/cursor_crop.gif").pixmap(16, 16));
+    
+    connect(&analysisWatcher, SIGNAL(finished()), this, SLOT(analysisFinished()));
+    connect(&surfaceImageWatcher, SIGNAL(finished()), this, SLOT(surfaceImageFinished()));
+    connect(&dataSeriesWatcher, SIGNAL(finished()), this, SLOT(dataSeriesLoaded()));
+    
+#ifdef Q_OS_UNIX
+    streamTimer.setInterval(STREAM_FRAME_INTERVAL);
+    connect(&streamTimer, SIGNAL(timeout()), this, SLOT(nextStreamFrame()));
+#endif
+    
+    animationTimer.setInterval(FRAME_INTERVAL);
+    connect(&animationTimer, SIGNAL(timeout()), this, SLOT(nextAnimationFrame()));
 }
 
 QSize RenderArea::minimumSizeHint() const
@@ -49,12 +110,53 @@ QSize RenderArea::sizeHint() const
 
 Plotter::size_type RenderArea::addFunction(const Expression &expr)
 {
-    plotter.addExpression(expr);
+    std::vector<Plotter::size_type> changed = plotter.addExpression(expr);
     
-    rebuildFunctionCache();
+    functionCache.resize(plotter.numExpressions());
+    sampleCache.resize(plotter.numExpressions());
+    regionCache.resize(plotter.numExpressions());
+    
+    bool surfacesChanged = false;
+    for (Plotter::size_type i : changed)
+    {
+        surfacesChanged = surfacesChanged || isSurface(i);
+        
+        if (i == selectedFunction)
+        {
+            criticalPoints.clear();
+            removeIntegral();
+        }
+    }
+    
+    if (animation != nullptr) restartAnimation();
+    
+    rebuildFunctionCache(changed, surfacesChanged);
     update();
     
-    return plotter.numExpressions() - 1;
+    return changed.front();
+}
+
+void RenderArea::replaceFunction(Plotter::size_type expressionIndex, const Expression &expr)
+{
+    bool surfacesChanged = isSurface(expressionIndex);
+    
+    std::vector<Plotter::size_type> changed = plotter.replaceExpression(expressionIndex, expr);
+    
+    for (Plotter::size_type i : changed)
+    {
+        surfacesChanged = surfacesChanged || isSurface(i);
+        
+        if (i == selectedFunction)
+        {
+            criticalPoints.clear();
+            removeIntegral();
+        }
+    }
+    
+    if (animation != nullptr) restartAnimation();
+    
+    rebuildFunctionCache(changed, surfacesChanged);
+    update();
 }
 
 Plotter::size_type RenderArea::removeSelectedFunction()
@@ -63,11 +165,19 @@ Plotter::size_type RenderArea::removeSelectedFunction()
     
     if (selectedFunction != npos)
     {
-        plotter.removeExpression(selectedFunction);
+        const bool surfacesChanged = isSurface(removedIndex);
+        
+        plotter.removeExpression(removedIndex);
         
         selectedFunction = npos;
+        curveImageIsOutdated = true;
+        criticalPoints.clear();
+        removeIntegral();
         
-        rebuildFunctionCache();
+        if (animation != nullptr) restartAnimation();
+        
+        // The index is left empty, so only its own cache entries change
+        rebuildFunctionCache(std::vector<Plotter::size_type>(1, removedIndex), surfacesChanged);
         update();
     }
     
@@ -87,6 +197,9 @@ void RenderArea::setTool(GraphTool _graphTool)
 {
     graphTool = _graphTool;
     
+    // The selection follows the cursor without a button pressed
+    setMouseTracking(graphTool == SELECTION);
+    
     switch(graphTool)
     {
         case MOVE:
@@ -100,13 +213,22 @@ void RenderArea::setTool(GraphTool _graphTool)
         case ZOOM:
             setCursor(zoomPlusCursor);
             break;
+        case INTEGRATION:
+            setCursor(Qt::CrossCursor);
+            removeCurveSelection();
+            break;
     }
+    
+    removeIntegral();
+    update();
 }
 
 void RenderArea::clearSelection()
 {
     plotter.clearSelection();
     selectedFunction = npos;
+    curveImageIsOutdated = true;
+    removeIntegral();
     
     update();
 }
@@ -115,6 +237,8 @@ void RenderArea::select(Plotter::size_type expressionIndex)
 {
     plotter.select(expressionIndex);
     selectedFunction = expressionIndex;
+    curveImageIsOutdated = true;
+    removeIntegral();
     
     update();
 }
@@ -126,18 +250,181 @@ void RenderArea::setEnabled(Plotter::size_type expressionIndex, bool enabled)
         
         plotter.setHidden(expressionIndex, !enabled);
         
-        if (enabled)
+        if (animation != nullptr) restartAnimation();
+        
+        rebuildFunctionCache(std::vector<Plotter::size_type>(1, expressionIndex), isSurface(expressionIndex));
+        update();
+    }
+}
+
+void RenderArea::setParameter(const std::string &name, real value)
+{
+    if (animation != nullptr && animation->getVariable() == name)
+    { // Scrubbing, computed frames are only drawn
+        animationFrame = animation->getIndex(value);
+        
+        if (showAnimationFrame(animationFrame)) return;
+        
+        if (!animationWatcher.isRunning()) precomputeFrames();
+    }
+    
+    Expression::setVariable(name, value);
+    
+    std::vector<Plotter::size_type> changed = animatedExpressions(name, true);
+    std::vector<Plotter::size_type> surfaces = animatedExpressions(name, false);
+    changed.insert(changed.end(), surfaces.begin(), surfaces.end());
+    
+    const bool surfacesChanged = !surfaces.empty();
+    
+    // The frames hold the other variables at the values they were computed with
+    if (animation != nullptr && animation->getVariable() != name && !changed.empty()) restartAnimation();
+    
+    if (std::find(changed.begin(), changed.end(), selectedFunction) != changed.end())
+    { // The marked point and integral belong to the old curve
+        removeCurveSelection();
+        removeIntegral();
+    }
+    
+    rebuildFunctionCache(changed, surfacesChanged);
+    update();
+}
+
+void RenderArea::loadDataSeries(const QString &path)
+{
+    pendingDataFiles.push_back(path.toStdString());
+    
+    if (pendingDataFiles.size() == 1) loadNextDataSeries();
+}
+
+void RenderArea::loadNextDataSeries()
+{
+    std::shared_ptr<std::string> error = std::make_shared<std::string>();
+    dataSeriesError = error;
+    
+    const std::string file = pendingDataFiles.front();
+    
+    dataSeriesWatcher.setFuture(QtConcurrent::run([file, error]() -> std::shared_ptr<const DataSeries>
+    {
+        try
         {
-            rebuildFunctionCache();
+            return std::make_shared<const DataSeries>(file);
         }
-        else
+        catch (const DataFileError &e)
+        {
+            *error = e.what();
+            return nullptr;
+        }
+    }));
+}
+
+const std::vector<std::shared_ptr<const DataSeries>> &RenderArea::getDataSeries() const
+{
+    return dataSeries;
+}
+
+void RenderArea::clearDataSeries()
+{
+    dataSeries.clear();
+    dataCache.clear();
+    
+    update();
+}
+
+void RenderArea::dataSeriesLoaded()
+{
+    std::shared_ptr<const DataSeries> series = dataSeriesWatcher.result();
+    const QString error = QString::fromStdString(*dataSeriesError);
+    
+    pendingDataFiles.pop_front();
+    if (!pendingDataFiles.empty()) loadNextDataSeries();
+    
+    if (series == nullptr)
+    {
+        QMessageBox::warning(this, "Data series", error);
+        return;
+    }
+    
+    dataSeries.push_back(series);
+    
+    rebuildDataCache();
+    update();
+}
+
+#ifdef Q_OS_UNIX
+void RenderArea::startStream(const std::string &socketPath, DataStream::size_type windowLength)
+{
+    stopStream();
+    
+    stream.reset(new DataStream(socketPath, windowLength));
+    streamTimer.start();
+}
+
+void RenderArea::stopStream()
+{
+    streamTimer.stop();
+    stream.reset();
+    streamCache = QPainterPath();
+    
+    // The frames are of a view the stream has scrolled away from
+    if (streamAnimationIsOutdated && animation != nullptr) restartAnimation();
+    streamAnimationIsOutdated = false;
+    
+    update();
+}
+
+void RenderArea::nextStreamFrame()
+{
+    // Also after the stream stops, so the animation ends up with the last view
+    if (streamAnimationIsOutdated && animation != nullptr && (!streamAnimationTimer.isValid() || streamAnimationTimer.elapsed() >= STREAM_ANIMATION_INTERVAL))
+    {
+        restartAnimation();
+        streamAnimationTimer.start();
+        streamAnimationIsOutdated = false;
+    }
+    
+    if (stream->drain() == 0) return;
+    
+    // The view keeps its width and follows the latest sample
+    if (plotter.scrollTo(stream->getLatestX()))
+    {
+        // A function without x, like y = 1, draws the same line wherever the view is
+        std::vector<Plotter::size_type> scrolled;
+        bool surfacesChanged = false;
+        
+        for (Plotter::size_type i = 0; i != plotter.numExpressions(); ++i)
         {
-            functionCache[expressionIndex] = QPainterPath();
+            const Expression &expression = *(plotter.cbegin() + i);
+            
+            if (plotter.isHidden(i) || (expression.getKind() == Expression::FUNCTION && !expression.dependsOnX())) continue;
+            
+            scrolled.push_back(i);
+            surfacesChanged = surfacesChanged || isSurface(i);
         }
         
-        update();
+        // The animation is restarted by a later frame
+        streamAnimationIsOutdated = animation != nullptr;
+        
+        rebuildPaths(scrolled);
+        
+        if (surfacesChanged) rebuildSurfaceImage();
+        rebuildRegionImage();
+        
+        if (hasIntegral) rebuildIntegralArea();
+        
+        // An analysis takes longer than a frame, the first frame after it is done starts the next
+        if (analysisEnabled && !analysisWatcher.isRunning()) startAnalysis();
+        
+        rebuildDataCache();
+    }
+    else
+    {
+        plotter.getStreamPaths(*stream, dataSamples);
+        streamCache = buildPath(dataSamples);
     }
+    
+    update();
 }
+#endif
 
 void RenderArea::keyPressEvent(QKeyEvent *event)
 {
@@ -164,14 +451,168 @@ void RenderArea::autoYBounds()
     update();
 }
 
+void RenderArea::setAnalysisEnabled(bool enabled)
+{
+    analysisEnabled = enabled;
+    criticalPoints.clear();
+    
+    if (analysisEnabled) startAnalysis();
+    else analysisCancelled->store(true);
+    
+    update();
+}
+
+void RenderArea::setRasterizerEnabled(bool enabled)
+{
+    rasterizerEnabled = enabled;
+    
+    // The image is only kept while it is used
+    if (!rasterizerEnabled) curveImage = QImage();
+    
+    update();
+}
+
+void RenderArea::benchmarkCurveDrawing()
+{
+    const int ROUNDS = 20;
+    
+    QImage image(size(), QImage::Format_ARGB32_Premultiplied);
+    QElapsedTimer timer;
+    
+    // The same curves both ways, into an image so that showing it on screen is not measured
+    timer.start();
+    for (int round = 0; round != ROUNDS; ++round)
+    {
+        image.fill(Qt::transparent);
+        
+        QPainter painter(&image);
+        drawCurves(painter);
+    }
+    
+    const double painterTime = timer.nsecsElapsed() / 1e6 / ROUNDS;
+    
+    timer.restart();
+    for (int round = 0; round != ROUNDS; ++round)
+    {
+        rasterizeCurves(image);
+    }
+    
+    const double rasterizerTime = timer.nsecsElapsed() / 1e6 / ROUNDS;
+    
+    QMessageBox::information(this, "Curve drawing", QString("Milliseconds per frame\n\nQPainter: %1\nParallel rasterizer: %2").arg(painterTime, 0, 'f', 2).arg(rasterizerTime, 0, 'f', 2));
+}
+
+void RenderArea::showSurfaceView()
+{
+    try
+    {
+        SurfaceView *view = new SurfaceView(plotter.getSurfacePlotFromSelected(), this);
+        view->show();
+    }
+    catch (const InvalidSelection &e)
+    {
+        invalidSelectionErrorDialog.setText(e.what());
+        invalidSelectionErrorDialog.exec();
+    }
+}
+
+void RenderArea::fitSelectedToData()
+{
+    try
+    {
+        if (dataSeries.empty())
+        {
+            throw InvalidSelection("No data series is loaded.");
+        }
+        
+        // The parameters are shared with everything else that is plotted, so the fit runs here
+        QApplication::setOverrideCursor(Qt::WaitCursor);
+        FitResult result;
+        
+        try
+        {
+            result = plotter.fitSelectedToData(*dataSeries.back());
+        }
+        catch (...)
+        {
+            // The selection is checked before the fit, the cursor must not stay busy after it
+            QApplication::restoreOverrideCursor();
+            throw;
+        }
+        
+        QApplication::restoreOverrideCursor();
+        
+        if (result.numPoints == 0)
+        {
+            QMessageBox::warning(this, "Curve fit", "The selected function is not defined at any point of the data series.");
+            return;
+        }
+        
+        QString message;
+        
+        for (std::vector<std::string>::size_type k = 0; k != result.parameters.size(); ++k)
+        {
+            emit parameterFitted(QString::fromStdString(result.parameters[k]), static_cast<double>(result.values[k]));
+            
+            message += QString::fromStdString(result.parameters[k]) + " = " + real_functions::toString(result.values[k]).c_str() + "\n";
+        }
+        
+        message += QString("\nRoot mean square residual %1 over %2 points").arg(static_cast<double>(std::sqrt(result.sumOfSquares / result.numPoints)), 0, 'g', 4).arg(result.numPoints);
+        
+        if (!result.converged)
+        {
+            message += QString("\nStopped after %1 iterations without converging").arg(result.iterations);
+        }
+        
+        // The marked point and integral belong to the old curve
+        removeCurveSelection();
+        removeIntegral();
+        
+        rebuildFunctionCache();
+        update();
+        
+        QMessageBox::information(this, "Curve fit", message);
+    }
+    catch (const InvalidSelection &e)
+    {
+        invalidSelectionErrorDialog.setText(e.what());
+        invalidSelectionErrorDialog.exec();
+    }
+}
+
+void RenderArea::analysisFinished()
+{
+    if (analysisEnabled && !analysisCancelled->load())
+    {
+        criticalPoints = analysisWatcher.result();
+        
+        update();
+    }
+}
+
+void RenderArea::surfaceImageFinished()
+{
+    QImage image = surfaceImageWatcher.result();
+    
+    if (!surfaceImageCancelled->load() && !image.isNull())
+    {
+        surfaceImage = image;
+        
+        update();
+    }
+}
+
 void RenderArea::paintEvent(QPaintEvent *)
 {
     QPainter painter(this);
     QFontMetrics currentFontMetrics = fontMetrics();
     QPen normalPen = QPen(QBrush(Qt::black), 1);
-    QPen boldPen = QPen(QBrush(Qt::black), 3);
     painter.setPen(normalPen);
     
+    // Surfaces and complex functions are drawn under everything else
+    if (!surfaceImage.isNull()) painter.drawImage(0, 0, surfaceImage);
+    if (!regionImage.isNull()) painter.drawImage(0, 0, regionImage);
+    
     // x-axis
     Point<int> origo = plotter.getOrigo();
     
@@ -194,50 +635,115 @@ void RenderArea::paintEvent(QPaintEvent *)
     painter.drawPath(yAxisArrow);
     painter.fillPath(yAxisArrow, QBrush(Qt::black));
     
-    // X markers
-    std::vector<std::pair<int, std::string>> xMarkers = plotter.getXMarkers();
+    // X markers, static text is placed by its top instead of the baseline
+    const int ascent = currentFontMetrics.ascent();
+    
+    const std::vector<std::pair<int, std::string>> &xMarkers = plotter.getXMarkers();
     for (auto it = xMarkers.cbegin(); it != xMarkers.cend(); ++it)
     {
         int currentPosition = it->first;
         
-        QString value = it->second.c_str();
+        const QStaticText &label = markerLabel(it->second);
         
-        painter.drawText(currentPosition - currentFontMetrics.width(value) / 2, origo.getY() + 20, value);
+        painter.drawStaticText(currentPosition - static_cast<int>(label.size().width()) / 2, origo.getY() + 20 - ascent, label);
         painter.drawLine(currentPosition, origo.getY() - 3, currentPosition, origo.getY() + 3);
     }
     
     // Y markers
-    std::vector<std::pair<int, std::string>> yMarkers = plotter.getYMarkers();
+    const std::vector<std::pair<int, std::string>> &yMarkers = plotter.getYMarkers();
     for (auto it = yMarkers.cbegin(); it != yMarkers.cend(); ++it)
     {
         int currentPosition = it->first;
         
-        painter.drawText(origo.getX() + 8, currentPosition + 5, it->second.c_str());
+        painter.drawStaticText(origo.getX() + 8, currentPosition + 5 - ascent, markerLabel(it->second));
         painter.drawLine(origo.getX() - 3, currentPosition, origo.getX() + 3, currentPosition);
     }
     
+    // Area of the integral
+    if (hasIntegral && !integralArea.isEmpty())
+    {
+        QColor areaColor = FUNCTION_COLORS[selectedFunction % FUNCTION_COLORS.size()];
+        areaColor.setAlpha(64);
+        
+        painter.fillPath(integralArea, QBrush(areaColor));
+    }
+    
+    // Data series and the stream under the curves
+    if (!dataCache.empty() || !streamCache.isEmpty())
+    {
+        painter.setRenderHint(QPainter::Antialiasing, true);
+        painter.setPen(QPen(QBrush(DATA_COLOR), CURVE_WIDTH));
+        
+        for (const QPainterPath &path : dataCache) painter.drawPath(path);
+        painter.drawPath(streamCache);
+        
+        painter.setRenderHint(QPainter::Antialiasing, false);
+    }
+    
     // Draw functions
-    for (size_type i = 0; i != functionCache.size(); ++i)
+    if (rasterizerEnabled)
     {
-        if (!functionCache[i].isEmpty())
+        if (curveImage.size() != size())
         {
-            if (i == selectedFunction)
-            {
-                boldPen.setColor(FUNCTION_COLORS[i % FUNCTION_COLORS.size()]);
-                painter.setPen(boldPen);
-            }
-            else
-            {
-                normalPen.setColor(FUNCTION_COLORS[i % FUNCTION_COLORS.size()]);
-                painter.setPen(normalPen);
-            }
-            
-            painter.drawPath(functionCache[i]);
+            curveImage = QImage(size(), QImage::Format_ARGB32_Premultiplied);
+            curveImageIsOutdated = true;
+        }
+        
+        if (curveImageIsOutdated)
+        {
+            rasterizeCurves(curveImage);
+            curveImageIsOutdated = false;
+        }
+        
+        painter.drawImage(0, 0, curveImage);
+    }
+    else
+    {
+        drawCurves(painter);
+    }
+    
+    normalPen.setColor(Qt::black);
+    painter.setPen(normalPen);
+    
+    // Roots, extrema and intersections
+    for (const CriticalPoint &point : criticalPoints)
+    {
+        Point<int> position = plotter.ptToPx(point.x, point.y);
+        
+        if (point.kind == CriticalPoint::INTERSECTION)
+        {
+            normalPen.setColor(Qt::black);
+        }
+        else
+        {
+            normalPen.setColor(FUNCTION_COLORS[point.first % FUNCTION_COLORS.size()]);
+        }
+        
+        painter.setPen(normalPen);
+        painter.setBrush(Qt::white);
+        
+        if (point.kind == CriticalPoint::MINIMUM || point.kind == CriticalPoint::MAXIMUM)
+        {
+            painter.drawRect(position.getX() - 3, position.getY() - 3, 6, 6);
+        }
+        else
+        {
+            painter.drawEllipse(QPoint(position.getX(), position.getY()), 3, 3);
+        }
+        
+        if (criticalPoints.size() <= MAX_LABELED_POINTS)
+        {
+            QString label = "(";
+            label += real_functions::toString(point.x).c_str();
+            label += ", ";
+            label += real_functions::toString(point.y).c_str();
+            label += ")";
             
-            painter.setPen(normalPen);
+            painter.drawText(position.getX() + 6, position.getY() - 6, label);
         }
     }
     
+    painter.setBrush(Qt::NoBrush);
     normalPen.setColor(Qt::black);
     painter.setPen(normalPen);
     
@@ -263,6 +769,19 @@ void RenderArea::paintEvent(QPaintEvent *)
         painter.drawText(width() - currentFontMetrics.width(selectedCoordinateString) - 3, height() - 5, selectedCoordinateString);
     }
     
+    if (leftDrag && graphTool == INTEGRATION)
+    {
+        painter.setPen(Qt::DashLine);
+        painter.drawLine(initialPosition.x(), 0, initialPosition.x(), height());
+        painter.drawLine(currentPosition.x(), 0, currentPosition.x(), height());
+    }
+    
+    if (graphTool == INTEGRATION && hasIntegral)
+    {
+        painter.setPen(normalPen);
+        painter.drawText(width() - currentFontMetrics.width(integralString) - 3, height() - 5, integralString);
+    }
+    
     painter.setPen(palette().dark().color());
     painter.setBrush(Qt::NoBrush);
     painter.drawRect(QRect(0, 0, width() - 1, height() - 1));
@@ -284,6 +803,7 @@ void RenderArea::mousePressEvent(QMouseEvent *event)
                 initialPosition = event->pos();
                 break;
             case ZOOM:
+            case INTEGRATION:
                 currentPosition = initialPosition = event->pos();
                 break;
         }
@@ -304,7 +824,7 @@ void RenderArea::mouseReleaseEvent(QMouseEvent *event)
                 setCursor(Qt::OpenHandCursor);
                 break;
             case SELECTION:
-                doCurveSelection(event->pos());
+                doCurveClick(event->pos(), event->modifiers() & Qt::AltModifier);
                 break;
             case ZOOM:
                 if (ignoreZoomBox(initialPosition, currentPosition))
@@ -359,6 +879,12 @@ void RenderArea::mouseReleaseEvent(QMouseEvent *event)
                 
                 rebuildFunctionCache();
                 break;
+            case INTEGRATION:
+                if (newPosition.x() != initialPosition.x())
+                {
+                    doIntegration(initialPosition, newPosition);
+                }
+                break;
         }
 
         update();
@@ -399,7 +925,15 @@ void RenderArea::mouseMoveEvent(QMouseEvent *event)
                 update();
             }
             break;
-    }
+        case INTEGRATION:
+            if (event->buttons() & Qt::LeftButton && leftDrag)
+            {
+                currentPosition = event->pos();
+                
+                update();
+            }
+            break;
+    }
 }
 
 void RenderArea::wheelEvent(QWheelEvent *event)
@@ -468,24 +1002,88 @@ void RenderArea::move(const QPoint &newPosition)
 
 void RenderArea::doCurveSelection(const QPoint &pos)
 {
-    try
+    CurveIndex::Hit hit;
+    
+    // The point is read from the drawn curve, so nothing is evaluated while the mouse moves
+    if (getCurveIndex().findNearest(pos.x(), pos.y(), SNAP_DISTANCE, hit))
     {
-        std::pair<Point<int>, Point<std::string>> selectedPoint = plotter.getPointFromSelected(pos.x());
+        Point<real> point = plotter.pxToPt(hit.x, hit.y);
+        
         selectedCoordinateString = "(";
-        selectedCoordinateString += selectedPoint.second.getX().c_str();
+        selectedCoordinateString += real_functions::toString(point.getX()).c_str();
         selectedCoordinateString += ", ";
-        selectedCoordinateString += selectedPoint.second.getY().c_str();
+        selectedCoordinateString += real_functions::toString(point.getY()).c_str();
         selectedCoordinateString += ")";
         
-        initialPosition = QPoint(selectedPoint.first.getX(), selectedPoint.first.getY());
-        currentPosition = pos;
-        
-        update();
+        initialPosition = QPoint(static_cast<int>(std::round(hit.x)), static_cast<int>(std::round(hit.y)));
     }
-    catch (const InvalidSelection &)
+    else
     {
         removeCurveSelection();
+    }
+    
+    currentPosition = pos;
+    
+    update();
+}
+
+void RenderArea::doCurveClick(const QPoint &pos, bool alt)
+{
+    CurveIndex::Hit hit;
+    
+    if (getCurveIndex().findNearest(pos.x(), pos.y(), SNAP_DISTANCE, hit) && hit.curve != selectedFunction)
+    { // The main window selects it in the list, which selects it here
+        emit curveClicked(static_cast<int>(hit.curve));
+    }
+    else if (selectedIsDifferential())
+    {
+        doSolution(pos, alt);
+        
+        return;
+    }
+    
+    doCurveSelection(pos);
+}
+
+const CurveIndex &RenderArea::getCurveIndex()
+{
+    if (curveIndex == nullptr)
+    {
+        std::shared_ptr<CurveIndex> index = std::make_shared<CurveIndex>(width(), height());
+        
+        for (size_type i = 0; i != sampleCache.size(); ++i)
+        {
+            // The slope field of a differential equation is not a curve to snap to
+            if (sampleCache[i].size() != 0 && (plotter.cbegin() + i)->getKind() != Expression::DIFFERENTIAL) index->add(i, sampleCache[i]);
+        }
+        
+        index->build();
+        curveIndex = index;
+    }
+    
+    return *curveIndex;
+}
+
+bool RenderArea::selectedIsDifferential() const
+{
+    return selectedFunction != npos && (plotter.cbegin() + selectedFunction)->getKind() == Expression::DIFFERENTIAL;
+}
+
+void RenderArea::doSolution(const QPoint &pos, bool clear)
+{
+    try
+    {
+        if (clear)
+            plotter.clearSolutionsOfSelected();
+        else
+            plotter.addSolutionToSelected(pos.x(), pos.y());
         
+        rebuildFunctionCache();
+        update();
+    }
+    catch (const InvalidSelection &e)
+    {
+        invalidSelectionErrorDialog.setText(e.what());
         invalidSelectionErrorDialog.exec();
     }
 }
@@ -495,38 +1093,490 @@ void RenderArea::removeCurveSelection()
     selectedCoordinateString.clear();
 }
 
-void RenderArea::rebuildFunctionCache()
+void RenderArea::doIntegration(const QPoint &begin, const QPoint &end)
+{
+    real xFrom = plotter.pxToPt(std::min(begin.x(), end.x()), 0).getX();
+    real xTo = plotter.pxToPt(std::max(begin.x(), end.x()), 0).getX();
+    
+    try
+    {
+        std::pair<real, real> integral = plotter.getIntegralFromSelected(xFrom, xTo);
+        
+        integralString = "∫ = ";
+        integralString += real_functions::toString(integral.first).c_str();
+        integralString += " (±";
+        integralString += QString::number(static_cast<double>(integral.second), 'g', 2);
+        integralString += ")";
+        
+        integrationInterval = std::pair<real, real>(xFrom, xTo);
+        hasIntegral = true;
+        
+        rebuildIntegralArea();
+    }
+    catch (const InvalidSelection &e)
+    {
+        removeIntegral();
+        
+        invalidSelectionErrorDialog.setText(e.what());
+        invalidSelectionErrorDialog.exec();
+    }
+}
+
+void RenderArea::rebuildIntegralArea()
+{
+    integralArea = QPainterPath();
+    
+    if (hasIntegral && selectedFunction != npos)
+    {
+        plotter.getPlotSamples(selectedFunction, integrationInterval.first, integrationInterval.second, integralSamples);
+        
+        if (integralSamples.size() == 0) return;
+        
+        const float *x = integralSamples.getX();
+        const float *y = integralSamples.getY();
+        int baseline = plotter.getOrigo().getY();
+        
+        integralArea.moveTo(x[0], baseline);
+        
+        for (SampleBuffer::size_type i = 0; i != integralSamples.size(); ++i)
+        {
+            integralArea.lineTo(x[i], y[i]);
+        }
+        
+        integralArea.lineTo(x[integralSamples.size() - 1], baseline);
+        integralArea.closeSubpath();
+    }
+}
+
+void RenderArea::removeIntegral()
+{
+    hasIntegral = false;
+    integralString.clear();
+    integralArea = QPainterPath();
+}
+
+void RenderArea::startAnimation(const std::string &name, real value, real from, real to, int numFrames)
 {
-    functionCache.clear();
+    stopAnimation();
+    
+    // The integral and the marked point would belong to one frame
+    removeCurveSelection();
+    removeIntegral();
+    
+    animation = std::make_shared<Animation>(plotter, name, animatedExpressions(name, true), from, to, numFrames);
+    animationFrame = animation->getIndex(value);
+    animationDirection = 1;
+    animationCancelled = std::make_shared<std::atomic<bool>>(false);
+    
+    precomputeFrames();
+    animationTimer.start();
+}
+
+void RenderArea::stopAnimation()
+{
+    if (animation == nullptr) return;
+    
+    animationTimer.stop();
+    animationCancelled->store(true);
+    animation.reset();
+    
+    // Drawn from the variable again, which also brings back the analysis
+    rebuildFunctionCache();
+    update();
+}
+
+void RenderArea::nextAnimationFrame()
+{
+    int direction = animationDirection;
+    int index = animation->next(animationFrame, direction);
+    
+    // A frame that is not computed yet is waited for on the next tick
+    if (showAnimationFrame(index))
+    {
+        animationFrame = index;
+        animationDirection = direction;
+    }
+    
+    if (!animationWatcher.isRunning()) precomputeFrames();
+}
+
+std::vector<Plotter::size_type> RenderArea::animatedExpressions(const std::string &name, bool precomputed) const
+{
+    // Surfaces and complex functions are images rendered as usual, everything else has frames
+    std::vector<Plotter::size_type> indices;
     
     for (Plotter::size_type i = 0; i != plotter.numExpressions(); ++i)
     {
+        const Expression &expression = *(plotter.cbegin() + i);
+        const bool isSurface = expression.getKind() == Expression::SURFACE || expression.getKind() == Expression::COMPLEX;
+        
+        if (!plotter.isHidden(i) && expression.readsVariable(name) && isSurface != precomputed) indices.push_back(i);
+    }
+    
+    return indices;
+}
+
+void RenderArea::restartAnimation()
+{
+    // Frames of the old view or expressions can not be used
+    animationCancelled->store(true);
+    animationCancelled = std::make_shared<std::atomic<bool>>(false);
+    
+    const std::string name = animation->getVariable();
+    animation = std::make_shared<Animation>(plotter, name, animatedExpressions(name, true), animation->getValue(0), animation->getValue(animation->getNumFrames() - 1), animation->getNumFrames());
+    
+    precomputeFrames();
+}
+
+void RenderArea::precomputeFrames()
+{
+    std::shared_ptr<const Animation> current = animation;
+    std::shared_ptr<std::atomic<bool>> cancelled = animationCancelled;
+    int playhead = animationFrame;
+    int direction = animationDirection;
+    
+    animationWatcher.setFuture(QtConcurrent::run([current, cancelled, playhead, direction]()
+    {
+        current->precompute(playhead, direction, *cancelled);
+    }));
+}
+
+bool RenderArea::showAnimationFrame(int index)
+{
+    std::shared_ptr<const Animation::Frame> frame = animation->getFrame(index);
+    
+    if (frame == nullptr) return false;
+    
+    const real value = animation->getValue(index);
+    Expression::setVariable(animation->getVariable(), value);
+    
+    const std::vector<Plotter::size_type> &indices = animation->getExpressionIndices();
+    for (std::vector<Plotter::size_type>::size_type k = 0; k != indices.size(); ++k)
+    {
+        sampleCache[indices[k]] = frame->paths[k];
+        setCurvePath(indices[k], sampleCache[indices[k]]);
+        regionCache[indices[k]] = frame->regions[k];
+    }
+    
+    curveIndex.reset();
+    
+    rebuildRegionImage();
+    
+    // Roots and extrema are not looked for until the animation stops
+    criticalPoints.clear();
+    
+    std::vector<Plotter::size_type> surfaces = animatedExpressions(animation->getVariable(), false);
+    if (!surfaces.empty()) rebuildSurfaceImage();
+    
+    emit parameterAnimated(QString::fromStdString(animation->getVariable()), static_cast<double>(value));
+    
+    update();
+    
+    return true;
+}
+
+const QStaticText &RenderArea::markerLabel(const std::string &text)
+{
+    auto found = markerLabels.find(text);
+    if (found != markerLabels.end()) return found->second;
+    
+    // Labels that scrolled out of view are dropped now and then
+    if (markerLabels.size() >= MAX_MARKER_LABELS) markerLabels.clear();
+    
+    QStaticText label(QString::fromStdString(text));
+    label.setTextFormat(Qt::PlainText);
+    label.prepare(QTransform(), font());
+    
+    return markerLabels.emplace(text, label).first->second;
+}
+
+QPainterPath RenderArea::buildPath(const SampleBuffer &paths)
+{
+    QPainterPath functionPath;
+    
+    const float *x = paths.getX();
+    const float *y = paths.getY();
+    
+    for (SampleBuffer::size_type path = 0; path != paths.numPaths(); ++path)
+    {
+        const SampleBuffer::size_type begin = paths.getPathBegin(path);
+        functionPath.moveTo(x[begin], y[begin]);
+        
+        for (SampleBuffer::size_type i = begin; i != paths.getPathEnd(path); ++i)
+        {
+            functionPath.lineTo(x[i], y[i]);
+        }
+    }
+    
+    return functionPath;
+}
+
+bool RenderArea::isInView(const SampleBuffer &paths) const
+{
+    if (paths.size() == 0) return false;
+    
+    const float *x = paths.getX();
+    const float *y = paths.getY();
+    
+    float left = x[0], right = x[0];
+    float top = y[0], bottom = y[0];
+    
+    for (SampleBuffer::size_type i = 1; i != paths.size(); ++i)
+    {
+        left = std::min(left, x[i]);
+        right = std::max(right, x[i]);
+        top = std::min(top, y[i]);
+        bottom = std::max(bottom, y[i]);
+    }
+    
+    // A bold curve just outside still shows
+    return right >= -SELECTED_CURVE_WIDTH && left <= width() + SELECTED_CURVE_WIDTH && bottom >= -SELECTED_CURVE_WIDTH && top <= height() + SELECTED_CURVE_WIDTH;
+}
+
+void RenderArea::setCurvePath(Plotter::size_type expressionIndex, const SampleBuffer &paths)
+{
+    // Curves entirely above or below the view are not built or stroked
+    functionCache[expressionIndex] = isInView(paths) ? buildPath(paths) : QPainterPath();
+    
+    curveBatchIsOutdated[expressionIndex % FUNCTION_COLORS.size()] = true;
+    curveImageIsOutdated = true;
+}
+
+void RenderArea::drawCurves(QPainter &painter)
+{
+    const size_type numColors = FUNCTION_COLORS.size();
+    
+    for (size_type color = 0; color != numColors; ++color)
+    {
+        if (!curveBatchIsOutdated[color]) continue;
+        
+        curveBatches[color] = QPainterPath();
+        
+        for (size_type i = color; i < functionCache.size(); i += numColors)
+        {
+            if (!functionCache[i].isEmpty()) curveBatches[color].addPath(functionCache[i]);
+        }
+        
+        curveBatchIsOutdated[color] = false;
+    }
+    
+    // Antialiased since the paths are in fractions of pixels
+    painter.setRenderHint(QPainter::Antialiasing, true);
+    
+    for (size_type color = 0; color != numColors; ++color)
+    {
+        if (!curveBatches[color].isEmpty())
+        {
+            painter.setPen(QPen(QBrush(FUNCTION_COLORS[color]), CURVE_WIDTH));
+            painter.drawPath(curveBatches[color]);
+        }
+    }
+    
+    // The selected curve again, bold on top of the others
+    if (selectedFunction < functionCache.size() && !functionCache[selectedFunction].isEmpty())
+    {
+        painter.setPen(QPen(QBrush(FUNCTION_COLORS[selectedFunction % numColors]), SELECTED_CURVE_WIDTH));
+        painter.drawPath(functionCache[selectedFunction]);
+    }
+    
+    painter.setRenderHint(QPainter::Antialiasing, false);
+}
+
+void RenderArea::rasterizeCurves(QImage &image) const
+{
+    image.fill(Qt::transparent);
+    
+    PolylineRasterizer rasterizer(image.width(), image.height());
+    
+    for (size_type i = 0; i != sampleCache.size(); ++i)
+    {
+        if (i != selectedFunction && !functionCache[i].isEmpty())
+        {
+            rasterizer.add(sampleCache[i], FUNCTION_COLORS[i % FUNCTION_COLORS.size()].rgba(), CURVE_WIDTH);
+        }
+    }
+    
+    // The selected curve last, bold on top of the others
+    if (selectedFunction < sampleCache.size() && !functionCache[selectedFunction].isEmpty())
+    {
+        rasterizer.add(sampleCache[selectedFunction], FUNCTION_COLORS[selectedFunction % FUNCTION_COLORS.size()].rgba(), SELECTED_CURVE_WIDTH);
+    }
+    
+    rasterizer.render(reinterpret_cast<std::uint32_t *>(image.bits()));
+}
+
+void RenderArea::rebuildFunctionCache()
+{
+    if (animation != nullptr) restartAnimation();
+    
+    std::vector<Plotter::size_type> all(plotter.numExpressions());
+    std::iota(all.begin(), all.end(), 0);
+    
+    functionCache.resize(all.size());
+    sampleCache.resize(all.size());
+    regionCache.resize(all.size());
+    
+    rebuildFunctionCache(all, true);
+    rebuildDataCache();
+}
+
+void RenderArea::rebuildDataCache()
+{
+    dataCache.resize(dataSeries.size());
+    
+    for (std::vector<std::shared_ptr<const DataSeries>>::size_type i = 0; i != dataSeries.size(); ++i)
+    {
+        plotter.getDataPaths(*dataSeries[i], dataSamples);
+        dataCache[i] = buildPath(dataSamples);
+    }
+    
+#ifdef Q_OS_UNIX
+    if (stream != nullptr)
+    {
+        plotter.getStreamPaths(*stream, dataSamples);
+        streamCache = buildPath(dataSamples);
+    }
+#endif
+}
+
+void RenderArea::rebuildFunctionCache(const std::vector<Plotter::size_type> &expressionIndices, bool surfacesChanged)
+{
+    rebuildPaths(expressionIndices);
+    
+    if (surfacesChanged) rebuildSurfaceImage();
+    rebuildRegionImage();
+    
+    if (hasIntegral) rebuildIntegralArea();
+    
+    if (analysisEnabled) startAnalysis();
+}
+
+void RenderArea::rebuildPaths(const std::vector<Plotter::size_type> &expressionIndices)
+{
+    for (Plotter::size_type i : expressionIndices)
+    {
+        sampleCache[i].clear();
+        regionCache[i].reset();
+        
         if (plotter.isHidden(i))
         {
-            functionCache.emplace_back();
+            setCurvePath(i, sampleCache[i]);
+            continue;
+        }
+        
+        // The bounds and the fill of an inequality come from the same samples
+        if ((plotter.cbegin() + i)->getKind() == Expression::INEQUALITY)
+        {
+            regionCache[i] = std::make_shared<const InequalityRegion>(plotter.getRegion(i));
+            regionCache[i]->getBoundaries(sampleCache[i]);
         }
         else
         {
-            std::vector<Point<int>> s = plotter.getPlotSamples(i);
+            plotter.getPlotPaths(i, sampleCache[i]);
+        }
+        
+        setCurvePath(i, sampleCache[i]);
+    }
+    
+    curveIndex.reset();
+}
 
-            QPainterPath functionPath;
-            
-            if (!s.empty())
-            {
-                Point<int> firstPoint = s.front();
-                functionPath.moveTo(firstPoint.getX(), firstPoint.getY());
-                
-                for (const Point<int> &expr : s)
-                {
-                    functionPath.lineTo(expr.getX(), expr.getY());
-                }
-            }
-            
-            functionCache.emplace_back(functionPath);
+bool RenderArea::isSurface(Plotter::size_type expressionIndex) const
+{
+    const Expression::Kind kind = (plotter.cbegin() + expressionIndex)->getKind();
+    
+    return kind == Expression::SURFACE || kind == Expression::COMPLEX;
+}
+
+void RenderArea::rebuildSurfaceImage()
+{
+    surfaceImageCancelled->store(true);
+    surfaceImage = QImage();
+    
+    Plotter::size_type surface = plotter.numExpressions();
+    for (Plotter::size_type i = 0; i != plotter.numExpressions(); ++i)
+    {
+        Expression::Kind kind = (plotter.cbegin() + i)->getKind();
+        
+        if (!plotter.isHidden(i) && (kind == Expression::SURFACE || kind == Expression::COMPLEX)) surface = i;
+    }
+    
+    if (surface == plotter.numExpressions()) return;
+    
+    std::function<bool(std::uint32_t *, const std::atomic<bool> &)> render;
+    
+    if ((plotter.cbegin() + surface)->getKind() == Expression::SURFACE)
+    {
+        Heatmap heatmap = plotter.getHeatmap(surface);
+        
+        surfaceImage = QImage(heatmap.getPixelWidth(), heatmap.getPixelHeight(), QImage::Format_ARGB32);
+        heatmap.renderCoarse(reinterpret_cast<std::uint32_t *>(surfaceImage.bits()));
+        
+        render = [heatmap](std::uint32_t *pixels, const std::atomic<bool> &cancelled) { return heatmap.render(pixels, cancelled); };
+    }
+    else
+    {
+        DomainColoring coloring = plotter.getDomainColoring(surface);
+        
+        surfaceImage = QImage(coloring.getPixelWidth(), coloring.getPixelHeight(), QImage::Format_ARGB32);
+        coloring.renderCoarse(reinterpret_cast<std::uint32_t *>(surfaceImage.bits()));
+        
+        render = [coloring](std::uint32_t *pixels, const std::atomic<bool> &cancelled) { return coloring.render(pixels, cancelled); };
+    }
+    
+    if (surfaceImage.isNull()) return;
+    
+    // A newer render replaces the one that is running, its result is never delivered
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+    surfaceImageCancelled = cancelled;
+    
+    QSize size = surfaceImage.size();
+    
+    surfaceImageWatcher.setFuture(QtConcurrent::run([render, cancelled, size]() -> QImage
+    {
+        QImage image(size, QImage::Format_ARGB32);
+        
+        if (!render(reinterpret_cast<std::uint32_t *>(image.bits()), *cancelled)) return QImage();
+        
+        return image;
+    }));
+}
+
+void RenderArea::rebuildRegionImage()
+{
+    regionImage = QImage();
+    
+    for (size_type i = 0; i != regionCache.size(); ++i)
+    {
+        if (!regionCache[i]) continue;
+        
+        if (regionImage.isNull())
+        {
+            regionImage = QImage(regionCache[i]->getPixelWidth(), regionCache[i]->getPixelHeight(), QImage::Format_ARGB32_Premultiplied);
+            regionImage.fill(Qt::transparent);
         }
+        
+        // Same opacity as the area of an integral
+        QColor regionColor = FUNCTION_COLORS[i % FUNCTION_COLORS.size()];
+        regionColor.setAlpha(64);
+        
+        regionCache[i]->fill(regionColor.rgba(), reinterpret_cast<std::uint32_t *>(regionImage.bits()));
     }
 }
 
+void RenderArea::startAnalysis()
+{
+    Analyzer analyzer = plotter.getAnalyzer();
+    
+    // A newer analysis replaces the one that is running, which stops at its next curve or pair
+    analysisCancelled->store(true);
+    
+    std::shared_ptr<std::atomic<bool>> cancelled = std::make_shared<std::atomic<bool>>(false);
+    analysisCancelled = cancelled;
+    
+    analysisWatcher.setFuture(QtConcurrent::run([analyzer, cancelled]() { return analyzer.analyze(*cancelled); }));
+}
+
 bool RenderArea::ignoreZoomBox(const QPoint &begin, const QPoint &end)
 {
     return (end - begin).manhattanLength() <= IGNORE_ZOOM_BOX;
@@ -10,21 +10,43 @@
 #define __MathGraph__RenderArea__
 
 #include "Plotter.h"
+#include "Analyzer.h"
+#include "Animation.h"
+#include "PolylineRasterizer.h"
+#include "CurveIndex.h"
+#include "DataSeries.h"
+
+#ifdef Q_OS_UNIX
+#include "DataStream.h"
+#endif
 
 #include <QPainter>
 #include <QWidget>
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QMessageBox>
+#include <QFutureWatcher>
+#include <QImage>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QStaticText>
 
 #include <vector>
 #include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
 
 enum GraphTool
 {
     MOVE,
     SELECTION,
-    ZOOM
+    ZOOM,
+    INTEGRATION
 };
 
 class RenderArea : public QWidget
@@ -39,7 +61,12 @@ public:
     QSize minimumSizeHint() const;
     QSize sizeHint() const;
     
+    // Only the new expression, and the ones calling it if it is a definition, are drawn. The index of
+    // an expression does not change when others are removed.
     Plotter::size_type addFunction(const Expression &expr);
+    
+    // Also recompiles and redraws the expressions calling a replaced definition, may throw InvalidExpression
+    void replaceFunction(Plotter::size_type expressionIndex, const Expression &expr);
     Plotter::size_type removeSelectedFunction();
     void centerOrigo();
     void setTool(GraphTool _graphTool);
@@ -48,11 +75,55 @@ public:
     void select(Plotter::size_type expressionIndex);
     void setEnabled(Plotter::size_type expressionIndex, bool enabled);
     
+    // Only the expressions reading the variable are drawn again
+    void setParameter(const std::string &name, real value);
+    
+    // Sweeps the variable back and forth from its value, numFrames values over [from, to]. The frames are
+    // computed ahead in the background and drawn at a steady rate. Setting the variable while animating
+    // jumps to the closest frame.
+    void startAnimation(const std::string &name, real value, real from, real to, int numFrames);
+    void stopAnimation();
+    
+    // The file is parsed or mapped in the background and drawn under the curves when it is ready.
+    // An error is shown in a message box.
+    void loadDataSeries(const QString &path);
+    const std::vector<std::shared_ptr<const DataSeries>> &getDataSeries() const;
+    
+#ifdef Q_OS_UNIX
+    // Plots the samples read from standard input, or from a Unix socket at the path, and scrolls the
+    // view along with the latest one. The window length bounds the samples kept. Replaces the stream
+    // before it, may throw DataFileError. Streams are read with POSIX calls and only exist on Unix.
+    void startStream(const std::string &socketPath, DataStream::size_type windowLength);
+#endif
+    
     void keyPressEvent(QKeyEvent *event);
     void keyReleaseEvent(QKeyEvent *event);
     
+signals:
+    void parameterAnimated(const QString &name, double value);
+    void parameterFitted(const QString &name, double value);
+    void curveClicked(int expressionIndex);
+    
 public slots:
     void autoYBounds();
+    void setAnalysisEnabled(bool enabled);
+    void setRasterizerEnabled(bool enabled);
+    void benchmarkCurveDrawing();
+    void showSurfaceView();
+    void fitSelectedToData();
+    void clearDataSeries();
+#ifdef Q_OS_UNIX
+    void stopStream();
+#endif
+    
+private slots:
+    void analysisFinished();
+    void surfaceImageFinished();
+    void nextAnimationFrame();
+    void dataSeriesLoaded();
+#ifdef Q_OS_UNIX
+    void nextStreamFrame();
+#endif
     
 protected:
     void paintEvent(QPaintEvent *event);
@@ -67,9 +138,35 @@ private:
     std::pair<int, int> getYBounds(Plotter::size_type expressionIndex) const;
     void move(const QPoint &newPosition);
     void doCurveSelection(const QPoint &pos);
+    void doCurveClick(const QPoint &pos, bool alt);
+    const CurveIndex &getCurveIndex();
+    bool selectedIsDifferential() const;
+    void doSolution(const QPoint &pos, bool clear);
     void removeCurveSelection();
+    void doIntegration(const QPoint &begin, const QPoint &end);
+    void rebuildIntegralArea();
+    void removeIntegral();
     void rebuildFunctionCache();
+    void rebuildFunctionCache(const std::vector<Plotter::size_type> &expressionIndices, bool surfacesChanged);
+    void rebuildPaths(const std::vector<Plotter::size_type> &expressionIndices);
+    bool isSurface(Plotter::size_type expressionIndex) const;
+    bool isInView(const SampleBuffer &paths) const;
+    void setCurvePath(Plotter::size_type expressionIndex, const SampleBuffer &paths);
+    void rebuildSurfaceImage();
+    void rebuildRegionImage();
+    void rebuildDataCache();
+    void loadNextDataSeries();
+    void startAnalysis();
+    std::vector<Plotter::size_type> animatedExpressions(const std::string &name, bool precomputed) const;
+    void restartAnimation();
+    void precomputeFrames();
+    bool showAnimationFrame(int index);
+    void drawCurves(QPainter &painter);
+    const QStaticText &markerLabel(const std::string &text);
+    void rasterizeCurves(QImage &image) const;
+    static QPainterPath buildPath(const SampleBuffer &paths);
     const int IGNORE_ZOOM_BOX = 8; // No box zoom if area is less or equal
+    const std::vector<CriticalPoint>::size_type MAX_LABELED_POINTS = 30; // Only markers if there are more points
     bool ignoreZoomBox(const QPoint &begin, const QPoint &end);
     
     typedef std::vector<QPainterPath>::size_type size_type;
@@ -85,10 +182,93 @@ private:
     bool leftDrag; // In case dragging started outside widget
     QString selectedCoordinateString;
     
+    // Integral of the selected function, the area is rebuilt with the function cache
+    bool hasIntegral;
+    std::pair<real, real> integrationInterval;
+    QString integralString;
+    QPainterPath integralArea;
+    
+    // Marker labels laid out once, by their text
+    const std::map<std::string, QStaticText>::size_type MAX_MARKER_LABELS = 256;
+    std::map<std::string, QStaticText> markerLabels;
+    
     Plotter plotter;
     std::vector<QPainterPath> functionCache;
     size_type selectedFunction;
     
+    // Pixel samples of the paths in the function cache, the memory is kept for the next rebuild.
+    // Curves outside the view have samples but an empty path.
+    std::vector<SampleBuffer> sampleCache;
+    
+    // The paths of the curves of each color joined, so that each pen is set and stroked once
+    std::vector<QPainterPath> curveBatches;
+    std::vector<bool> curveBatchIsOutdated;
+    SampleBuffer integralSamples;
+    
+    // Curves can be drawn by the parallel rasterizer into an image that is kept between paints, and
+    // drawn again only when the curves, the selection or the size change
+    const float CURVE_WIDTH = 1;
+    const float SELECTED_CURVE_WIDTH = 3;
+    bool rasterizerEnabled;
+    QImage curveImage;
+    bool curveImageIsOutdated;
+    
+    // The selection tool snaps to curves within this many pixels, found in an index of the sample
+    // cache that is built when it is first needed after the cache changes
+    const float SNAP_DISTANCE = 8;
+    std::shared_ptr<const CurveIndex> curveIndex;
+    
+    // Roots, extrema and intersections, computed in the background after each cache rebuild.
+    // Setting the flag abandons the analysis that is running.
+    bool analysisEnabled;
+    std::vector<CriticalPoint> criticalPoints;
+    std::shared_ptr<std::atomic<bool>> analysisCancelled;
+    QFutureWatcher<std::vector<CriticalPoint>> analysisWatcher;
+    
+    // Heatmap or domain coloring of the last visible surface or complex function. A coarse image
+    // is shown at once and replaced when the full resolution one is rendered in the background,
+    // setting the flag abandons that render.
+    QImage surfaceImage;
+    std::shared_ptr<std::atomic<bool>> surfaceImageCancelled;
+    QFutureWatcher<QImage> surfaceImageWatcher;
+    
+    // Regions of the visible inequalities, filled together into one image under the curves
+    std::vector<std::shared_ptr<const InequalityRegion>> regionCache;
+    QImage regionImage;
+    
+    // The animation being played, frames that are not computed yet are waited for without blocking
+    const int FRAME_INTERVAL = 40; // Milliseconds
+    std::shared_ptr<Animation> animation;
+    int animationFrame;
+    int animationDirection;
+    QTimer animationTimer;
+    std::shared_ptr<std::atomic<bool>> animationCancelled;
+    QFutureWatcher<void> animationWatcher;
+    
+    // Measured data, downsampled for the view when the function cache is rebuilt. Files are loaded one
+    // at a time, the first pending one is being loaded and an error is passed back in the string.
+    const QColor DATA_COLOR = Qt::darkGray;
+    std::vector<std::shared_ptr<const DataSeries>> dataSeries;
+    std::vector<QPainterPath> dataCache;
+    SampleBuffer dataSamples;
+    std::deque<std::string> pendingDataFiles;
+    std::shared_ptr<std::string> dataSeriesError;
+    QFutureWatcher<std::shared_ptr<const DataSeries>> dataSeriesWatcher;
+    
+#ifdef Q_OS_UNIX
+    // The live stream is drained and drawn at a capped rate, not for every sample
+    const int STREAM_FRAME_INTERVAL = 33; // Milliseconds
+    std::unique_ptr<DataStream> stream;
+    QTimer streamTimer;
+    
+    // A running animation is restarted for the scrolled view at most this often, its curves lag behind
+    // the view until then. Restarting on every frame would throw away its frames before they are shown.
+    const qint64 STREAM_ANIMATION_INTERVAL = 500; // Milliseconds
+    QElapsedTimer streamAnimationTimer;
+    bool streamAnimationIsOutdated;
+#endif
+    QPainterPath streamCache;
+    
     QMessageBox invalidSelectionErrorDialog;
 };
 
@@ -0,0 +1,86 @@
+//
+//  SampleBuffer.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "SampleBuffer.h"
+
+SampleBuffer::SampleBuffer()
+    : x(),
+      y(),
+      pathBegins(),
+      broken(true)
+{
+}
+
+void SampleBuffer::clear()
+{
+    x.clear();
+    y.clear();
+    pathBegins.clear();
+    broken = true;
+}
+
+void SampleBuffer::reserve(size_type numPoints)
+{
+    x.reserve(numPoints);
+    y.reserve(numPoints);
+}
+
+void SampleBuffer::add(float _x, float _y)
+{
+    if (broken) pathBegins.push_back(x.size());
+    broken = false;
+    
+    x.push_back(_x);
+    y.push_back(_y);
+}
+
+void SampleBuffer::breakPath()
+{
+    broken = true;
+}
+
+SampleBuffer::size_type SampleBuffer::size() const
+{
+    return x.size();
+}
+
+SampleBuffer::size_type SampleBuffer::numPaths() const
+{
+    return pathBegins.size();
+}
+
+SampleBuffer::size_type SampleBuffer::getPathBegin(size_type path) const
+{
+    return pathBegins[path];
+}
+
+SampleBuffer::size_type SampleBuffer::getPathEnd(size_type path) const
+{
+    return path + 1 != pathBegins.size() ? pathBegins[path + 1] : x.size();
+}
+
+const float *SampleBuffer::getX() const
+{
+    return x.data();
+}
+
+const float *SampleBuffer::getY() const
+{
+    return y.data();
+}
+
+void SampleBuffer::toPixels(const real *world, std::size_t count, real origin, real scale, float *pixels)
+{
+    // The difference is taken in full precision, far from the origin the samples are close together
+    for (std::size_t i = 0; i != count; ++i)
+    {
+        const real pixel = (world[i] - origin) * scale;
+        
+        pixels[i] = static_cast<float>(pixel < -MAX_PIXEL ? -MAX_PIXEL : pixel > MAX_PIXEL ? MAX_PIXEL : pixel);
+    }
+}
@@ -0,0 +1,57 @@
+//
+//  SampleBuffer.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__SampleBuffer__
+#define __MathGraph__SampleBuffer__
+
+#include "real.h"
+
+#include <cstddef>
+#include <vector>
+
+// Polylines in pixel coordinates. The x and y coordinates of all points are kept in two contiguous
+// float arrays, which keeps the fractions of pixels for antialiased drawing, and whole arrays of
+// samples are moved to the viewport at once. clear keeps the memory, so a buffer that is filled
+// again for every redraw stops allocating once it has grown.
+class SampleBuffer
+{
+public:
+    typedef std::vector<float>::size_type size_type;
+    
+    SampleBuffer();
+    
+    void clear();
+    void reserve(size_type numPoints);
+    
+    // Points are added to the last polyline, breakPath starts a new one. Empty polylines are not kept.
+    void add(float x, float y);
+    void breakPath();
+    
+    size_type size() const;
+    size_type numPaths() const;
+    
+    // The points of a polyline are [getPathBegin(path), getPathEnd(path)) in the coordinate arrays
+    size_type getPathBegin(size_type path) const;
+    size_type getPathEnd(size_type path) const;
+    const float *getX() const;
+    const float *getY() const;
+    
+    // Viewport transform of one axis, pixels[i] = (world[i] - origin) * scale. Far outside the view
+    // the exact position does not matter and is clamped to MAX_PIXEL, NaN stays NaN.
+    static void toPixels(const real *world, std::size_t count, real origin, real scale, float *pixels);
+    
+    static const int MAX_PIXEL = 1 << 20;
+    
+private:
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<size_type> pathBegins;
+    bool broken; // The next point begins a polyline
+};
+
+#endif /* defined(__MathGraph__SampleBuffer__) */
@@ -0,0 +1,73 @@
+//
+//  SampleRing.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "SampleRing.h"
+
+#include <algorithm>
+
+namespace
+{
+    SampleRing::size_type roundUpToPowerOfTwo(SampleRing::size_type n)
+    {
+        SampleRing::size_type power = 1;
+        while (power < n) power *= 2;
+        
+        return power;
+    }
+}
+
+SampleRing::SampleRing(size_type capacity)
+    : xs(roundUpToPowerOfTwo(std::max<size_type>(capacity, 2))),
+      ys(xs.size()),
+      mask(xs.size() - 1),
+      head(0),
+      cachedTail(0),
+      tail(0),
+      cachedHead(0)
+{
+}
+
+bool SampleRing::push(double x, double y)
+{
+    const size_type position = head.load(std::memory_order_relaxed);
+    
+    if (position - cachedTail == xs.size())
+    {
+        cachedTail = tail.load(std::memory_order_acquire);
+        
+        if (position - cachedTail == xs.size()) return false;
+    }
+    
+    xs[position & mask] = x;
+    ys[position & mask] = y;
+    
+    // The sample is written before the consumer can see the new head
+    head.store(position + 1, std::memory_order_release);
+    
+    return true;
+}
+
+SampleRing::size_type SampleRing::pop(double *x, double *y, size_type maxCount)
+{
+    const size_type position = tail.load(std::memory_order_relaxed);
+    
+    if (cachedHead - position < maxCount) cachedHead = head.load(std::memory_order_acquire);
+    
+    const size_type count = std::min(cachedHead - position, maxCount);
+    
+    for (size_type i = 0; i != count; ++i)
+    {
+        x[i] = xs[(position + i) & mask];
+        y[i] = ys[(position + i) & mask];
+    }
+    
+    // The samples are read before the producer can write over them
+    tail.store(position + count, std::memory_order_release);
+    
+    return count;
+}
@@ -0,0 +1,51 @@
+//
+//  SampleRing.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__SampleRing__
+#define __MathGraph__SampleRing__
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+// Fixed size queue of (x, y) samples between one producer thread and one consumer thread, without
+// locks. Each side only writes its own position and reads the other's, and keeps a copy of the
+// other's position from the last time it looked, so the positions only move between cores when
+// the ring seems full or empty.
+class SampleRing
+{
+public:
+    typedef std::size_t size_type;
+    
+    // The capacity is rounded up to a power of two
+    SampleRing(size_type capacity);
+    
+    SampleRing(const SampleRing &) = delete;
+    SampleRing &operator=(const SampleRing &) = delete;
+    
+    // Producer, never waits. Returns false and drops the sample if the ring is full.
+    bool push(double x, double y);
+    
+    // Consumer, takes up to maxCount samples in order and returns how many
+    size_type pop(double *x, double *y, size_type maxCount);
+    
+private:
+    std::vector<double> xs;
+    std::vector<double> ys;
+    size_type mask;
+    
+    // Positions count samples from the start and wrap around the ring through the mask. The padding
+    // keeps the producer's and the consumer's fields on different cache lines.
+    std::atomic<size_type> head; // Next sample to write
+    size_type cachedTail;
+    char padding[64];
+    std::atomic<size_type> tail; // Next sample to read
+    size_type cachedHead;
+};
+
+#endif /* defined(__MathGraph__SampleRing__) */
@@ -0,0 +1,79 @@
+//
+//  SlopeField.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "SlopeField.h"
+
+#include <cmath>
+
+SlopeField::SlopeField(const Expression &_equation, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight)
+    : equation(_equation),
+      xMin(_xMin),
+      xMax(_xMax),
+      yMin(_yMin),
+      yMax(_yMax),
+      pixelWidth(_pixelWidth),
+      pixelHeight(_pixelHeight)
+{
+}
+
+void SlopeField::getSegments(SampleBuffer &paths) const
+{
+    if (pixelWidth <= 0 || pixelHeight <= 0) return;
+    
+    const int columns = pixelWidth / SPACING + 1;
+    const int rows = pixelHeight / SPACING + 1;
+    
+    // Center the grid in the view
+    const int left = (pixelWidth - (columns - 1) * SPACING) / 2;
+    const int top = (pixelHeight - (rows - 1) * SPACING) / 2;
+    
+    const real xPixel = (xMax - xMin) / pixelWidth;
+    const real yPixel = (yMax - yMin) / pixelHeight;
+    
+    std::vector<real> xs(static_cast<std::size_t>(columns) * rows);
+    std::vector<real> ys(xs.size());
+    std::vector<real> slopes(xs.size());
+    
+    for (std::size_t k = 0; k != xs.size(); ++k)
+    {
+        xs[k] = xMin + (left + static_cast<int>(k % columns) * SPACING) * xPixel;
+        ys[k] = yMax - (top + static_cast<int>(k / columns) * SPACING) * yPixel;
+    }
+    
+    equation.evaluate(xs.data(), ys.data(), slopes.data(), xs.size());
+    
+    paths.reserve(paths.size() + 2 * xs.size());
+    
+    for (std::size_t k = 0; k != xs.size(); ++k)
+    {
+        if (std::isnan(slopes[k])) continue;
+        
+        // Direction (1, f) in pixels, y grows downwards on screen
+        real dx = 1 / xPixel;
+        real dy = -slopes[k] / yPixel;
+        
+        if (std::isinf(slopes[k]))
+        {
+            dx = 0;
+            dy = 1;
+        }
+        
+        real scale = SEGMENT_LENGTH / (2 * std::hypot(dx, dy));
+        float offsetX = static_cast<float>(dx * scale);
+        float offsetY = static_cast<float>(dy * scale);
+        
+        float centerX = static_cast<float>(left + static_cast<int>(k % columns) * SPACING);
+        float centerY = static_cast<float>(top + static_cast<int>(k / columns) * SPACING);
+        
+        paths.breakPath();
+        paths.add(centerX - offsetX, centerY - offsetY);
+        paths.add(centerX + offsetX, centerY + offsetY);
+    }
+    
+    paths.breakPath();
+}
@@ -0,0 +1,40 @@
+//
+//  SlopeField.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__SlopeField__
+#define __MathGraph__SlopeField__
+
+#include "real.h"
+#include "Expression.h"
+#include "SampleBuffer.h"
+
+#include <vector>
+
+// Short line segments with the slope of dy/dx = f(x, y) on a regular pixel grid. The grid is
+// evaluated as one batch.
+class SlopeField
+{
+public:
+    SlopeField(const Expression &_equation, real _xMin, real _xMax, real _yMin, real _yMax, int _pixelWidth, int _pixelHeight);
+    
+    // Adds one polyline with two points to paths per grid point where the slope is defined
+    void getSegments(SampleBuffer &paths) const;
+    
+private:
+    // Pixels between the grid points and the length of the segments
+    static const int SPACING = 24;
+    static const int SEGMENT_LENGTH = 14;
+    
+    Expression equation;
+    real xMin, xMax;
+    real yMin, yMax;
+    int pixelWidth;
+    int pixelHeight;
+};
+
+#endif /* defined(__MathGraph__SlopeField__) */
@@ -0,0 +1,250 @@
+//
+//  SurfacePlot.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "SurfacePlot.h"
+#include "Heatmap.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <limits>
+
+SurfacePlot::SurfacePlot(const Expression &expression, real xMin, real xMax, real yMin, real yMax, int _resolution)
+    : resolution(std::max(_resolution, 1)),
+      heights(),
+      levels()
+{
+    const std::size_t n = resolution + 1;
+    
+    std::vector<real> xs(n * n);
+    std::vector<real> ys(n * n);
+    std::vector<real> zs(n * n);
+    
+    for (std::size_t k = 0; k != xs.size(); ++k)
+    {
+        xs[k] = xMin + (xMax - xMin) * static_cast<real>(k % n) / resolution;
+        ys[k] = yMin + (yMax - yMin) * static_cast<real>(k / n) / resolution;
+    }
+    
+    expression.evaluate(xs.data(), ys.data(), zs.data(), zs.size());
+    
+    // Like the heatmap, a few extreme values do not flatten the rest of the surface
+    std::vector<real> finite;
+    std::copy_if(zs.begin(), zs.end(), std::back_inserter(finite), [](real z) { return std::isfinite(z); });
+    
+    real low = 0;
+    real high = 0;
+    
+    if (!finite.empty())
+    {
+        std::nth_element(finite.begin(), finite.begin() + (finite.size() - 1) / 100, finite.end());
+        low = finite[(finite.size() - 1) / 100];
+        
+        std::nth_element(finite.begin(), finite.begin() + (finite.size() - 1) * 99 / 100, finite.end());
+        high = finite[(finite.size() - 1) * 99 / 100];
+    }
+    
+    if (!(high > low))
+    {
+        low -= 1;
+        high = low + 2;
+    }
+    
+    heights.resize(zs.size());
+    levels.resize(zs.size());
+    
+    for (std::size_t k = 0; k != zs.size(); ++k)
+    {
+        if (std::isnan(zs[k]))
+        {
+            heights[k] = levels[k] = std::numeric_limits<float>::quiet_NaN();
+        }
+        else
+        {
+            float level = static_cast<float>(std::max<real>(0, std::min<real>(1, (zs[k] - low) / (high - low))));
+            
+            levels[k] = level;
+            heights[k] = (level - 0.5f) * 1.4f;
+        }
+    }
+}
+
+void SurfacePlot::render(double yaw, double pitch, double zoom, int width, int height, bool interactive, std::uint32_t *pixels) const
+{
+    if (width <= 0 || height <= 0) return;
+    
+    const std::size_t n = resolution + 1;
+    
+    const float cosYaw = static_cast<float>(std::cos(yaw));
+    const float sinYaw = static_cast<float>(std::sin(yaw));
+    const float cosPitch = static_cast<float>(std::cos(pitch));
+    const float sinPitch = static_cast<float>(std::sin(pitch));
+    const float scale = static_cast<float>(zoom * 0.3 * std::min(width, height) * CAMERA_DISTANCE);
+    
+    // Level of detail, cells in the middle of the surface are about scale / CAMERA_DISTANCE * 2 / resolution pixels wide
+    const int minCellPixels = interactive ? MIN_INTERACTIVE_CELL_PIXELS : MIN_CELL_PIXELS;
+    
+    int stride = 1;
+    while (stride < resolution && scale / CAMERA_DISTANCE * 2 * stride / resolution < minCellPixels) stride *= 2;
+    
+    // Any resolution works, the last cell on each side is narrower if the stride does not divide it
+    const int cells = (resolution + stride - 1) / stride;
+    
+    // Project the vertices that are used, depth is the distance along the view direction
+    const std::size_t m = cells + 1;
+    std::vector<float> screenX(m * m);
+    std::vector<float> screenY(m * m);
+    std::vector<float> depth(m * m);
+    std::vector<float> worldX(m * m);
+    std::vector<float> worldY(m * m);
+    std::vector<float> worldZ(m * m);
+    std::vector<float> level(m * m);
+    
+    for (std::size_t j = 0; j != m; ++j)
+    {
+        for (std::size_t i = 0; i != m; ++i)
+        {
+            const std::size_t k = j * m + i;
+            const std::size_t column = std::min<std::size_t>(i * stride, resolution);
+            const std::size_t row = std::min<std::size_t>(j * stride, resolution);
+            const std::size_t grid = row * n + column;
+            
+            const float u = -1 + 2.0f * column / resolution;
+            const float v = -1 + 2.0f * row / resolution;
+            const float h = heights[grid];
+            
+            const float x = u * cosYaw - v * sinYaw;
+            const float y = u * sinYaw + v * cosYaw;
+            const float up = y * sinPitch + h * cosPitch;
+            const float distance = CAMERA_DISTANCE + y * cosPitch - h * sinPitch;
+            
+            screenX[k] = width / 2.0f + x * scale / distance;
+            screenY[k] = height / 2.0f - up * scale / distance;
+            depth[k] = distance;
+            worldX[k] = u;
+            worldY[k] = v;
+            worldZ[k] = h;
+            level[k] = levels[grid];
+        }
+    }
+    
+    // Two triangles per cell, the indices of their corners
+    std::vector<std::size_t> corners;
+    corners.reserve(static_cast<std::size_t>(cells) * cells * 6);
+    
+    for (std::size_t j = 0; j != m - 1; ++j)
+    {
+        for (std::size_t i = 0; i != m - 1; ++i)
+        {
+            const std::size_t k = j * m + i;
+            const std::size_t quad[6] = {k, k + 1, k + m, k + 1, k + m + 1, k + m};
+            
+            for (int t = 0; t != 6; t += 3)
+            {
+                if (std::isnan(depth[quad[t]]) || std::isnan(depth[quad[t + 1]]) || std::isnan(depth[quad[t + 2]])) continue;
+                
+                corners.insert(corners.end(), quad + t, quad + t + 3);
+            }
+        }
+    }
+    
+    // Sort the triangles into the bands they cover
+    const int numBands = (height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    std::vector<std::vector<std::size_t>> bands(numBands);
+    
+    for (std::size_t t = 0; t < corners.size(); t += 3)
+    {
+        float top = std::min(std::min(screenY[corners[t]], screenY[corners[t + 1]]), screenY[corners[t + 2]]);
+        float bottom = std::max(std::max(screenY[corners[t]], screenY[corners[t + 1]]), screenY[corners[t + 2]]);
+        
+        if (bottom < 0 || top >= height) continue;
+        
+        int first = std::max(0, static_cast<int>(top) / BAND_HEIGHT);
+        int last = std::min(numBands - 1, static_cast<int>(bottom) / BAND_HEIGHT);
+        
+        for (int band = first; band <= last; ++band) bands[band].push_back(t);
+    }
+    
+    const std::vector<std::uint32_t> &colors = Heatmap::colorMap();
+    
+    // Lambert shading from a light above and behind the camera, lit from both sides
+    const float lightX = -0.3f;
+    const float lightY = -0.5f;
+    const float lightZ = 0.81f;
+    
+    ThreadPool::globalInstance().parallelFor(numBands, [&](ThreadPool::size_type band)
+    {
+        const int top = static_cast<int>(band) * BAND_HEIGHT;
+        const int bottom = std::min(height, top + BAND_HEIGHT);
+        
+        std::fill(pixels + static_cast<std::size_t>(top) * width, pixels + static_cast<std::size_t>(bottom) * width, 0xffffffffu);
+        std::vector<float> zBuffer(static_cast<std::size_t>(bottom - top) * width, std::numeric_limits<float>::infinity());
+        
+        for (std::size_t t : bands[band])
+        {
+            const std::size_t a = corners[t];
+            const std::size_t b = corners[t + 1];
+            const std::size_t c = corners[t + 2];
+            
+            const float area = (screenX[b] - screenX[a]) * (screenY[c] - screenY[a]) - (screenX[c] - screenX[a]) * (screenY[b] - screenY[a]);
+            if (std::abs(area) < 1e-6f) continue;
+            
+            // Flat shaded, the color is the level at the center
+            float nx = (worldY[b] - worldY[a]) * (worldZ[c] - worldZ[a]) - (worldZ[b] - worldZ[a]) * (worldY[c] - worldY[a]);
+            float ny = (worldZ[b] - worldZ[a]) * (worldX[c] - worldX[a]) - (worldX[b] - worldX[a]) * (worldZ[c] - worldZ[a]);
+            float nz = (worldX[b] - worldX[a]) * (worldY[c] - worldY[a]) - (worldY[b] - worldY[a]) * (worldX[c] - worldX[a]);
+            float light = std::abs(nx * lightX + ny * lightY + nz * lightZ) / std::sqrt(nx * nx + ny * ny + nz * nz);
+            float brightness = 0.35f + 0.65f * light;
+            
+            std::uint32_t base = colors[static_cast<std::size_t>((level[a] + level[b] + level[c]) / 3 * (colors.size() - 1) + 0.5f)];
+            std::uint32_t color = 0xff000000u;
+            for (int shift = 0; shift != 24; shift += 8)
+            {
+                color |= static_cast<std::uint32_t>(((base >> shift) & 0xff) * brightness) << shift;
+            }
+            
+            int minX = std::max(0, static_cast<int>(std::floor(std::min(std::min(screenX[a], screenX[b]), screenX[c]))));
+            int maxX = std::min(width - 1, static_cast<int>(std::ceil(std::max(std::max(screenX[a], screenX[b]), screenX[c]))));
+            int minY = std::max(top, static_cast<int>(std::floor(std::min(std::min(screenY[a], screenY[b]), screenY[c]))));
+            int maxY = std::min(bottom - 1, static_cast<int>(std::ceil(std::max(std::max(screenY[a], screenY[b]), screenY[c]))));
+            
+            // Barycentric coordinates are linear, so they are stepped along the rows
+            const float stepA = (screenY[b] - screenY[c]) / area;
+            const float stepB = (screenY[c] - screenY[a]) / area;
+            
+            for (int py = minY; py <= maxY; ++py)
+            {
+                const float x = minX + 0.5f;
+                const float y = py + 0.5f;
+                
+                float wa = ((screenX[b] - x) * (screenY[c] - y) - (screenX[c] - x) * (screenY[b] - y)) / area;
+                float wb = ((screenX[c] - x) * (screenY[a] - y) - (screenX[a] - x) * (screenY[c] - y)) / area;
+                
+                float *stored = zBuffer.data() + static_cast<std::size_t>(py - top) * width;
+                std::uint32_t *out = pixels + static_cast<std::size_t>(py) * width;
+                
+                for (int px = minX; px <= maxX; ++px, wa += stepA, wb += stepB)
+                {
+                    // All are positive inside the triangle
+                    float wc = 1 - wa - wb;
+                    
+                    if (wa < 0 || wb < 0 || wc < 0) continue;
+                    
+                    float z = wa * depth[a] + wb * depth[b] + wc * depth[c];
+                    
+                    if (z < stored[px])
+                    {
+                        stored[px] = z;
+                        out[px] = color;
+                    }
+                }
+            }
+        }
+    });
+}
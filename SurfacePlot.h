@@ -0,0 +1,52 @@
+//
+//  SurfacePlot.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__SurfacePlot__
+#define __MathGraph__SurfacePlot__
+
+#include "real.h"
+#include "Expression.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// 3D view of z = f(x, y) over a rectangle, rasterized on the CPU. The grid is evaluated once as one
+// batch. Every frame the vertices are projected, the triangles are sorted into horizontal bands of
+// the image, and the bands are filled in parallel, each with its own part of the z-buffer.
+class SurfacePlot
+{
+public:
+    // resolution is the number of grid cells per side
+    SurfacePlot(const Expression &expression, real xMin, real xMax, real yMin, real yMax, int _resolution = 256);
+    
+    // yaw turns the surface around the z-axis and pitch is the angle of the camera above the xy-plane.
+    // Where the cells would be smaller than a pixel, or a few pixels while interactive, only every
+    // second, fourth and so on grid line is drawn, and always the last one.
+    void render(double yaw, double pitch, double zoom, int width, int height, bool interactive, std::uint32_t *pixels) const;
+    
+private:
+    // Rows of pixels per band
+    static const int BAND_HEIGHT = 16;
+    
+    // The grid is coarsened until cells are at least this many pixels wide on screen
+    static const int MIN_CELL_PIXELS = 1;
+    static const int MIN_INTERACTIVE_CELL_PIXELS = 4;
+    
+    // The camera is at this distance from the center of the [-1, 1] x [-1, 1] square
+    static const int CAMERA_DISTANCE = 4;
+    
+    int resolution;
+    
+    // Grid values row by row, heights are scaled to [-0.7, 0.7] and levels to [0, 1] for
+    // the colors, undefined points are NaN
+    std::vector<float> heights;
+    std::vector<float> levels;
+};
+
+#endif /* defined(__MathGraph__SurfacePlot__) */
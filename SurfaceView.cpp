@@ -0,0 +1,102 @@
+//
+//  SurfaceView.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "SurfaceView.h"
+
+#include <QPainter>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+SurfaceView::SurfaceView(const SurfacePlot &_surface, QWidget *_parent)
+    : QWidget(_parent, Qt::Window),
+      surface(_surface),
+      yaw(-0.6),
+      pitch(0.5),
+      zoom(1),
+      interactive(false),
+      lastPosition(),
+      refineTimer(),
+      image()
+{
+    setWindowTitle("3D view");
+    setAttribute(Qt::WA_DeleteOnClose);
+    setAttribute(Qt::WA_OpaquePaintEvent);
+    setCursor(Qt::OpenHandCursor);
+    
+    refineTimer.setSingleShot(true);
+    refineTimer.setInterval(REFINE_DELAY);
+    connect(&refineTimer, SIGNAL(timeout()), this, SLOT(refine()));
+}
+
+QSize SurfaceView::sizeHint() const
+{
+    return QSize(640, 480);
+}
+
+void SurfaceView::refine()
+{
+    interactive = false;
+    
+    update();
+}
+
+void SurfaceView::paintEvent(QPaintEvent *)
+{
+    if (image.size() != size()) image = QImage(size(), QImage::Format_ARGB32);
+    
+    surface.render(yaw, pitch, zoom, image.width(), image.height(), interactive, reinterpret_cast<std::uint32_t *>(image.bits()));
+    
+    QPainter painter(this);
+    painter.drawImage(0, 0, image);
+}
+
+void SurfaceView::mousePressEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton)
+    {
+        lastPosition = event->pos();
+        setCursor(Qt::ClosedHandCursor);
+    }
+}
+
+void SurfaceView::mouseMoveEvent(QMouseEvent *event)
+{
+    if (event->buttons() & Qt::LeftButton)
+    {
+        QPoint delta = event->pos() - lastPosition;
+        lastPosition = event->pos();
+        
+        yaw -= delta.x() * RADIANS_PER_PIXEL;
+        pitch = std::max(-MAX_PITCH, std::min(MAX_PITCH, pitch + delta.y() * RADIANS_PER_PIXEL));
+        
+        interact();
+    }
+}
+
+void SurfaceView::mouseReleaseEvent(QMouseEvent *)
+{
+    setCursor(Qt::OpenHandCursor);
+}
+
+void SurfaceView::wheelEvent(QWheelEvent *event)
+{
+    // A wheel notch is 120, in eighths of a degree
+    zoom *= std::pow(1.25, event->angleDelta().y() / 120.0);
+    zoom = std::max(0.1, std::min(10.0, zoom));
+    
+    interact();
+}
+
+void SurfaceView::interact()
+{
+    interactive = true;
+    refineTimer.start();
+    
+    update();
+}
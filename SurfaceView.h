@@ -0,0 +1,59 @@
+//
+//  SurfaceView.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__SurfaceView__
+#define __MathGraph__SurfaceView__
+
+#include "SurfacePlot.h"
+
+#include <QWidget>
+#include <QImage>
+#include <QTimer>
+#include <QMouseEvent>
+#include <QWheelEvent>
+
+// Window with a 3D view of a surface, dragging turns it and the wheel zooms. While dragging a
+// coarser grid is drawn, the full one is drawn once the mouse has been still for a moment.
+class SurfaceView : public QWidget
+{
+    Q_OBJECT
+    
+public:
+    SurfaceView(const SurfacePlot &_surface, QWidget *parent = nullptr);
+    
+    QSize sizeHint() const;
+    
+private slots:
+    void refine();
+    
+protected:
+    void paintEvent(QPaintEvent *event);
+    
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    void wheelEvent(QWheelEvent *event);
+    
+private:
+    const int REFINE_DELAY = 150; // Milliseconds after the last change
+    const double RADIANS_PER_PIXEL = 0.01;
+    const double MAX_PITCH = 1.5;
+    
+    void interact();
+    
+    SurfacePlot surface;
+    double yaw;
+    double pitch;
+    double zoom;
+    bool interactive;
+    QPoint lastPosition;
+    QTimer refineTimer;
+    QImage image;
+};
+
+#endif /* defined(__MathGraph__SurfaceView__) */
@@ -0,0 +1,142 @@
+//
+//  ThreadPool.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "ThreadPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+ThreadPool &ThreadPool::globalInstance()
+{
+    static ThreadPool pool(std::thread::hardware_concurrency());
+    
+    return pool;
+}
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+    : workers(),
+      tasks(),
+      mutex(),
+      condition(),
+      stopping(false)
+{
+    // The thread calling parallelFor does its share, so one core is left for it
+    for (unsigned int i = 1; i < numThreads; ++i)
+    {
+        workers.emplace_back(&ThreadPool::work, this);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    
+    condition.notify_all();
+    
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+unsigned int ThreadPool::numThreads() const
+{
+    return static_cast<unsigned int>(workers.size()) + 1;
+}
+
+void ThreadPool::parallelFor(size_type count, const std::function<void(size_type)> &body)
+{
+    struct Job
+    {
+        std::atomic<size_type> next;
+        size_type finished;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+    
+    if (count == 0) return;
+    
+    std::shared_ptr<Job> job = std::make_shared<Job>();
+    job->next = 0;
+    job->finished = 0;
+    
+    const std::function<void(size_type)> *bodyPointer = &body;
+    
+    // Helpers that start after the job is finished find no index left and never touch body
+    std::function<void()> run = [job, count, bodyPointer]()
+    {
+        size_type i;
+        while ((i = job->next++) < count)
+        {
+            std::exception_ptr error;
+            
+            try
+            {
+                (*bodyPointer)(i);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+            
+            std::lock_guard<std::mutex> lock(job->mutex);
+            
+            if (error && !job->error) job->error = error;
+            
+            if (++job->finished == count) job->done.notify_all();
+        }
+    };
+    
+    size_type numHelpers = std::min<size_type>(workers.size(), count - 1);
+    if (numHelpers != 0)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            
+            for (size_type i = 0; i != numHelpers; ++i)
+            {
+                tasks.push_back(run);
+            }
+        }
+        
+        condition.notify_all();
+    }
+    
+    run();
+    
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [job, count]() { return job->finished == count; });
+    
+    if (job->error) std::rethrow_exception(job->error);
+}
+
+void ThreadPool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            
+            if (stopping && tasks.empty()) return;
+            
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        
+        task();
+    }
+}
@@ -0,0 +1,50 @@
+//
+//  ThreadPool.h
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#ifndef __MathGraph__ThreadPool__
+#define __MathGraph__ThreadPool__
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class ThreadPool
+{
+public:
+    typedef std::size_t size_type;
+    
+    // Shared by everything that evaluates in parallel, sized to the number of cores
+    static ThreadPool &globalInstance();
+    
+    ThreadPool(unsigned int numThreads);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+    
+    unsigned int numThreads() const;
+    
+    // Calls body(i) for every i in [0, count) and returns when all calls are done. The calling
+    // thread takes part in the work, so parallelFor may be called from inside a task.
+    void parallelFor(size_type count, const std::function<void(size_type)> &body);
+    
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping;
+    
+    void work();
+};
+
+#endif /* defined(__MathGraph__ThreadPool__) */
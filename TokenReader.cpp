@@ -50,6 +50,13 @@ TokenType TokenReader::read(std::string &result)
             case '*':
             case '/':
             case '^':
+            case '=':
+                tokenType = OPERATOR;
+                break;
+            case '<':
+            case '>':
+                if (expressionStream.peek() == '=') result += static_cast<char>(expressionStream.get());
+                
                 tokenType = OPERATOR;
                 break;
             case '(':
@@ -58,6 +65,9 @@ TokenType TokenReader::read(std::string &result)
             case ')':
                 tokenType = PARENTHESIS_END;
                 break;
+            case ',':
+                tokenType = SEPARATOR;
+                break;
             default:
                 if (isalpha(c))
                 {
@@ -82,7 +92,10 @@ TokenType TokenReader::read(std::string &result)
 
 size_t TokenReader::getCurrentPosition()
 {
-    return expressionStream.tellg();
+    std::streampos position = expressionStream.tellg();
+    
+    // After reading past the end the stream has failed and tellg returns -1
+    return position != std::streampos(-1) ? static_cast<size_t>(position) : expressionStream.str().length();
 }
 
 bool TokenReader::isOperator(const std::string &token)
@@ -99,11 +112,17 @@ bool TokenReader::isOperator(const std::string &token)
             case '*':
             case '/':
             case '^':
+            case '=':
                 isOpr = true;
         }
     }
     
-    return isOpr;
+    return isOpr || isComparison(token);
+}
+
+bool TokenReader::isComparison(const std::string &token)
+{
+    return token == "<" || token == ">" || token == "<=" || token == ">=";
 }
 
 bool TokenReader::isUnary(const std::string &token)
@@ -120,23 +139,30 @@ int TokenReader::operatorPrecedence(const std::string &token)
 {
     int precedence = -1;
     
-    if (token.length() == 1)
+    if (isComparison(token))
+    {
+        precedence = 2;
+    }
+    else if (token.length() == 1)
     {
         switch (token[0])
         {
+            case '=':
+                precedence = 1;
+                break;
             case '+':
             case '-':
-                precedence = 2;
+                precedence = 3;
                 break;
             case '*':
             case '/':
-                precedence = 3;
+                precedence = 4;
                 break;
             case '~':
-                precedence = 4;
+                precedence = 5;
                 break;
             case '^':
-                precedence = 5;
+                precedence = 6;
                 break;
         }
     }
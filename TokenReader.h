@@ -18,6 +18,7 @@ enum TokenType
     NAME,
     PARENTHESIS_START,
     PARENTHESIS_END,
+    SEPARATOR,
     END,
     BAD_TOKEN
 };
@@ -33,6 +34,7 @@ public:
     size_t getCurrentPosition();
     
     static bool isOperator(const std::string &token);
+    static bool isComparison(const std::string &token);
     static bool isUnary(const std::string &token);
     static bool isLeftAssociative(const std::string &token);
     static int operatorPrecedence(const std::string &token);
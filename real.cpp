@@ -8,6 +8,9 @@
 
 #include "real.h"
 
+#include <cstdio>
+#include <cstdlib>
+
 bool real_functions::parseReal(const std::string &str, long double &r)
 {
     try
@@ -37,3 +40,46 @@ std::string real_functions::toString(real value)
     
     return result;
 }
+
+std::string real_functions::toShortString(double value)
+{
+    if (std::isnan(value)) return "nan";
+    if (std::isinf(value)) return value > 0 ? "inf" : "-inf";
+    if (value == 0) return "0";
+    
+    // Digits of round values like axis markers are found in the first or second try
+    char buffer[32];
+    for (int precision = 0; precision != 17; ++precision)
+    {
+        std::snprintf(buffer, sizeof(buffer), "%.*e", precision, value);
+        if (std::strtod(buffer, nullptr) == value) break;
+    }
+    
+    // Split d.ddde+x into its digits and exponent
+    std::string text(buffer);
+    std::string::size_type e = text.find('e');
+    int exponent = std::atoi(text.c_str() + e + 1);
+    
+    std::string sign = value < 0 ? "-" : "";
+    std::string digits;
+    for (std::string::size_type i = sign.size(); i != e; ++i)
+    {
+        if (text[i] != '.') digits += text[i];
+    }
+    
+    const int MIN_FIXED_EXPONENT = -5;
+    const int MAX_FIXED_EXPONENT = 11;
+    
+    if (exponent < MIN_FIXED_EXPONENT || exponent > MAX_FIXED_EXPONENT)
+    {
+        std::string mantissa = digits.substr(0, 1) + (digits.size() > 1 ? "." + digits.substr(1) : "");
+        
+        return sign + mantissa + "e" + std::to_string(exponent);
+    }
+    
+    if (exponent < 0) return sign + "0." + std::string(-exponent - 1, '0') + digits;
+    
+    if (static_cast<int>(digits.size()) <= exponent + 1) return sign + digits + std::string(exponent + 1 - digits.size(), '0');
+    
+    return sign + digits.substr(0, exponent + 1) + "." + digits.substr(exponent + 1);
+}
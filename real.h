@@ -30,6 +30,7 @@ namespace real_functions
     
     const auto ceil  = static_cast<real (*)(real)>( std::ceil );
     const auto floor = static_cast<real (*)(real)>( std::floor );
+    const auto abs   = static_cast<real (*)(real)>( std::fabs );
     
     const auto ln    = static_cast<real (*)(real)>( std::log );
     const auto log10 = static_cast<real (*)(real)>( std::log10 );
@@ -37,6 +38,10 @@ namespace real_functions
     bool parseReal(const std::string &str, long double &r);
     real round(real value, int decimals);
     std::string toString(real value);
+    
+    // The fewest significant digits that read back as the same double, like 0.3 for 0.3000000000000000166.
+    // Very large and very small values are written with an exponent.
+    std::string toShortString(double value);
 }
 
 #endif /* defined(__MathGraph__real__) */
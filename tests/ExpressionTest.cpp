@@ -0,0 +1,67 @@
+//
+//  ExpressionTest.cpp
+//  MathGraph
+//
+//  Copyright Max Ekström. Licensed under GPL v3 (see README).
+//
+//
+
+#include "Expression.h"
+
+#include <iostream>
+#include <string>
+
+namespace
+{
+    int failures = 0;
+    
+    void check(bool passed, const std::string &what)
+    {
+        if (!passed)
+        {
+            std::cerr << "FAIL: " << what << std::endl;
+            ++failures;
+        }
+    }
+    
+    bool isRejected(const std::string &expression)
+    {
+        try
+        {
+            Expression parsed(expression);
+        }
+        catch (const InvalidExpression &)
+        {
+            return true;
+        }
+        
+        return false;
+    }
+    
+    void testComparisons()
+    {
+        check(Expression("x < 3").evaluate(2) == 1, "x < 3 at 2");
+        check(Expression("x < 3").evaluate(4) == 0, "x < 3 at 4");
+        check(Expression("if(0 < x, 1, 2)").evaluate(-1) == 2, "if(0 < x, 1, 2) at -1");
+        check(Expression("if(0 < x, x < 3, 0)").evaluate(4) == 0, "if(0 < x, x < 3, 0) at 4");
+        check(Expression("(0 < x) * (x < 3)").evaluate(4) == 0, "(0 < x) * (x < 3) at 4");
+        
+        // a < b < c would compare the 0 or 1 of a < b to c
+        check(isRejected("2 < x < 3"), "2 < x < 3 is rejected");
+        check(isRejected("if(0 < x < 3, 1, 0)"), "if(0 < x < 3, 1, 0) is rejected");
+        check(isRejected("1 < x < 2 < 3"), "1 < x < 2 < 3 is rejected");
+        check(isRejected("1 <= x >= 2"), "1 <= x >= 2 is rejected");
+        
+        // Inequalities of y are bounds, not chained comparisons
+        check(Expression("x < y < x + 1").getKind() == Expression::INEQUALITY, "x < y < x + 1 is an inequality");
+    }
+}
+
+int main()
+{
+    testComparisons();
+    
+    if (failures == 0) std::cout << "All tests passed" << std::endl;
+    
+    return failures == 0 ? 0 : 1;
+}
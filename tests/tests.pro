@@ -0,0 +1,24 @@
+#
+#   tests.pro
+#   MathGraph
+#
+#   Copyright Max Ekström. Licensed under GPL v3 (see README).
+#
+#
+
+CONFIG += c++11 console
+CONFIG -= qt app_bundle
+
+TARGET = ExpressionTest
+TEMPLATE = app
+
+INCLUDEPATH += ..
+
+SOURCES +=  ExpressionTest.cpp \
+            ../Expression.cpp \
+            ../TokenReader.cpp \
+            ../real.cpp \
+            ../CumulativeIntegral.cpp \
+            ../GridCache.cpp \
+            ../Integrator.cpp \
+            ../ThreadPool.cpp